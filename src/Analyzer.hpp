@@ -4,18 +4,24 @@
 #include <cmath>
 #include <memory>    // unique_ptr, shared_ptr
 #include <algorithm> // min, max
+#include <vector>
+#include <cstdint>
+#include <cstring>   // memcpy
 #ifdef ANALYZER_DEBUG
 #  include <fstream>
 #endif
 
 #include <fft4g.hpp>
 
+#include "ConstantQ.hpp"
+#include "WorkerPool.hpp"
+
 #ifndef ANALYZER_SAMPLE_FREQ
 #define ANALYZER_SAMPLE_FREQ 44100 // Hz
 #endif // ANALYZER_SAMPLE_FREQ
 
 #ifndef ANALYZER_ANALYZE_FREQ
-#define ANALYZER_ANALYZE_FREQ 30   // Hz
+#define ANALYZER_ANALYZE_FREQ 30   // Hz, default, see Analyzer::set_analyze_freq()
 #endif // ANALYZER_ANALYZE_FREQ
 
 #ifndef ANALYZER_ANALYZE_SPAN
@@ -32,6 +38,7 @@
 class Analyzer {
 public:
     typedef          float  sample_t;           // sample type
+    typedef void (*analyzeCb)(Analyzer &analyzer, void *param); // called after each analysis
     static constexpr double sample_fsval = 1.0; // sample full-scale value
 
     static constexpr double FREQ_A8 = 7040.0;
@@ -47,22 +54,53 @@ public:
 
     static const     double SAMPLE_FREQ;
     static const     size_t FFTSIZE;
-    static const     size_t ANALYZE_INTERVAL;
-    static const     size_t PITCH_BUF_SIZE;
+    static const     size_t &ANALYZE_INTERVAL;  // samples between analyses, set_analyze_freq() sets it
+    static const     size_t &PITCH_BUF_SIZE;    // analyses kept, ANALYZER_ANALYZE_SPAN seconds worth
+    static const     size_t CQ_KEYS;            // constant-Q keys, C1..C8
+    static constexpr double ANALYZE_FREQ_MIN = 10.0;  // Hz
+    static constexpr double ANALYZE_FREQ_MAX = 500.0; // Hz
+    static constexpr size_t BATCH_MAX = 16;     // analyses run at once on the pool, see addData()
+    static constexpr double GATE_RATIO = 0.5;   // the gate opens at this share of the threshold, see set_gate()
+    static constexpr float  DC_POLE = 0.999f;   // DC blocker of addFrames(), -3 dB at ~7 Hz
+
+    // interleaved sample formats taken by addFrames(), little endian, s24 is packed
+    enum InputFormat {
+        InputU8,
+        InputS16,
+        InputS24,
+        InputS32,
+        InputF32
+    };
 
     Analyzer() :
         threshold(2.0),
         analyze_cnt(0),
         total_analyze_cnt(0),
         peak_freq(-1.0),
+        level(0.0),
+        confidence(0.0),
         han_window(new double[FFTSIZE]),
         acf_data(new double[FFTSIZE]()),
         fft((int)FFTSIZE),
         fft_data(new double[FFTSIZE]()),
         pitch_buf(new float[PITCH_BUF_SIZE]),
         pitch_buf_pos(0),
-        wave_data(new sample_t[FFTSIZE]()),
-        wave_data_pos(0)
+        wave_size(FFTSIZE + BATCH_MAX * ANALYZE_INTERVAL),
+        wave_data(new sample_t[wave_size]()),
+        wave_data_pos(0),
+        analyze_cb(nullptr),
+        analyze_cb_param(nullptr),
+        gate(false),
+        gate_open(true),
+        gate_stride(1),
+        gate_hold(0),
+        gate_idle(0),
+        gate_frames(0),
+        gated_cnt(0),
+        fft_stale(false),
+        dc_x(0.0f),
+        dc_y(0.0f),
+        input_peak(0.0f)
     {
         for(size_t i = 0; i < FFTSIZE; ++i)
             han_window[i] = (0.5 - std::cos((double)i * M_PI * 2 / (double)FFTSIZE) * 0.5) / sample_fsval;
@@ -73,22 +111,99 @@ public:
 
     void addData(sample_t sample) {
         wave_data[wave_data_pos] = sample;
-        wave_data_pos = (wave_data_pos + 1) % FFTSIZE;
+        wave_data_pos = (wave_data_pos + 1) % wave_size;
         if (++analyze_cnt == ANALYZE_INTERVAL) {
-            analyze();
+            analyze(wave_data_pos);
             analyze_cnt = 0;
         }
     }
 
+    // adds count samples taken every stride elements, i.e. a single channel of an interleaved buffer,
+    // with a pool the analyses falling within the block run in parallel, each window is complete
+    // once its samples are in, results are committed in the frame order as if analyzed one by one,
+    // don't pass the pool the caller is running on
+    void addData(const sample_t *data, size_t count, size_t stride = 1, WorkerPool *pool = nullptr) {
+        feed(count, [&](sample_t *dst, size_t n) {
+            for (; n; --n, data += stride)
+                *dst++ = *data;
+        }, pool);
+    }
+
+    // device ingest: takes interleaved frames as they come, converts, downmixes all channels
+    // (or takes the given one), removes DC and meters the peak level in a single pass straight
+    // into the wave ring; pool as for addData()
+    void addFrames(const void *data, InputFormat format, size_t frames, size_t channels, int channel = -1, WorkerPool *pool = nullptr) {
+        if (!channels)
+            return;
+        switch (format) {
+        case InputU8:  ingest<uint8_t>(data, frames, channels, channel, pool); break;
+        case InputS16: ingest<int16_t>(data, frames, channels, channel, pool); break;
+        case InputS24: ingest<S24>(data, frames, channels, channel, pool); break;
+        case InputS32: ingest<int32_t>(data, frames, channels, channel, pool); break;
+        case InputF32: ingest<float>(data, frames, channels, channel, pool); break;
+        }
+    }
+
+    // peak absolute level taken by addFrames() since the last call, 0~1
+    float take_input_peak() {
+        float peak = input_peak;
+        input_peak = 0.0f;
+        return peak;
+    }
+
     void clearData() {
         wave_data_pos = 0;
         analyze_cnt = 0;
+        dc_x = dc_y = 0.0f;
+    }
+
+    // reallocates the rate dependent buffers after set_analyze_freq(), the history is dropped
+    void resize() {
+        wave_size = FFTSIZE + BATCH_MAX * ANALYZE_INTERVAL;
+        wave_data.reset(new sample_t[wave_size]());
+        pitch_buf.reset(new float[PITCH_BUF_SIZE]);
+        if (cq)
+            cq_data.reset(new float[cq->size() * PITCH_BUF_SIZE]);
+        pitch_buf_pos = 0;
+        total_analyze_cnt = 0;
+        clearData();
+        clearPitch();
+    }
+
+    // makes the batch working sets for blocks of up to the given frames ahead of the first batch
+    // and touches their pages, so the audio thread neither allocates nor faults them in later
+    void prefault(size_t frames) {
+        size_t count = std::min(BATCH_MAX, frames / ANALYZE_INTERVAL + 1);
+        while (batch_slots.size() < count)
+            batch_slots.emplace_back(new BatchSlot());
+        for (auto &bs : batch_slots) {
+            std::fill(bs->fft_data.get(), bs->fft_data.get() + FFTSIZE, 0.0);
+            std::fill(bs->acf_data.get(), bs->acf_data.get() + FFTSIZE, 0.0);
+        }
+    }
+
+    void clearPitch() {
+        for(size_t i = 0; i < PITCH_BUF_SIZE; ++i)
+            pitch_buf[i] = -1.0f;
+        if (cq_data)
+            std::fill(cq_data.get(), cq_data.get() + cq->size() * PITCH_BUF_SIZE, 0.0f);
+        peak_freq = -1.0;
     }
 
     double get_peak_freq() {
         return peak_freq;
     }
 
+    // signal level of the last analyzed frame, compared against the threshold
+    double get_level() {
+        return level;
+    }
+
+    // normalized autocorrelation at the detected period (0~1), 0 if no pitch was detected
+    double get_confidence() {
+        return confidence;
+    }
+
     std::shared_ptr<const double[]> get_fft_buf() {
         return fft_data;
     }
@@ -97,6 +212,16 @@ public:
         return pitch_buf;
     }
 
+    // constant-Q key magnitudes, a frame of get_cq_keys() per pitch buffer element, in the same ring order,
+    // nullptr unless enabled by set_cq()
+    std::shared_ptr<const float[]> get_cq_buf() {
+        return cq_data;
+    }
+
+    size_t get_cq_keys() {
+        return cq ? cq->size() : 0;
+    }
+
     size_t get_pitch_buf_pos() {
         return pitch_buf_pos;
     }
@@ -113,11 +238,66 @@ public:
         threshold = thres;
     }
 
+    // energy pre-gate: the signal energy is taken in the time domain first, frames well below
+    // the threshold skip both FFTs and come out as no pitch with zero spectrum, as they would anyway;
+    // the gate opens at GATE_RATIO of the threshold and stays open for 100 ms after,
+    // with idle_stride > 1 only every idle_stride-th frame is checked while closed
+    void set_gate(bool enable, size_t idle_stride = 1) {
+        gate = enable;
+        gate_stride = std::max<size_t>(idle_stride, 1);
+        gate_open = true;
+        gate_hold = 0;
+    }
+
+    // frames passed through the gate and skipped by it since the last reset
+    size_t get_gate_frames() { return gate_frames; }
+    size_t get_gated_cnt() { return gated_cnt; }
+    void reset_gate_stats() { gate_frames = gated_cnt = 0; }
+
+    // the callback runs in the thread feeding the data, right after the new frame is analyzed
+    void set_analyze_cb(analyzeCb cb, void *param = nullptr) {
+        analyze_cb = cb;
+        analyze_cb_param = param;
+    }
+
+    // enables the constant-Q transform after each analysis, nullptr disables it,
+    // the kernel has to be built for FFTSIZE and SAMPLE_FREQ, see make_cq_kernel()
+    void set_cq(std::shared_ptr<const ConstantQ> kernel) {
+        if (kernel && (!cq_data || !cq || cq->size() != kernel->size()))
+            cq_data.reset(new float[kernel->size() * PITCH_BUF_SIZE]());
+        else if (!kernel)
+            cq_data.reset();
+        cq = kernel;
+    }
+
+    static std::shared_ptr<const ConstantQ> make_cq_kernel()
+    {
+        return std::make_shared<const ConstantQ>(FFTSIZE, SAMPLE_FREQ, FREQ_C1, CQ_KEYS);
+    }
+
     static float get_interval_sec()
     {
         return (float)ANALYZE_INTERVAL / (float)SAMPLE_FREQ;
     }
 
+    // actual analysis rate, the interval is a whole number of samples
+    static double get_analyze_freq()
+    {
+        return SAMPLE_FREQ / (double)ANALYZE_INTERVAL;
+    }
+
+    // sets the analysis rate, Hz, process wide, false if out of range,
+    // call before creating analyzers or resize() the existing ones, the audio callback interval
+    // should follow ANALYZE_INTERVAL
+    static bool set_analyze_freq(double freq)
+    {
+        if (!(freq >= ANALYZE_FREQ_MIN && freq <= ANALYZE_FREQ_MAX))
+            return false;
+        analyze_interval = (size_t)(SAMPLE_FREQ / freq + 0.5);
+        pitch_buf_size = (size_t)(get_analyze_freq() * (ANALYZER_ANALYZE_SPAN) + 0.5);
+        return true;
+    }
+
     static double sharp_of(const double freq)
     {
         return std::pow(2.0, 1.0/12.0) * freq;
@@ -149,41 +329,305 @@ protected:
     size_t analyze_cnt;
     size_t total_analyze_cnt;
     double peak_freq;
+    double level;
+    double confidence;
     std::unique_ptr<double[]> han_window;
     std::unique_ptr<double[]> acf_data;
     fft4g fft;
     std::shared_ptr<double[]> fft_data;
     std::shared_ptr<float[]> pitch_buf;
     size_t pitch_buf_pos;
+    size_t wave_size;     // FFTSIZE plus the batch samples, the batch windows are all kept
     std::unique_ptr<sample_t[]> wave_data;
     size_t wave_data_pos;
+    analyzeCb analyze_cb;
+    void *analyze_cb_param;
+    std::shared_ptr<const ConstantQ> cq;
+    std::shared_ptr<float[]> cq_data;
+    bool gate;
+    bool gate_open;
+    size_t gate_stride;
+    size_t gate_hold;     // frames left before the gate closes
+    size_t gate_idle;     // frames since the gate closed
+    size_t gate_frames;
+    size_t gated_cnt;
+    bool fft_stale;       // fft_data holds a spectrum, the next skipped frame clears it
+    float dc_x, dc_y;     // DC blocker state, the last input and output
+    float input_peak;
+
+    // appends count samples written by fill(sample_t *dst, size_t n) in runs up to the ring wrap,
+    // analyzes as the intervals complete, see addData()
+    template<typename Fill>
+    void feed(size_t count, Fill &&fill, WorkerPool *pool) {
+        while (count) {
+            size_t ends[BATCH_MAX];
+            size_t batch = 0;
+            while (count && batch < BATCH_MAX) {
+                size_t n = std::min(count, ANALYZE_INTERVAL - analyze_cnt);
+                count -= n;
+                analyze_cnt += n;
+                while (n) {
+                    size_t run = std::min(n, wave_size - wave_data_pos);
+                    fill(wave_data.get() + wave_data_pos, run);
+                    wave_data_pos += run;
+                    if (wave_data_pos == wave_size)
+                        wave_data_pos = 0;
+                    n -= run;
+                }
+                if (analyze_cnt == ANALYZE_INTERVAL) {
+                    analyze_cnt = 0;
+                    if (!pool || pool->size() == 0) {
+                        analyze(wave_data_pos);
+                        continue;
+                    }
+                    ends[batch++] = wave_data_pos;
+                }
+            }
+            if (batch)
+                analyze_batch(ends, batch, *pool);
+        }
+    }
+
+    // packed 24 bit sample
+    struct S24 { uint8_t b[3]; };
+
+    static float to_float(uint8_t v) { return (float)((int)v - 128) * (1.0f / 128.0f); }
+    static float to_float(int16_t v) { return (float)v * (1.0f / 32768.0f); }
+    static float to_float(S24 v) { return (float)(int32_t)((uint32_t)v.b[0] << 8 | (uint32_t)v.b[1] << 16 | (uint32_t)v.b[2] << 24) * (1.0f / 2147483648.0f); }
+    static float to_float(int32_t v) { return (float)v * (1.0f / 2147483648.0f); }
+    static float to_float(float v) { return v; }
+
+    // sums mix channels of n frames, the compiler vectorizes it for the fixed channel counts
+    template<typename T, size_t MIX>
+    static void mix_frames(const T *src, size_t stride, size_t mix, size_t n, float scale, float *dst) {
+        if (MIX)
+            mix = MIX;
+        for (size_t i = 0; i < n; ++i) {
+            const T *frame = src + i * stride;
+            float sum = 0.0f;
+            for (size_t ch = 0; ch < mix; ++ch)
+                sum += to_float(frame[ch]);
+            dst[i] = sum * scale;
+        }
+    }
 
-    void analyze()
+    template<typename T>
+    void ingest(const void *data, size_t frames, size_t channels, int channel, WorkerPool *pool) {
+        static_assert(sizeof(S24) == 3, "packed s24");
+        const T *src = (const T*)data;
+        size_t mix = channels;
+        if (channel >= 0 && (size_t)channel < channels) {
+            src += channel;
+            mix = 1;
+        }
+        const float scale = 1.0f / (float)mix;
+        feed(frames, [&](sample_t *dst, size_t n) {
+            // in blocks of L1 sized scratch, the DC blocker is a recursion and goes sample by sample
+            constexpr size_t block = 256;
+            float mono[block];
+            float x1 = dc_x, y1 = dc_y, peak = input_peak;
+            while (n) {
+                size_t m = std::min(n, block);
+                if (mix == 1)
+                    mix_frames<T, 1>(src, channels, 1, m, scale, mono);
+                else if (mix == 2)
+                    mix_frames<T, 2>(src, channels, 2, m, scale, mono);
+                else
+                    mix_frames<T, 0>(src, channels, mix, m, scale, mono);
+                for (size_t i = 0; i < m; ++i) {
+                    float y = mono[i] - x1 + DC_POLE * y1;
+                    x1 = mono[i];
+                    y1 = y;
+                    dst[i] = y;
+                    peak = std::max(peak, std::fabs(y));
+                }
+                src += m * channels;
+                dst += m;
+                n -= m;
+            }
+            dc_x = x1;
+            dc_y = y1;
+            input_peak = peak;
+        }, pool);
+    }
+
+    // working set of a batch job
+    struct BatchSlot {
+        BatchSlot() : fft((int)FFTSIZE), fft_data(new double[FFTSIZE]), acf_data(new double[FFTSIZE]) {}
+        fft4g fft;
+        std::unique_ptr<double[]> fft_data;
+        std::unique_ptr<double[]> acf_data;
+        double peak_freq, level, confidence;
+        bool skipped;
+    };
+    std::vector<std::unique_ptr<BatchSlot>> batch_slots; // allocated by the first batch
+
+    static size_t analyze_interval;
+    static size_t pitch_buf_size;
+
+    void analyze(size_t end)
     {
+        confidence = 0.0;
+        if (!pass_gate(end, level)) {
+            skip_frame();
+            return;
+        }
+        peak_freq = analyze_window(end, fft, fft_data.get(), acf_data.get(), level, confidence);
+        fft_stale = gate;
+        if (cq)
+            cq->transform(fft_data.get(), cq_data.get() + pitch_buf_pos * cq->size());
+        commit();
+    }
+
+    // windowed energy of the FFTSIZE samples before the wave position end, equals acf_data[0]
+    // of the spectral path: rdft does not scale, so the lag 0 sum is FFTSIZE / 2 times the energy
+    double window_energy(size_t end) const
+    {
+        size_t start = (end + wave_size - FFTSIZE) % wave_size;
+        size_t first = std::min(FFTSIZE, wave_size - start); // up to the ring wrap
+        double energy = 0.0;
+        for (size_t i = 0; i < first; ++i) {
+            double v = han_window[i] * wave_data[start + i];
+            energy += v * v;
+        }
+        for (size_t i = first; i < FFTSIZE; ++i) {
+            double v = han_window[i] * wave_data[i - first];
+            energy += v * v;
+        }
+        return energy * (double)(FFTSIZE / 2);
+    }
+
+    // true if the frame needs the spectral stages, frame_level is set otherwise, frames go in order
+    bool pass_gate(size_t end, double &frame_level)
+    {
+        if (!gate)
+            return true;
+        ++gate_frames;
+        if (!gate_open && ++gate_idle % gate_stride) {
+            ++gated_cnt; // not checked, the level stays
+            return false;
+        }
+        double lvl = std::sqrt(window_energy(end));
+        if (lvl >= threshold * GATE_RATIO) {
+            gate_open = true;
+            gate_hold = std::max<size_t>((size_t)(get_analyze_freq() / 10.0), 1);
+            return true;
+        }
+        if (gate_open && gate_hold) {
+            --gate_hold;
+            return true;
+        }
+        if (gate_open) {
+            gate_open = false;
+            gate_idle = 0;
+        }
+        frame_level = lvl;
+        ++gated_cnt;
+        return false;
+    }
+
+    // commits a frame the gate skipped, peak_freq, confidence and level are set
+    void skip_frame()
+    {
+        peak_freq = -1.0;
+        if (fft_stale) {
+            std::fill(fft_data.get(), fft_data.get() + FFTSIZE, 0.0);
+            std::fill(acf_data.get(), acf_data.get() + FFTSIZE, 0.0);
+            fft_stale = false;
+        }
+        if (cq)
+            std::fill(cq_data.get() + pitch_buf_pos * cq->size(), cq_data.get() + (pitch_buf_pos + 1) * cq->size(), 0.0f);
+        commit();
+    }
+
+    // analyzes the windows ending at the given wave positions on the pool, commits them in order
+    void analyze_batch(const size_t *ends, size_t count, WorkerPool &pool)
+    {
+        if (count == 1) {
+            analyze(ends[0]);
+            return;
+        }
+        while (batch_slots.size() < count)
+            batch_slots.emplace_back(new BatchSlot());
+
+        // the gate goes in order, only the frames it lets through are spread over the pool
+        size_t jobs[BATCH_MAX];
+        size_t job_count = 0, last_job = 0;
+        for (size_t i = 0; i < count; ++i) {
+            BatchSlot &bs = *batch_slots[i];
+            bs.level = level;
+            bs.skipped = !pass_gate(ends[i], bs.level);
+            level = bs.level;
+            if (!bs.skipped)
+                jobs[job_count++] = last_job = i;
+        }
+
+        pool.run(job_count, [&](size_t j) {
+            size_t i = jobs[j];
+            BatchSlot &bs = *batch_slots[i];
+            bs.confidence = 0.0;
+            bs.peak_freq = analyze_window(ends[i], bs.fft, bs.fft_data.get(), bs.acf_data.get(), bs.level, bs.confidence);
+            if (cq)
+                cq->transform(bs.fft_data.get(), cq_data.get() + (pitch_buf_pos + i) % PITCH_BUF_SIZE * cq->size());
+        });
+
+        for (size_t i = 0; i < count; ++i) {
+            BatchSlot &bs = *batch_slots[i];
+            level = bs.level;
+            confidence = 0.0;
+            if (bs.skipped) {
+                skip_frame();
+                continue;
+            }
+            peak_freq = bs.peak_freq;
+            confidence = bs.confidence;
+            // the callback may look at the spectrum, the last one stays for get_fft_buf()
+            if (analyze_cb || i == last_job) {
+                std::copy(bs.fft_data.get(), bs.fft_data.get() + FFTSIZE, fft_data.get());
+                fft_stale = gate;
+            }
+            if (i == last_job)
+                std::copy(bs.acf_data.get(), bs.acf_data.get() + FFTSIZE, acf_data.get());
+            commit();
+        }
+    }
+
+    // takes the FFTSIZE samples before the wave position end, returns the pitch, -1 if none,
+    // only reads the analyzer state, the batch jobs run it concurrently
+    double analyze_window(size_t end, fft4g &fft, double *fft_data, double *acf_data, double &level, double &confidence) const
+    {
+        size_t start = (end + wave_size - FFTSIZE) % wave_size;
         for (size_t i = 0; i < FFTSIZE; ++i)
-            fft_data[i] = han_window[i] * wave_data[(wave_data_pos + i) % FFTSIZE];
+            fft_data[i] = han_window[i] * wave_data[(start + i) % wave_size];
 
-        fft.rdft(1, fft_data.get());
+        fft.rdft(1, fft_data);
         acf_data[0] = power(fft_data[0], 0.0); // it is NOT math power
         acf_data[1] = power(fft_data[1], 0.0);
         for (size_t i = 2; i < FFTSIZE; i += 2) {
             acf_data[i] = power(fft_data[i], fft_data[i + 1]);
             acf_data[i + 1] = 0.0;
         }
-        fft.rdft(-1, acf_data.get());
+        fft.rdft(-1, acf_data);
 
-        if (std::sqrt(acf_data[0]) >= threshold)
-            peak_freq = detect_pitch();
-        else
-            peak_freq = -1.0;
+        level = std::sqrt(acf_data[0]);
+        if (level >= threshold)
+            return detect_pitch(fft_data, acf_data, confidence);
+        return -1.0;
+    }
 
+    // stores the result of the analysis just done
+    void commit()
+    {
         pitch_buf[pitch_buf_pos] = freq_to_cent(peak_freq);
         pitch_buf_pos = (pitch_buf_pos + 1) % PITCH_BUF_SIZE;
 
         ++total_analyze_cnt;
+
+        if (analyze_cb)
+            analyze_cb(*this, analyze_cb_param);
     }
 
-    double get_fft_value_around_f(double freq) {
+    static double get_fft_value_around_f(const double *fft_data, double freq) {
         int bin  = (int)(freq * (47.0/48.0) / SAMPLE_FREQ * (double)FFTSIZE);
         int stop = (int)(freq * (49.0/48.0) / SAMPLE_FREQ * (double)FFTSIZE);
         double result = 0.0;
@@ -203,7 +647,7 @@ protected:
     }
 
 #ifdef ANALYZER_INTERPOLATION
-    inline double parabolic(const double *data, size_t x)
+    static inline double parabolic(const double *data, size_t x)
     {
         if (x < 1 || x >= FFTSIZE - 1)
             return (double)x;
@@ -214,7 +658,7 @@ protected:
     }
 #endif // ANALYZER_INTERPOLATION
 
-    double detect_pitch()
+    static double detect_pitch(const double *fft_data, const double *acf_data, double &confidence)
     {
         int start = (int)(SAMPLE_FREQ / FREQ_C8) - 1;
         int stop = (int)(SAMPLE_FREQ / FREQ_C1) + 1;
@@ -241,34 +685,35 @@ protected:
         }
         if (peaki == 0 || peakv < acf_data[0] * 0.5)
             return -1.0;
+        confidence = peakv / acf_data[0];
 
         double f0;
         do {
 #ifdef ANALYZER_INTERPOLATION
-            double f1 = SAMPLE_FREQ / parabolic(acf_data.get(), peaki);
+            double f1 = SAMPLE_FREQ / parabolic(acf_data, peaki);
 #else
             double f1 = SAMPLE_FREQ / (double)peaki;
 #endif // ANALYZER_INTERPOLATION
-            double f1mag = get_fft_value_around_f(f1);
+            double f1mag = get_fft_value_around_f(fft_data, f1);
             constexpr double mag_thr = 0.24;
             constexpr double odd_scale = 0.06;
             constexpr double even_scale = 1.25;
             // lower harmonics
             if (f1mag >= mag_thr) {
                 f0 = f1 / 3.0;
-                if (f0 >= FREQ_C1 && get_fft_value_around_f(f0 * 2.0) > f1mag * 3.15)
+                if (f0 >= FREQ_C1 && get_fft_value_around_f(fft_data, f0 * 2.0) > f1mag * 3.15)
                     break;
 
                 f0 = f1 / 2.0;
-                if (f0 >= FREQ_C1 && get_fft_value_around_f(f1 * 1.5) > f1mag * 1.0)
+                if (f0 >= FREQ_C1 && get_fft_value_around_f(fft_data, f1 * 1.5) > f1mag * 1.0)
                     break;
             }
 
             // higher harmonics
             double f2 = f1 * 2.0;
-            double f2mag = get_fft_value_around_f(f2);
+            double f2mag = get_fft_value_around_f(fft_data, f2);
             double f3 = f1 * 3.0;
-            double f3mag = get_fft_value_around_f(f3);
+            double f3mag = get_fft_value_around_f(fft_data, f3);
 
             if (f2mag >= mag_thr &&
                 f2mag > f1mag * even_scale &&
@@ -285,8 +730,10 @@ protected:
                 f3 <= FREQ_C8)
                 f0 = f3;
 
-            if (std::sqrt(std::pow(f2mag, 2) + std::pow(f1mag, 2) + std::pow(f3mag, 2)) < 0.7)
+            if (std::sqrt(std::pow(f2mag, 2) + std::pow(f1mag, 2) + std::pow(f3mag, 2)) < 0.7) {
+                confidence = 0.0;
                 return -1.0;
+            }
         } while(0);
 
 #ifdef ANALYZER_INTERPOLATION
@@ -313,7 +760,7 @@ protected:
             if (peaki == start || peaki == stop)
                 break;
 
-            double x = parabolic(acf_data.get(), peaki);
+            double x = parabolic(acf_data, peaki);
             f0 += SAMPLE_FREQ / (x - px);
             ++peaks;
             px = x;
@@ -354,7 +801,7 @@ public:
         f.open("wave.txt");
         if (f.is_open()) {
             for (size_t i = 0; i < FFTSIZE; ++i)
-                f << wave_data[(wave_data_pos + i) % FFTSIZE] << std::endl;
+                f << wave_data[(wave_data_pos + wave_size - FFTSIZE + i) % wave_size] << std::endl;
             f.close();
         }
         f.open("pitch.txt");
@@ -399,8 +846,11 @@ const double Analyzer::LOG2_FREQ_C1 = std::log2(FREQ_C1);
 
 const double Analyzer::SAMPLE_FREQ = ANALYZER_SAMPLE_FREQ;
 const size_t Analyzer::FFTSIZE = (size_t)std::pow(2.0, std::ceil(std::log2((double)(ANALYZER_SAMPLE_FREQ) / (sharp_of(ANALYZER_BASE_FREQ) - (ANALYZER_BASE_FREQ)))));
-const size_t Analyzer::ANALYZE_INTERVAL = (size_t)((double)(ANALYZER_SAMPLE_FREQ) / (ANALYZER_ANALYZE_FREQ));
-const size_t Analyzer::PITCH_BUF_SIZE = (ANALYZER_ANALYZE_FREQ) * (ANALYZER_ANALYZE_SPAN);
+size_t Analyzer::analyze_interval = (size_t)((double)(ANALYZER_SAMPLE_FREQ) / (ANALYZER_ANALYZE_FREQ));
+size_t Analyzer::pitch_buf_size = (ANALYZER_ANALYZE_FREQ) * (ANALYZER_ANALYZE_SPAN);
+const size_t &Analyzer::ANALYZE_INTERVAL = Analyzer::analyze_interval;
+const size_t &Analyzer::PITCH_BUF_SIZE = Analyzer::pitch_buf_size;
+const size_t Analyzer::CQ_KEYS = 7 * 12 + 1;
 
 // perf using X5675 PC3‑10600
 // clang -O3, 4096 FFT size, no interpolation, 440.wav
@@ -17,6 +17,14 @@
 
 #define MINIAUDIO_IMPLEMENTATION
 #include "AudioHandler.h"
+#include "WavMap.hpp"
+#include "ThreadTuning.hpp"
+
+#if defined(MA_WIN32)
+#include <psapi.h>  // GetProcessMemoryInfo
+#else
+#include <sys/resource.h> // getrusage
+#endif
 
 #define _UNUSED_ [[maybe_unused]]
 
@@ -90,11 +98,155 @@ static ma_decoding_backend_vtable g_ma_decoding_backend_vtable_libopus =
     ma_decoding_backend_uninit__libopus
 };
 
+#endif // defined(HAVE_OPUS)
+
+// uncompressed WAV/RF64 played right from a memory mapping, see WavMap;
+// the frames are converted to the decoder output format on the way out of the mapping,
+// the decoder passes them through then, f32 files are a plain copy
+struct ma_wavmap {
+    ma_data_source_base ds;
+    WavMap map;
+    ma_format format;       // file format
+    ma_format outputFormat;
+    ma_uint64 cursor;
+};
+
+static ma_result ma_wavmap_read(ma_data_source* pDataSource, void* pFramesOut, ma_uint64 frameCount, ma_uint64* pFramesRead)
+{
+    ma_wavmap* pWav = (ma_wavmap*)pDataSource;
+    ma_uint64 frames = std::min<ma_uint64>(frameCount, pWav->map.Frames() - pWav->cursor);
+    const void* pSrc = pWav->map.FrameData(pWav->cursor);
+    if (pWav->outputFormat == pWav->format)
+        memcpy(pFramesOut, pSrc, (size_t)frames * pWav->map.BytesPerFrame());
+    else
+        ma_pcm_convert(pFramesOut, pWav->outputFormat, pSrc, pWav->format, frames * pWav->map.Channels(), ma_dither_mode_none);
+    pWav->cursor += frames;
+    pWav->map.Advise(pWav->cursor);
+    if (pFramesRead)
+        *pFramesRead = frames;
+    return frames == 0 && frameCount > 0 ? MA_AT_END : MA_SUCCESS;
+}
+
+static ma_result ma_wavmap_seek(ma_data_source* pDataSource, ma_uint64 frameIndex)
+{
+    ma_wavmap* pWav = (ma_wavmap*)pDataSource;
+    if (frameIndex > pWav->map.Frames())
+        return MA_INVALID_ARGS;
+    pWav->cursor = frameIndex;
+    pWav->map.Advise(frameIndex);
+    return MA_SUCCESS;
+}
+
+static ma_result ma_wavmap_get_data_format(ma_data_source* pDataSource, ma_format* pFormat, ma_uint32* pChannels, ma_uint32* pSampleRate, ma_channel* pChannelMap, size_t channelMapCap)
+{
+    ma_wavmap* pWav = (ma_wavmap*)pDataSource;
+    if (pFormat)
+        *pFormat = pWav->outputFormat;
+    if (pChannels)
+        *pChannels = pWav->map.Channels();
+    if (pSampleRate)
+        *pSampleRate = pWav->map.SampleRate();
+    if (pChannelMap)
+        ma_channel_map_init_standard(ma_standard_channel_map_microsoft, pChannelMap, channelMapCap, pWav->map.Channels());
+    return MA_SUCCESS;
+}
+
+static ma_result ma_wavmap_get_cursor(ma_data_source* pDataSource, ma_uint64* pCursor)
+{
+    *pCursor = ((ma_wavmap*)pDataSource)->cursor;
+    return MA_SUCCESS;
+}
+
+static ma_result ma_wavmap_get_length(ma_data_source* pDataSource, ma_uint64* pLength)
+{
+    *pLength = ((ma_wavmap*)pDataSource)->map.Frames();
+    return MA_SUCCESS;
+}
+
+static ma_data_source_vtable g_ma_wavmap_ds_vtable =
+{
+    ma_wavmap_read,
+    ma_wavmap_seek,
+    ma_wavmap_get_data_format,
+    ma_wavmap_get_cursor,
+    ma_wavmap_get_length,
+    NULL, /* onSetLooping() */
+    0
+};
+
+static ma_result ma_wavmap_init_file(const WavMap::path_char_t* pFilePath, const ma_decoding_backend_config* pConfig, const ma_allocation_callbacks* pAllocationCallbacks, ma_data_source** ppBackend)
+{
+    static const ma_format formats[] = { ma_format_unknown, ma_format_u8, ma_format_s16, ma_format_s24, ma_format_s32, ma_format_f32 };
+
+    ma_wavmap* pWav = (ma_wavmap*)ma_malloc(sizeof(*pWav), pAllocationCallbacks);
+    if (pWav == NULL)
+        return MA_OUT_OF_MEMORY;
+    new (pWav) ma_wavmap();
+
+    ma_data_source_config dataSourceConfig = ma_data_source_config_init();
+    dataSourceConfig.vtable = &g_ma_wavmap_ds_vtable;
+    ma_result result = ma_data_source_init(&dataSourceConfig, &pWav->ds);
+    if (result == MA_SUCCESS && !pWav->map.Open(pFilePath))
+        result = MA_INVALID_FILE; // not for us, the next backend tries
+    if (result != MA_SUCCESS) {
+        pWav->~ma_wavmap();
+        ma_free(pWav, pAllocationCallbacks);
+        return result;
+    }
+    pWav->format = formats[pWav->map.Format()];
+    pWav->outputFormat = pConfig && pConfig->preferredFormat != ma_format_unknown ? pConfig->preferredFormat : pWav->format;
+    pWav->cursor = 0;
+
+    *ppBackend = pWav;
+    return MA_SUCCESS;
+}
+
+static ma_result ma_decoding_backend_init_file__wavmap(_UNUSED_ void* pUserData, const char* pFilePath, const ma_decoding_backend_config* pConfig, const ma_allocation_callbacks* pAllocationCallbacks, ma_data_source** ppBackend)
+{
+#if defined(MA_WIN32)
+    (void)pFilePath; (void)pConfig; (void)pAllocationCallbacks; (void)ppBackend;
+    return MA_NOT_IMPLEMENTED; // files are opened by the wide name
+#else
+    return ma_wavmap_init_file(pFilePath, pConfig, pAllocationCallbacks, ppBackend);
+#endif
+}
+
+static ma_result ma_decoding_backend_init_file_w__wavmap(_UNUSED_ void* pUserData, const wchar_t* pFilePath, const ma_decoding_backend_config* pConfig, const ma_allocation_callbacks* pAllocationCallbacks, ma_data_source** ppBackend)
+{
+#if defined(MA_WIN32)
+    return ma_wavmap_init_file(pFilePath, pConfig, pAllocationCallbacks, ppBackend);
+#else
+    (void)pFilePath; (void)pConfig; (void)pAllocationCallbacks; (void)ppBackend;
+    return MA_NOT_IMPLEMENTED;
+#endif
+}
+
+static void ma_decoding_backend_uninit__wavmap(_UNUSED_ void* pUserData, ma_data_source* pBackend, const ma_allocation_callbacks* pAllocationCallbacks)
+{
+    ma_wavmap* pWav = (ma_wavmap*)pBackend;
+
+    ma_data_source_uninit(&pWav->ds);
+    pWav->~ma_wavmap();
+    ma_free(pWav, pAllocationCallbacks);
+}
+
+static ma_decoding_backend_vtable g_ma_decoding_backend_vtable_wavmap =
+{
+    NULL, /* onInit(), only files are mapped */
+    ma_decoding_backend_init_file__wavmap,
+    ma_decoding_backend_init_file_w__wavmap,
+    NULL, /* onInitMemory() */
+    ma_decoding_backend_uninit__wavmap
+};
+
+// custom backends are tried before the stock ones, the mapped one goes first, see setMappedPlayback()
 static ma_decoding_backend_vtable* pCustomBackendVTables[] =
 {
+    &g_ma_decoding_backend_vtable_wavmap,
+#if defined(HAVE_OPUS)
     &g_ma_decoding_backend_vtable_libopus
-};
 #endif // defined(HAVE_OPUS)
+};
 
 // wide char functions / wrappers for Windows intl compatibility
 #if defined(MA_WIN32)
@@ -232,27 +384,34 @@ static void ah_log_callback(void* pUserData, _UNUSED_ ma_uint32 level, const cha
 static ma_bool32 ah_device_enum_callback(_UNUSED_ ma_context* pContext, ma_device_type deviceType,
                                          const ma_device_info* pInfo, void* pUserData)
 {
-    AudioHandler::privateContext *ppc = reinterpret_cast<AudioHandler::privateContext*>(pUserData);
-    if (!ppc)
+    AudioHandler::DeviceSnapshot *snapshot = reinterpret_cast<AudioHandler::DeviceSnapshot*>(pUserData);
+    if (!snapshot)
         return MA_FALSE;
 
-    AudioHandler::Devices *devices;
-    if (deviceType == ma_device_type_playback)
-        devices = &ppc->playbackDevices;
-    else
-        devices = &ppc->captureDevices;
+    bool playback = deviceType == ma_device_type_playback;
+    auto &list = playback ? snapshot->playback : snapshot->capture;
+    if (pInfo->isDefault)
+        (playback ? snapshot->playbackDefault : snapshot->captureDefault) = (int)list.size();
+    list.push_back(AudioHandler::Devices::Device({pInfo->name, pInfo->id}));
 
-    if (pInfo->isDefault) {
-        devices->defaultIdx = (int)devices->list.size();
-        if (devices->selectedName.empty())
-            devices->selectedName = pInfo->name;
-    }
-    devices->list.push_back(AudioHandler::Devices::Device({pInfo->name, pInfo->id}));
+    return MA_TRUE;
+}
 
-    if (ppc->log) ppc->log->LogMsg(LOG_DBG, " %s: %s%s", deviceType == ma_device_type_capture ? "Capture" : "Playback",
-            pInfo->name, pInfo->isDefault ? " [default]" : "" );
+static bool ah_same_devices(const std::vector<AudioHandler::Devices::Device> &a, const std::vector<AudioHandler::Devices::Device> &b)
+{
+    return a.size() == b.size()
+        && std::equal(a.begin(), a.end(), b.begin(), [](const AudioHandler::Devices::Device &da, const AudioHandler::Devices::Device &db)
+                      { return da.name == db.name; });
+}
 
-    return MA_TRUE;
+// wakes the enumeration worker up, the result is published when it is done
+static void ah_request_enumeration(AudioHandler::privateContext *ppc)
+{
+    {
+        std::lock_guard<std::mutex> lock(ppc->enumMutex);
+        ppc->enumRequested = true;
+    }
+    ppc->enumCond.notify_one();
 }
 
 static void ah_device_callback(const ma_device_notification* pNotification)
@@ -264,19 +423,101 @@ static void ah_device_callback(const ma_device_notification* pNotification)
     std::unique_lock<std::timed_mutex> lock(ppc->mutex, std::chrono::milliseconds(10));
     if (pNotification->type == ma_device_notification_type_stopped && ppc->state.isActive()) {
         // device externally stopped, sync the state
+        ppc->devicePoolStale = true;
         if (ppc->log) ppc->log->LogMsg(LOG_WARN, "%s device stopped",
                 pNotification->pDevice->type == ma_device_type_playback ? "Playback" : "Capture");
         // reverse order
         ppc->cmdQueue.internalCommand(AudioHandler::CmdEnumerateDevices);
         ppc->cmdQueue.internalCommand(AudioHandler::CmdStop);
     }
+    else if (pNotification->type == ma_device_notification_type_rerouted)
+        ah_request_enumeration(ppc); // default device changed, something was probably plugged in or out
+}
+
+static void ah_fan_out(AudioHandler::privateContext *ppc, ma_format format, ma_uint32 channels, const void *pData, ma_uint32 frameCount);
+
+// pins the device thread on its first callback, the backends don't take an affinity
+static inline void ah_tune_audio_thread(const AudioHandler::privateContext *ppc)
+{
+    static thread_local bool tuned = false;
+    uint64_t cpus;
+    if (tuned || !(cpus = ppc->audioCpus.load(std::memory_order_relaxed)))
+        return;
+    tuned = true;
+    if (!ThreadTuning::SetAffinity(cpus) && ppc->log)
+        ppc->log->LogMsg(LOG_WARN, "Failed to pin the audio thread to cpus 0x%llx", (unsigned long long)cpus);
+}
+
+static void ah_tune_worker_thread(const AudioHandler::privateContext *ppc)
+{
+    uint64_t cpus = ppc->workerCpus;
+    if (ppc->threadPriority == AudioHandler::PriorityRealtime && !ThreadTuning::SetRealtime(ThreadTuning::WorkerPriority) && ppc->log)
+        ppc->log->LogMsg(LOG_WARN, "Failed to set the realtime priority of a worker thread");
+    if (!ThreadTuning::SetAffinity(cpus) && ppc->log)
+        ppc->log->LogMsg(LOG_WARN, "Failed to pin a worker thread to cpus 0x%llx", (unsigned long long)cpus);
+}
+
+// the main device fell behind, a second time in a while the low latency tuner backs off;
+// only flags it, the command thread polls the flag and queues the retune, pushing a command can lock or allocate
+static void ah_xrun(AudioHandler::privateContext *ppc, std::chrono::steady_clock::time_point now)
+{
+    ppc->xruns.fetch_add(1, std::memory_order_relaxed);
+    if (now - ppc->lastXrun < AudioHandler::XrunBackoffWindow && ppc->tunable.load(std::memory_order_relaxed))
+        ppc->retuneRequested.store(true, std::memory_order_relaxed);
+    ppc->lastXrun = now;
 }
 
+// main device callback timing, checks the device clock against the wall clock on the way in:
+// the frames it is short of beyond what its buffer holds were lost to an overrun or played as an underrun;
+// the base is renewed every second, the clock drift never adds up to a buffer
+class ah_callback_clock {
+public:
+    ah_callback_clock(AudioHandler::privateContext *ppc, const ma_device *pDevice, ma_uint32 frameCount) :
+        ppc(ppc), start(std::chrono::steady_clock::now())
+    {
+        if (ppc->clockRestart.exchange(false, std::memory_order_acquire)) {
+            ppc->clockBase = start;
+            ppc->clockFrames = 0;
+            return;
+        }
+        ppc->clockFrames += frameCount;
+        double elapsed = std::chrono::duration<double>(start - ppc->clockBase).count();
+        bool playback = pDevice->type == ma_device_type_playback;
+        ma_uint32 period = playback ? pDevice->playback.internalPeriodSizeInFrames : pDevice->capture.internalPeriodSizeInFrames;
+        ma_uint32 periods = playback ? pDevice->playback.internalPeriods : pDevice->capture.internalPeriods;
+        double slack = (double)period * (periods + 1) + frameCount;
+        if (elapsed * pDevice->sampleRate - (double)ppc->clockFrames > slack) {
+            ah_xrun(ppc, start);
+            ppc->clockBase = start;
+            ppc->clockFrames = 0;
+        } else if (elapsed >= 1.0) {
+            ppc->clockBase = start;
+            ppc->clockFrames = 0;
+        }
+    }
+    ~ah_callback_clock()
+    {
+        uint64_t ns = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        ppc->callbacks.fetch_add(1, std::memory_order_relaxed);
+        ppc->callbackNs.fetch_add(ns, std::memory_order_relaxed);
+        if (ns > ppc->callbackMaxNs.load(std::memory_order_relaxed)) // the only writer
+            ppc->callbackMaxNs.store(ns, std::memory_order_relaxed);
+    }
+
+    std::chrono::steady_clock::time_point now() const { return start; }
+
+private:
+    AudioHandler::privateContext *ppc;
+    std::chrono::steady_clock::time_point start;
+};
+
 static void ah_play_callback(ma_device *pDevice, void *pOutput, _UNUSED_ const void *pInput, ma_uint32 frameCount)
 {
     AudioHandler::privateContext *ppc = reinterpret_cast<AudioHandler::privateContext*>(pDevice->pUserData);
     if (!ppc)
         return;
+    ah_tune_audio_thread(ppc);
+    ah_callback_clock clock(ppc, pDevice, frameCount);
 
     std::unique_lock<std::timed_mutex> lock(ppc->mutex, std::chrono::milliseconds(5));
     if (lock.owns_lock()) {
@@ -294,11 +535,19 @@ static void ah_play_callback(ma_device *pDevice, void *pOutput, _UNUSED_ const v
                 ppc->cmdQueue.internalCommand(AudioHandler::CmdStop);
                 if (ppc->log) ppc->log->LogMsg(LOG_ERR, "Error reading file: %s\n", ma_result_description(result));
             }
+            ppc->publish();
             return;
         }
+        ma_uint64 cursor;
+        if (ma_decoder_get_cursor_in_pcm_frames(ppc->decoder.get(), &cursor) == MA_SUCCESS)
+            ppc->cursor.store(cursor, std::memory_order_relaxed);
 
         if (ppc->frameDataCbProc)
             ppc->frameDataCbProc((AudioHandler::Format)pDevice->playback.format, pDevice->playback.channels, pOutput, (uint32_t)framesRead, ppc->frameDataCbUserData);
+        ah_fan_out(ppc, pDevice->playback.format, pDevice->playback.channels, pOutput, (ma_uint32)framesRead);
+    } else {
+        ppc->callbackMisses.fetch_add(1, std::memory_order_relaxed);
+        ah_xrun(ppc, clock.now());
     }
 }
 
@@ -307,6 +556,11 @@ static void ah_capture_callback(ma_device *pDevice, _UNUSED_ void *pOutput, cons
     AudioHandler::privateContext *ppc = reinterpret_cast<AudioHandler::privateContext*>(pDevice->pUserData);
     if (!ppc)
         return;
+    ah_tune_audio_thread(ppc);
+    ah_callback_clock clock(ppc, pDevice, frameCount);
+
+    // the timeline runs regardless of the lock, group devices follow it
+    ppc->captureFrames += frameCount;
 
     std::unique_lock<std::timed_mutex> lock(ppc->mutex, std::chrono::milliseconds(5));
     if (lock.owns_lock()) {
@@ -315,6 +569,7 @@ static void ah_capture_callback(ma_device *pDevice, _UNUSED_ void *pOutput, cons
 
         if (ppc->frameDataCbProc)
             ppc->frameDataCbProc((AudioHandler::Format)pDevice->capture.format, pDevice->capture.channels, pInput, frameCount, ppc->frameDataCbUserData);
+        ah_fan_out(ppc, pDevice->capture.format, pDevice->capture.channels, pInput, frameCount);
 
         if (ppc->encoder) {
             ma_result result = MA_SUCCESS;
@@ -332,41 +587,382 @@ static void ah_capture_callback(ma_device *pDevice, _UNUSED_ void *pOutput, cons
                 ppc->backendError = result;
                 ppc->cmdQueue.internalCommand(AudioHandler::CmdStop);
                 if (ppc->log) ppc->log->LogMsg(LOG_ERR, "Error writing file: %s\n", ma_result_description(result));
+                ppc->publish();
                 return;
             }
         }
+    } else {
+        ppc->callbackMisses.fetch_add(1, std::memory_order_relaxed);
+        ah_xrun(ppc, clock.now());
+    }
+}
+
+static void ah_group_device_callback(const ma_device_notification* pNotification)
+{
+    AudioHandler::GroupDevice *pgd = reinterpret_cast<AudioHandler::GroupDevice*>(pNotification->pDevice->pUserData);
+    if (!pgd)
+        return;
+
+    // the group device is not vital, just report it, the slot stays until the next start
+    if (pNotification->type == ma_device_notification_type_stopped && pgd->started.exchange(false) && pgd->ppc->log)
+        pgd->ppc->log->LogMsg(LOG_WARN, "Capture group device %u stopped: %s", pgd->index, pgd->name.c_str());
+}
+
+static void ah_group_capture_callback(ma_device *pDevice, _UNUSED_ void *pOutput, const void *pInput, ma_uint32 frameCount)
+{
+    AudioHandler::GroupDevice *pgd = reinterpret_cast<AudioHandler::GroupDevice*>(pDevice->pUserData);
+    if (!pgd || !pgd->rbReady)
+        return;
+    ah_tune_audio_thread(pgd->ppc);
+
+    // no locks here, the worker thread does the rest
+    const ma_uint32 bpf = ma_get_bytes_per_frame(pDevice->capture.format, pDevice->capture.channels);
+    const char *src = (const char*)pInput;
+    ma_uint32 left = frameCount;
+    for (int pass = 0; pass < 2 && left; ++pass) { // ring wraps at most once
+        ma_uint32 frames = left;
+        void *pBuf;
+        if (ma_pcm_rb_acquire_write(&pgd->rb, &frames, &pBuf) != MA_SUCCESS || frames == 0)
+            break;
+        memcpy(pBuf, src, (size_t)frames * bpf);
+        ma_pcm_rb_commit_write(&pgd->rb, frames);
+        src += (size_t)frames * bpf;
+        left -= frames;
+    }
+    if (left)
+        pgd->overruns += left;
+    pgd->framesIn += frameCount;
+    ma_event_signal(&pgd->dataEvent);
+}
+
+// group device worker: keeps the device stream aligned to the main capture timeline
+// by dropping or inserting frames when the clocks diverge by more than two periods
+static void ah_group_worker(AudioHandler::GroupDevice *pgd, ma_format format, ma_uint32 channels, ma_uint32 period)
+{
+    AudioHandler::privateContext *ppc = pgd->ppc;
+    ah_tune_worker_thread(ppc);
+    const ma_uint32 bpf = ma_get_bytes_per_frame(format, channels);
+    const int64_t tolerance = (int64_t)period * 2;
+    std::unique_ptr<char[]> silence(new char[(size_t)period * bpf]());
+    uint64_t out = pgd->framesOut;
+    int64_t offset = 0;
+
+    auto deliver = [&](const void *pData, ma_uint32 frames) {
+        AudioHandler::groupFrameDataCb cb = ppc->groupFrameDataCbProc;
+        if (cb)
+            cb(pgd->index, (AudioHandler::Format)format, channels, pData, frames, (uint64_t)(offset + (int64_t)out), ppc->groupFrameDataCbUserData);
+        out += frames;
+    };
+
+    while (pgd->running) {
+        ma_event_wait(&pgd->dataEvent);
+
+        ma_uint32 avail;
+        while (pgd->running && (avail = ma_pcm_rb_available_read(&pgd->rb)) > 0) {
+            int64_t master = (int64_t)ppc->captureFrames.load();
+            offset = pgd->timelineOffset;
+            if (offset < 0) {
+                // (re)started, join the timeline so the pending frames end at the current main position
+                offset = master - (int64_t)avail - (int64_t)out;
+                pgd->timelineOffset = offset;
+            }
+
+            int64_t drift = offset + (int64_t)(out + avail) - master;
+            if (drift > tolerance) {
+                // device clock runs faster, drop the excess keeping one period of slack
+                ma_uint32 drop = (ma_uint32)std::min<int64_t>(drift - period, avail);
+                ma_pcm_rb_seek_read(&pgd->rb, drop);
+                pgd->slipped += drop;
+                avail -= drop;
+            } else if (drift < -tolerance) {
+                // device clock runs slower or frames were lost, fill the gap with silence
+                uint64_t fill = (uint64_t)(-drift - period);
+                pgd->slipped += fill;
+                while (fill) {
+                    ma_uint32 frames = (ma_uint32)std::min<uint64_t>(fill, period);
+                    deliver(silence.get(), frames);
+                    fill -= frames;
+                }
+            }
+
+            while (avail) {
+                ma_uint32 frames = avail;
+                void *pBuf;
+                if (ma_pcm_rb_acquire_read(&pgd->rb, &frames, &pBuf) != MA_SUCCESS || frames == 0)
+                    break;
+                deliver(pBuf, frames);
+                ma_pcm_rb_commit_read(&pgd->rb, frames);
+                avail -= frames;
+            }
+            pgd->framesOut = out;
+        }
+    }
+}
+
+AudioHandler::GroupDevice::GroupDevice(privateContext *_ppc, unsigned _index, const std::string &_preferred) :
+            ppc(_ppc),
+            index(_index),
+            preferred(_preferred),
+            device(nullptr),
+            rbReady(false),
+            running(false),
+            framesIn(0),
+            framesOut(0),
+            slipped(0),
+            overruns(0),
+            timelineOffset(-1),
+            started(false),
+            startIn(0),
+            startMaster(0)
+{
+    ma_event_init(&dataEvent);
+}
+
+AudioHandler::GroupDevice::~GroupDevice()
+{
+    device = nullptr;
+    if (worker.joinable()) {
+        running = false;
+        ma_event_signal(&dataEvent);
+        worker.join();
+    }
+    if (rbReady)
+        ma_pcm_rb_uninit(&rb);
+    ma_event_uninit(&dataEvent);
+}
+
+static inline size_t ah_chunk_align(size_t bytes)
+{
+    return (bytes + AudioHandler::Subscriber::ChunkAlign - 1) & ~(AudioHandler::Subscriber::ChunkAlign - 1);
+}
+
+// device thread, with the mutex held: one chunk per subscriber, whole or not at all
+static void ah_fan_out(AudioHandler::privateContext *ppc, ma_format format, ma_uint32 channels, const void *pData, ma_uint32 frameCount)
+{
+    if (!frameCount)
+        return;
+
+    const size_t bytes = (size_t)frameCount * ma_get_bytes_per_frame(format, channels);
+    const size_t size = sizeof(AudioHandler::Subscriber::Chunk) + ah_chunk_align(bytes);
+    const AudioHandler::Subscriber::Chunk header = {(uint16_t)format, (uint16_t)channels, frameCount};
+
+    for (auto &ps : ppc->subscribers) {
+        if (!ps)
+            continue;
+        ps->framesIn += frameCount;
+        if (ma_rb_available_write(&ps->rb) < size) {
+            ps->overruns += frameCount;
+            continue;
+        }
+        // the header never wraps, the frames wrap at most once, the padding is left as is
+        const char *src = (const char*)pData;
+        size_t left = size, copy = bytes;
+        for (int pass = 0; pass < 3 && left; ++pass) {
+            size_t n = pass ? left : sizeof(header);
+            void *pBuf;
+            if (ma_rb_acquire_write(&ps->rb, &n, &pBuf) != MA_SUCCESS || n == 0)
+                break;
+            if (pass == 0)
+                memcpy(pBuf, &header, n);
+            else {
+                size_t c = std::min(n, copy);
+                memcpy(pBuf, src, c);
+                src += c;
+                copy -= c;
+            }
+            ma_rb_commit_write(&ps->rb, n);
+            left -= n;
+        }
+        if (!ps->polled)
+            ma_event_signal(&ps->dataEvent);
     }
 }
 
-AudioHandler::privateContext::privateContext(Logger *logptr) :
+// consumer side: delivers the complete chunks, a chunk still being written is left for the next call
+static size_t ah_subscriber_drain(AudioHandler::Subscriber *ps)
+{
+    size_t delivered = 0;
+
+    for (;;) {
+        size_t avail = ma_rb_available_read(&ps->rb);
+        size_t n = sizeof(AudioHandler::Subscriber::Chunk);
+        void *pBuf;
+        if (avail < n || ma_rb_acquire_read(&ps->rb, &n, &pBuf) != MA_SUCCESS || n < sizeof(AudioHandler::Subscriber::Chunk))
+            break;
+        AudioHandler::Subscriber::Chunk header;
+        memcpy(&header, pBuf, sizeof(header));
+        const size_t bytes = (size_t)header.frames * ma_get_bytes_per_frame((ma_format)header.format, header.channels);
+        const size_t size = ah_chunk_align(bytes);
+        if (avail < sizeof(header) + size)
+            break;
+        ma_rb_commit_read(&ps->rb, sizeof(header));
+
+        // right from the ring unless the chunk wraps
+        n = size;
+        if (ma_rb_acquire_read(&ps->rb, &n, &pBuf) != MA_SUCCESS)
+            break;
+        if (n == size) {
+            ps->cbProc((AudioHandler::Format)header.format, header.channels, pBuf, header.frames, ps->userData);
+            ma_rb_commit_read(&ps->rb, size);
+        } else {
+            memcpy(ps->chunk.get(), pBuf, n);
+            ma_rb_commit_read(&ps->rb, n);
+            size_t rest = size - n;
+            if (ma_rb_acquire_read(&ps->rb, &rest, &pBuf) != MA_SUCCESS || rest != size - n)
+                break; // can't happen, the whole chunk is there
+            memcpy(ps->chunk.get() + n, pBuf, rest);
+            ma_rb_commit_read(&ps->rb, rest);
+            ps->cbProc((AudioHandler::Format)header.format, header.channels, ps->chunk.get(), header.frames, ps->userData);
+        }
+        ps->framesOut += header.frames;
+        delivered += header.frames;
+    }
+
+    return delivered;
+}
+
+static void ah_subscriber_worker(AudioHandler::Subscriber *ps, const AudioHandler::privateContext *ppc)
+{
+    ah_tune_worker_thread(ppc);
+    while (ps->running) {
+        ma_event_wait(&ps->dataEvent);
+        if (ps->running)
+            ah_subscriber_drain(ps);
+    }
+}
+
+AudioHandler::Subscriber::Subscriber(frameDataCb _cbProc, void *_userData, bool _polled) :
+            cbProc(_cbProc),
+            userData(_userData),
+            polled(_polled),
+            rbReady(false),
+            running(false),
+            framesIn(0),
+            framesOut(0),
+            overruns(0)
+{
+    ma_event_init(&dataEvent);
+}
+
+AudioHandler::Subscriber::~Subscriber()
+{
+    if (worker.joinable()) {
+        running = false;
+        ma_event_signal(&dataEvent);
+        worker.join();
+    }
+    if (rbReady)
+        ma_rb_uninit(&rb);
+    ma_event_uninit(&dataEvent);
+}
+
+AudioHandler::privateContext::privateContext(Logger *logptr, Backend backend) :
+            backend(backend),
             state(StateExit),
             backendError(MA_SUCCESS),
             updatePlaybackFileName(false),
+            mappedPlayback(true),
             length(0),
             playbackEOFcmd(CmdStop),
             playbackVolumeFactor(1.0f),
+            cmdStats(),
+            callbackMisses(0),
             context(new ma_context),
             device(nullptr),
+            captureChannels(0),
+            devicePeriod(0),
+            deviceChannels(0),
             encoder(nullptr),
             decoder(nullptr),
+            devicePoolStale(false),
+            enumRequested(true),
+            enumExit(false),
             frameDataCbProc(nullptr),
             frameDataCbUserData(nullptr),
             notificationCbProc(nullptr),
             notificationCbUserData(nullptr),
             notificationCbMask(0),
-            log(logptr)
+            notificationWakeupProc(nullptr),
+            notificationQueued(false),
+            notificationHead(0),
+            notificationTail(0),
+            groupFrameDataCbProc(nullptr),
+            groupFrameDataCbUserData(nullptr),
+            captureFrames(0),
+            threadPriority(PriorityDefault),
+            audioCpus(0),
+            workerCpus(0),
+            lowLatencyPeriod(0),
+            tunedPeriod(0),
+            tunable(false),
+            retuneRequested(false),
+            retunePending(false),
+            clockRestart(true),
+            clockFrames(0),
+            xruns(0),
+            callbacks(0),
+            callbackNs(0),
+            callbackMaxNs(0),
+            log(logptr),
+            pubSeq(0),
+            pubState(StateExit),
+            pubHasPlaybackFile(false),
+            pubLength(0),
+            pubHasCursor(false),
+            cursor(0),
+            pubError(MA_SUCCESS),
+            pubErrorLast(MA_SUCCESS),
+            errorTaken(MA_SUCCESS)
 {
-    ma_result result;
-    if (!context
-        || (result = ma_context_init(NULL, 0, NULL, context.get())) != MA_SUCCESS) {
-        backendError = context ? result : MA_OUT_OF_MEMORY;
-        context = nullptr;
-        if (log) log->LogMsg(LOG_ERR, "Failed to init audio context: %s", ma_result_description(backendError));
-        return;
+}
+
+// with the mutex held, after the state, the length or the error changes
+void AudioHandler::privateContext::publish()
+{
+    // a different error set since is not the one taken, it is still to be reported
+    int taken = errorTaken.exchange(MA_SUCCESS, std::memory_order_relaxed);
+    if (taken != MA_SUCCESS && genericError == taken) {
+        backendError = MA_SUCCESS;
+        pubErrorLast = MA_SUCCESS;
+    }
+    if (decoder) {
+        ma_uint64 pos;
+        cursor.store(ma_decoder_get_cursor_in_pcm_frames(decoder.get(), &pos) == MA_SUCCESS ? pos : 0, std::memory_order_relaxed);
     }
 
+    uint32_t seq = pubSeq.load(std::memory_order_relaxed);
+    pubSeq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    pubState.store(state.value, std::memory_order_relaxed);
+    pubHasPlaybackFile.store(state.hasPlaybackFile, std::memory_order_relaxed);
+    pubLength.store(!state.isIdle() && backendError == MA_SUCCESS ? length : 0, std::memory_order_relaxed);
+    pubHasCursor.store(decoder != nullptr, std::memory_order_relaxed);
+    if (genericError != pubErrorLast) // reported once, a new error replaces the one not taken yet
+        pubError.store(pubErrorLast = genericError, std::memory_order_relaxed);
+    pubSeq.store(seq + 2, std::memory_order_release);
+}
+
+static ma_thread_priority ah_thread_priority(AudioHandler::ThreadPriority priority)
+{
+    return priority == AudioHandler::PriorityRealtime ? ma_thread_priority_realtime : ma_thread_priority_default;
+}
+
+// runs on the command thread, the slowest part of the startup on some systems
+ma_result AudioHandler::privateContext::initContext()
+{
+    ma_result result;
+    ma_backend nullBackend = ma_backend_null;
+    if (!context)
+        return MA_OUT_OF_MEMORY;
+    ma_context_config contextConfig = ma_context_config_init();
+    contextConfig.threadPriority = ah_thread_priority(threadPriority);
+    if ((result = ma_context_init(backend == BackendNull ? &nullBackend : NULL, backend == BackendNull ? 1 : 0,
+                                  &contextConfig, context.get())) != MA_SUCCESS)
+        return result;
+
     ma_log_register_callback(&context->log, ma_log_callback_init(ah_log_callback, log));
     context->pUserData = this;
+    return MA_SUCCESS;
 }
 
 AudioHandler::privateContext::~privateContext()
@@ -386,26 +982,53 @@ AudioHandler::AudioHandler(Logger *logptr, uint32_t _sampleRateHz, uint32_t _cha
 {
 }
 
-AudioHandler::AudioHandler(Logger *logptr, uint32_t _sampleRateHz, uint32_t _channels, Format _sampleFormat, Format _recordFormat, uint32_t _frameDataCbInterval) :
+AudioHandler::AudioHandler(Logger *logptr, uint32_t _sampleRateHz, uint32_t _channels, Format _sampleFormat, Format _recordFormat, uint32_t _frameDataCbInterval, Backend _backend, bool _lazyInit) :
                            sampleRateHz(_sampleRateHz),
                            channels(_channels),
                            sampleFormat((ma_format)_sampleFormat),
                            recordFormat((ma_format)_recordFormat),
                            frameDataCbInterval(_frameDataCbInterval),
-                           pc(logptr)
+                           captureFormat((ma_format)_sampleFormat),
+                           pc(logptr, _backend)
 {
-    if (pc.context) {
-        std::unique_lock<std::timed_mutex> lock(pc.mutex);
-        commandThread = std::thread(&AudioHandler::commandProc, this);
-        pc.cond.wait(lock, [this]{ return pc.state.isReady(); });
+    pc.captureChannels = channels;
+    if (_lazyInit || !pc.context)
+        return;
+
+    init();
+    std::unique_lock<std::timed_mutex> lock(pc.mutex);
+    pc.cond.wait(lock, [this]{ return pc.state.isReady() || pc.backendError != MA_SUCCESS; });
+    if (!pc.state.isReady()) {
+        lock.unlock();
+        commandThread.join();
+        pc.context = nullptr;
     }
 }
 
 AudioHandler::~AudioHandler()
 {
     pc.cmdQueue.internalCommand(CmdExit);
+    {
+        std::lock_guard<std::mutex> lock(pc.enumMutex);
+        pc.enumExit = true;
+    }
+    pc.enumCond.notify_one();
+    pc.snapshotCond.notify_all();
     if (commandThread.joinable())
         commandThread.join();
+    if (pc.enumWorker.joinable()) // started by the command thread
+        pc.enumWorker.join();
+}
+
+void AudioHandler::init(uint32_t _frameDataCbInterval)
+{
+    if (!pc.context || commandThread.joinable())
+        return;
+
+    if (_frameDataCbInterval)
+        frameDataCbInterval = _frameDataCbInterval;
+
+    commandThread = std::thread(&AudioHandler::commandProc, this);
 }
 
 void AudioHandler::attachFrameDataCb(frameDataCb cbProc, void *userData)
@@ -424,13 +1047,29 @@ void AudioHandler::removeFrameDataCb()
     pc.frameDataCbUserData = nullptr;
 }
 
-void AudioHandler::attachNotificationCb(unsigned mask, notificationCb cbProc, void *userData)
+void AudioHandler::attachNotificationCb(unsigned mask, notificationCb cbProc, void *userData, bool queued, wakeupCb wakeupProc)
 {
     std::lock_guard<std::timed_mutex> lock(pc.mutex);
 
     pc.notificationCbProc = cbProc;
     pc.notificationCbUserData = userData;
     pc.notificationCbMask = cbProc ? mask : 0;
+    pc.notificationQueued = queued;
+    pc.notificationWakeupProc = wakeupProc;
+}
+
+size_t AudioHandler::dispatchNotifications()
+{
+    size_t head = pc.notificationHead.load(std::memory_order_relaxed);
+    size_t tail = pc.notificationTail.load(std::memory_order_acquire);
+    size_t count = 0;
+    for (; head != tail; ++head, ++count) {
+        const privateContext::QueuedNotification &qn = pc.notificationQueue[head % privateContext::NotificationQueueSize];
+        qn.cbProc({qn.event, qn.dataStr, qn.dataU64}, qn.userData);
+        pc.notificationHead.store(head + 1, std::memory_order_release); // the slot is free again
+    }
+
+    return count;
 }
 
 void AudioHandler::removeNotificationCb()
@@ -442,29 +1081,169 @@ void AudioHandler::removeNotificationCb()
     pc.notificationCbUserData = nullptr;
 }
 
-void AudioHandler::enumerate()
+void AudioHandler::attachGroupFrameDataCb(groupFrameDataCb cbProc, void *userData)
 {
-    if (!pc.context)
+    std::lock_guard<std::timed_mutex> lock(pc.mutex);
+
+    pc.groupFrameDataCbProc = nullptr;
+    pc.groupFrameDataCbUserData = userData;
+    pc.groupFrameDataCbProc = cbProc;
+}
+
+void AudioHandler::removeGroupFrameDataCb()
+{
+    std::lock_guard<std::timed_mutex> lock(pc.mutex);
+
+    pc.groupFrameDataCbProc = nullptr;
+}
+
+void AudioHandler::setThreadPriority(ThreadPriority priority, uint64_t audioCpus, uint64_t workerCpus)
+{
+    std::lock_guard<std::timed_mutex> lock(pc.mutex);
+
+    pc.threadPriority = priority;
+    pc.audioCpus = audioCpus;
+    pc.workerCpus = workerCpus;
+    if (pc.state.isReady()) // the context is up already, the backend takes it from there for the new devices
+        pc.context->threadPriority = ah_thread_priority(priority);
+}
+
+void AudioHandler::setLowLatency(uint32_t periodFrames)
+{
+    std::lock_guard<std::timed_mutex> lock(pc.mutex);
+
+    pc.lowLatencyPeriod = periodFrames ? std::max(periodFrames, LowLatencyPeriodMin) : 0;
+    pc.tunedPeriod = pc.lowLatencyPeriod; // the pooled devices of another period are not reused
+}
+
+bool AudioHandler::getLatencyStats(LatencyStats &stats)
+{
+    std::unique_lock<std::timed_mutex> lock(pc.mutex, std::chrono::milliseconds(10));
+    if (!lock.owns_lock())
+        return false;
+
+    stats = LatencyStats();
+    if (pc.device && ma_device_is_started(pc.device.get())) {
+        const ma_device *dev = pc.device.get();
+        bool playback = dev->type == ma_device_type_playback;
+        stats.periodFrames = playback ? dev->playback.internalPeriodSizeInFrames : dev->capture.internalPeriodSizeInFrames;
+        stats.periods = playback ? dev->playback.internalPeriods : dev->capture.internalPeriods;
+        ma_uint32 rate = playback ? dev->playback.internalSampleRate : dev->capture.internalSampleRate;
+        if (rate)
+            stats.bufferMs = 1000.0 * stats.periodFrames * (playback ? stats.periods : 1) / rate;
+    }
+    uint64_t callbacks = pc.callbacks.load(std::memory_order_relaxed);
+    if (callbacks)
+        stats.callbackAvgMs = pc.callbackNs.load(std::memory_order_relaxed) / 1e6 / callbacks;
+    stats.callbackMaxMs = pc.callbackMaxNs.load(std::memory_order_relaxed) / 1e6;
+    stats.xruns = pc.xruns.load(std::memory_order_relaxed);
+    stats.tunedPeriod = pc.tunedPeriod;
+
+    return true;
+}
+
+int AudioHandler::addSubscriber(frameDataCb cbProc, void *userData, bool polled, unsigned periods)
+{
+    if (!cbProc)
+        return -1;
+
+    // the widest sample format and a native capture of the usual channel counts, whatever the device ends up with
+    const size_t chunkSize = sizeof(Subscriber::Chunk) + ah_chunk_align((size_t)frameDataCbInterval * std::max(channels, SubscriberChannels) * sizeof(float));
+    const size_t ringSize = chunkSize * std::max(2u, periods);
+    std::unique_ptr<Subscriber> ps(new Subscriber(cbProc, userData, polled));
+    ma_result result = ma_rb_init(ringSize, NULL, NULL, &ps->rb);
+    if (result != MA_SUCCESS) {
+        if (pc.log) pc.log->LogMsg(LOG_ERR, "Failed to init subscriber buffer: %s", ma_result_description(result));
+        return -1;
+    }
+    ps->rbReady = true;
+    ps->chunk.reset(new char[ringSize]);
+
+    std::lock_guard<std::timed_mutex> lock(pc.mutex);
+    for (unsigned id = 0; id < privateContext::MaxSubscribers; ++id) {
+        if (pc.subscribers[id])
+            continue;
+        if (!polled) {
+            ps->running = true;
+            ps->worker = std::thread(ah_subscriber_worker, ps.get(), &pc);
+        }
+        pc.subscribers[id] = std::move(ps);
+        return (int)id;
+    }
+
+    return -1;
+}
+
+void AudioHandler::removeSubscriber(int id)
+{
+    if (id < 0 || id >= (int)privateContext::MaxSubscribers)
         return;
 
-    pc.cmdQueue.userCommand(CmdEnumerateDevices);
+    std::unique_ptr<Subscriber> ps;
+    {
+        std::lock_guard<std::timed_mutex> lock(pc.mutex);
+        ps = std::move(pc.subscribers[id]);
+    }
+    // the worker is joined outside of the lock, the device callbacks go on meanwhile
+}
+
+size_t AudioHandler::pollSubscriber(int id)
+{
+    // the slot can't change under the thread that owns it
+    if (id < 0 || id >= (int)privateContext::MaxSubscribers || !pc.subscribers[id] || !pc.subscribers[id]->polled)
+        return 0;
+
+    return ah_subscriber_drain(pc.subscribers[id].get());
 }
 
-const AudioHandler::Devices &AudioHandler::getPlaybackDevices()
+bool AudioHandler::getSubscriberStats(int id, SubscriberStats &stats)
 {
-    pc.device_mutex.lock();
-    return pc.playbackDevices;
+    if (id < 0 || id >= (int)privateContext::MaxSubscribers)
+        return false;
+    std::unique_lock<std::timed_mutex> lock(pc.mutex, std::chrono::milliseconds(10));
+    if (!lock.owns_lock() || !pc.subscribers[id])
+        return false;
+
+    const Subscriber &sub = *pc.subscribers[id];
+    stats.framesIn  = sub.framesIn;
+    stats.framesOut = sub.framesOut;
+    stats.overruns  = sub.overruns;
+
+    return true;
 }
 
-const AudioHandler::Devices &AudioHandler::getCaptureDevices()
+void AudioHandler::enumerate()
 {
-    pc.device_mutex.lock();
-    return pc.captureDevices;
+    if (!pc.context)
+        return;
+
+    ah_request_enumeration(&pc);
 }
 
-void AudioHandler::unlockDevices()
+AudioHandler::Devices AudioHandler::getPlaybackDevices()
 {
-    pc.device_mutex.unlock();
+    Devices devices;
+    {
+        std::lock_guard<std::mutex> lock(pc.device_mutex);
+        devices = pc.playbackDevices;
+    }
+    auto snapshot = std::atomic_load(&pc.deviceSnapshot);
+    devices.list = snapshot ? snapshot->playback : std::vector<Devices::Device>();
+    devices.defaultIdx = snapshot ? snapshot->playbackDefault : -1;
+    return devices;
+}
+
+AudioHandler::Devices AudioHandler::getCaptureDevices()
+{
+    Devices devices;
+    {
+        std::lock_guard<std::mutex> lock(pc.device_mutex);
+        devices = pc.captureDevices;
+    }
+    auto snapshot = std::atomic_load(&pc.deviceSnapshot);
+    devices.list = snapshot ? snapshot->capture : std::vector<Devices::Device>();
+    devices.defaultIdx = snapshot ? snapshot->captureDefault : -1;
+    return devices;
 }
 
 void AudioHandler::setPreferredPlaybackDevice(const char *deviceName)
@@ -472,7 +1251,7 @@ void AudioHandler::setPreferredPlaybackDevice(const char *deviceName)
     if (!pc.context)
         return;
 
-    pc.cmdQueue.userCommand({CmdSwitchPlaybackDevice, deviceName});
+    pc.cmdQueue.userCommand(CmdSwitchPlaybackDevice, deviceName);
 }
 
 void AudioHandler::setPreferredCaptureDevice(const char *deviceName)
@@ -480,7 +1259,76 @@ void AudioHandler::setPreferredCaptureDevice(const char *deviceName)
     if (!pc.context)
         return;
 
-    pc.cmdQueue.userCommand({CmdSwitchCaptureDevice, deviceName});
+    pc.cmdQueue.userCommand(CmdSwitchCaptureDevice, deviceName);
+}
+
+void AudioHandler::addCaptureDevice(const char *deviceName)
+{
+    if (!pc.context)
+        return;
+
+    pc.cmdQueue.userCommand(CmdAddCaptureDevice, deviceName);
+}
+
+void AudioHandler::clearCaptureDevices()
+{
+    if (!pc.context)
+        return;
+
+    pc.cmdQueue.userCommand(CmdClearCaptureDevices);
+}
+
+bool AudioHandler::getCommandStats(std::vector<CommandStats> &stats, uint64_t *callbackMisses)
+{
+    std::unique_lock<std::timed_mutex> lock(pc.mutex, std::chrono::milliseconds(10));
+    if (!lock.owns_lock())
+        return false;
+
+    stats.assign(pc.cmdStats, pc.cmdStats + CmdExit + 1);
+    for (size_t i = 0; i < stats.size(); ++i) {
+        stats[i].issued    = pc.cmdQueue.issued[i].load(std::memory_order_relaxed);
+        stats[i].coalesced = pc.cmdQueue.coalesced[i].load(std::memory_order_relaxed);
+    }
+    if (callbackMisses)
+        *callbackMisses = pc.callbackMisses.load(std::memory_order_relaxed);
+
+    return true;
+}
+
+bool AudioHandler::getCaptureGroupStats(std::vector<GroupDeviceStats> &stats)
+{
+    if (!pc.context)
+        return false;
+    std::unique_lock<std::timed_mutex> lock(pc.mutex, std::chrono::milliseconds(10));
+    if (!lock.owns_lock())
+        return false;
+
+    uint64_t master = pc.captureFrames;
+    stats.resize(pc.groupDevices.size());
+    for (size_t i = 0; i < pc.groupDevices.size(); ++i) {
+        const GroupDevice &gd = *pc.groupDevices[i];
+        GroupDeviceStats &st = stats[i];
+        st.name      = gd.device ? gd.name : std::string();
+        st.framesIn  = gd.framesIn;
+        st.framesOut = gd.framesOut;
+        st.slipped   = gd.slipped;
+        st.overruns  = gd.overruns;
+        st.driftPpm  = 0.0;
+        if (gd.device && master > gd.startMaster) {
+            double span = (double)(master - gd.startMaster);
+            st.driftPpm = ((double)(st.framesIn - gd.startIn) - span) / span * 1e6;
+        }
+    }
+
+    return true;
+}
+
+void AudioHandler::setCaptureChannels(uint32_t captureChannels)
+{
+    if (!pc.context)
+        return;
+
+    pc.cmdQueue.userCommand(CmdSetCaptureChannels, (uint64_t)captureChannels);
 }
 
 void AudioHandler::setPlaybackVolumeFactor(const float &volumeFactor)
@@ -488,7 +1336,7 @@ void AudioHandler::setPlaybackVolumeFactor(const float &volumeFactor)
     if (!pc.context)
         return;
 
-    pc.cmdQueue.userCommand({CmdSetPlaybackVolume, volumeFactor});
+    pc.cmdQueue.userCommand(CmdSetPlaybackVolume, volumeFactor);
 }
 
 bool AudioHandler::getPlaybackVolumeFactor(float &volumeFactor)
@@ -532,7 +1380,7 @@ void AudioHandler::setPlaybackFileName(const char *fileName)
     if (!pc.context)
         return;
 
-    pc.cmdQueue.userCommand({CmdSetPlaybackFileName, fileName});
+    pc.cmdQueue.userCommand(CmdSetPlaybackFileName, fileName);
 }
 
 void AudioHandler::stop()
@@ -548,7 +1396,7 @@ void AudioHandler::play(const char *fileName)
     if (!pc.context)
         return;
 
-    pc.cmdQueue.userCommand({CmdPlay, fileName});
+    pc.cmdQueue.userCommand(CmdPlay, fileName);
 }
 
 void AudioHandler::capture()
@@ -564,7 +1412,7 @@ void AudioHandler::record(const char *fileName)
     if (!pc.context)
         return;
 
-    pc.cmdQueue.userCommand({CmdRecord, fileName});
+    pc.cmdQueue.userCommand(CmdRecord, fileName);
 }
 
 void AudioHandler::seek(uint64_t posInPcmFrames)
@@ -572,7 +1420,7 @@ void AudioHandler::seek(uint64_t posInPcmFrames)
     if (!pc.context)
         return;
 
-    pc.cmdQueue.userCommand({CmdSeek, posInPcmFrames});
+    pc.cmdQueue.userCommand(CmdSeek, posInPcmFrames);
 }
 
 void AudioHandler::rewind()
@@ -609,25 +1457,27 @@ void AudioHandler::togglePause()
 
 bool AudioHandler::getState(State &state, uint64_t *lenInPcmFrames, uint64_t *posInPcmFrames)
 {
-    std::unique_lock<std::timed_mutex> lock(pc.mutex, std::chrono::milliseconds(10));
-    if (!lock.owns_lock())
-        return false;
+    unsigned value;
+    bool hasPlaybackFile, hasCursor;
+    uint64_t length, cursor;
+    uint32_t seq;
+    do {
+        seq = pc.pubSeq.load(std::memory_order_acquire);
+        value           = pc.pubState.load(std::memory_order_relaxed);
+        hasPlaybackFile = pc.pubHasPlaybackFile.load(std::memory_order_relaxed);
+        length          = pc.pubLength.load(std::memory_order_relaxed);
+        hasCursor       = pc.pubHasCursor.load(std::memory_order_relaxed);
+        cursor          = pc.cursor.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+    } while ((seq & 1) || seq != pc.pubSeq.load(std::memory_order_relaxed));
 
     if (lenInPcmFrames)
-        *lenInPcmFrames = isOperational() ? pc.length : 0;
-    if (posInPcmFrames) {
-        if (pc.decoder) {
-            // file cursor for playback
-            ma_uint64 cursor;
-            if (ma_decoder_get_cursor_in_pcm_frames(pc.decoder.get(), &cursor) == MA_SUCCESS)
-                *posInPcmFrames = cursor;
-            else
-                *posInPcmFrames = 0;
-        } else
-            // same as length for capture/recording
-            *posInPcmFrames = isOperational() ? pc.length : 0;
-    }
-    state = pc.state;
+        *lenInPcmFrames = length;
+    if (posInPcmFrames)
+        // file cursor for playback, same as length for capture/recording
+        *posInPcmFrames = hasCursor ? cursor : length;
+    state = value;
+    state.hasPlaybackFile = hasPlaybackFile;
 
     return true;
 }
@@ -638,20 +1488,23 @@ static const char *ErrorDescriptions[] = {
 };
 bool AudioHandler::getError(int *error, const char **description)
 {
-    std::unique_lock<std::timed_mutex> lock(pc.mutex, std::chrono::milliseconds(10));
-    if (!lock.owns_lock())
-        return false;
-
+    int err = pc.pubError.exchange(MA_SUCCESS, std::memory_order_relaxed);
     if (error)
-        *error = pc.genericError > ErrorBase ? (int)pc.stateError : (int)pc.backendError;
+        *error = err;
     if (description) {
-        if (pc.genericError > ErrorBase)
-            *description = pc.stateError < ErrorLast ? ErrorDescriptions[pc.stateError - ErrorBase - 1] : nullptr;
+        if (err > ErrorBase)
+            *description = err < ErrorLast ? ErrorDescriptions[err - ErrorBase - 1] : nullptr;
         else
-            *description = pc.backendError != MA_SUCCESS ? ma_result_description(pc.backendError) : nullptr;
+            *description = err != MA_SUCCESS ? ma_result_description((ma_result)err) : nullptr;
     }
 
-    pc.backendError = MA_SUCCESS;
+    if (err != MA_SUCCESS) {
+        // cleared right away if the command thread is not busy, by its next publish() otherwise
+        std::unique_lock<std::timed_mutex> lock(pc.mutex, std::try_to_lock);
+        pc.errorTaken.store(err, std::memory_order_relaxed);
+        if (lock.owns_lock())
+            pc.publish();
+    }
 
     return true;
 }
@@ -670,6 +1523,282 @@ std::string AudioHandler::framesToTime(uint64_t frames, uint32_t sampleRateHz)
     return ss.str();
 }
 
+bool AudioHandler::groupDeviceStart(GroupDevice &gd)
+{
+    ma_result result;
+
+    if (!gd.device) {
+        ma_device_config deviceConfig = ma_device_config_init(ma_device_type_capture);
+        ma_device_id deviceId;
+
+        deviceConfig.capture.format     = sampleFormat;
+        deviceConfig.capture.channels   = channels;
+        deviceConfig.sampleRate         = sampleRateHz;
+        deviceConfig.dataCallback       = ah_group_capture_callback;
+        deviceConfig.notificationCallback = ah_group_device_callback;
+        deviceConfig.pUserData          = &gd;
+        deviceConfig.periodSizeInFrames = frameDataCbInterval;
+
+        // select the device, no fallback to default, it would just duplicate the main one
+        {
+            auto snapshot = waitDeviceSnapshot();
+            for (size_t i = 0; i < snapshot->capture.size(); ++i) {
+                if (match(snapshot->capture[i].name, gd.preferred)) {
+                    deviceId = snapshot->capture[i].id;
+                    gd.name = snapshot->capture[i].name;
+                    deviceConfig.capture.pDeviceID = &deviceId;
+                    break;
+                }
+            }
+        }
+        if (!deviceConfig.capture.pDeviceID) {
+            if (pc.log) pc.log->LogMsg(LOG_ERR, "Capture group device %u: no device matching '%s'", gd.index, gd.preferred.c_str());
+            return false;
+        }
+
+        if (!gd.rbReady) {
+            // eight periods are plenty for the worker to catch up
+            result = ma_pcm_rb_init(sampleFormat, channels, frameDataCbInterval * 8, NULL, NULL, &gd.rb);
+            if (result != MA_SUCCESS) {
+                if (pc.log) pc.log->LogMsg(LOG_ERR, "Capture group device %u: failed to init buffer: %s", gd.index, ma_result_description(result));
+                return false;
+            }
+            gd.rbReady = true;
+        }
+
+        gd.device = ma_unique_device(new ma_device());
+        if (!gd.device
+            || (result = ma_device_init(pc.context.get(), &deviceConfig, gd.device.get())) != MA_SUCCESS) {
+            if (pc.log) pc.log->LogMsg(LOG_ERR, "Capture group device %u: failed to open %s: %s", gd.index, gd.name.c_str(),
+                ma_result_description(gd.device ? result : MA_OUT_OF_MEMORY));
+            gd.device = nullptr;
+            return false;
+        }
+        if (pc.log) pc.log->LogMsg(LOG_DBG, "Opened capture group device %u: %s", gd.index, gd.name.c_str());
+
+        if (!gd.worker.joinable()) {
+            gd.running = true;
+            gd.worker = std::thread(ah_group_worker, &gd, sampleFormat, channels, frameDataCbInterval);
+        }
+    }
+
+    if (!ma_device_is_started(gd.device.get())) {
+        gd.timelineOffset = -1; // resync on the first data
+        gd.startIn = gd.framesIn;
+        gd.startMaster = pc.captureFrames;
+        gd.started = true;
+        result = ma_device_start(gd.device.get());
+        if (result != MA_SUCCESS) {
+            gd.started = false;
+            if (pc.log) pc.log->LogMsg(LOG_ERR, "Capture group device %u: failed to start: %s", gd.index, ma_result_description(result));
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void AudioHandler::groupDeviceClose(GroupDevice &gd)
+{
+    gd.started = false;
+    gd.device = nullptr;   // no more callbacks after uninit
+    if (gd.worker.joinable()) {
+        gd.running = false;
+        ma_event_signal(&gd.dataEvent);
+        gd.worker.join();
+    }
+    // a reopened device starts on the timeline afresh, not with the frames left over
+    if (gd.rbReady)
+        ma_pcm_rb_reset(&gd.rb);
+}
+
+void AudioHandler::enumerateProc()
+{
+    static constexpr auto refreshInterval = std::chrono::seconds(10); // catches hot-plug the backend does not report
+
+    std::unique_lock<std::mutex> lock(pc.enumMutex);
+    while (!pc.enumExit) {
+        pc.enumRequested = false;
+        lock.unlock();
+
+        auto snapshot = std::make_shared<DeviceSnapshot>();
+        auto start = std::chrono::steady_clock::now();
+        ma_result result = ma_context_enumerate_devices(pc.context.get(), ah_device_enum_callback, snapshot.get());
+        auto previous = std::atomic_load(&pc.deviceSnapshot);
+        if (result != MA_SUCCESS) {
+            if (pc.log) pc.log->LogMsg(LOG_ERR, "Failed to enumerate devices: %s", ma_result_description(result));
+            if (previous)
+                snapshot = nullptr; // keep the last good one
+        } else if (!previous || !ah_same_devices(previous->playback, snapshot->playback) || !ah_same_devices(previous->capture, snapshot->capture)) {
+            if (pc.log) {
+                pc.log->LogMsg(LOG_DBG, "Audio devices, enumerated in %.1f ms:",
+                    std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+                for (size_t i = 0; i < snapshot->playback.size(); i++)
+                    pc.log->LogMsg(LOG_DBG, " Playback: %s%s", snapshot->playback[i].name.c_str(), (int)i == snapshot->playbackDefault ? " [default]" : "");
+                for (size_t i = 0; i < snapshot->capture.size(); i++)
+                    pc.log->LogMsg(LOG_DBG, " Capture: %s%s", snapshot->capture[i].name.c_str(), (int)i == snapshot->captureDefault ? " [default]" : "");
+            }
+        }
+        if (snapshot) {
+            {
+                // the default device is the selected one until another one is started
+                std::lock_guard<std::mutex> dlock(pc.device_mutex);
+                if (pc.playbackDevices.selectedName.empty() && snapshot->playbackDefault > -1)
+                    pc.playbackDevices.selectedName = snapshot->playback[snapshot->playbackDefault].name;
+                if (pc.captureDevices.selectedName.empty() && snapshot->captureDefault > -1)
+                    pc.captureDevices.selectedName = snapshot->capture[snapshot->captureDefault].name;
+            }
+            std::atomic_store(&pc.deviceSnapshot, std::shared_ptr<const DeviceSnapshot>(std::move(snapshot)));
+        }
+
+        lock.lock();
+        pc.snapshotCond.notify_all();
+        pc.enumCond.wait_for(lock, refreshInterval, [this]{ return pc.enumRequested || pc.enumExit; });
+    }
+}
+
+// the latest device list, waits only for the very first enumeration, which starts along with the handler
+std::shared_ptr<const AudioHandler::DeviceSnapshot> AudioHandler::waitDeviceSnapshot(bool wait)
+{
+    auto snapshot = std::atomic_load(&pc.deviceSnapshot);
+    if (!snapshot && wait) {
+        std::unique_lock<std::mutex> lock(pc.enumMutex);
+        pc.snapshotCond.wait_for(lock, std::chrono::seconds(5), [this, &snapshot]{
+            return (snapshot = std::atomic_load(&pc.deviceSnapshot)) != nullptr || pc.enumExit;
+        });
+    }
+    if (!snapshot)
+        snapshot = std::make_shared<const DeviceSnapshot>(); // nothing enumerated, defaults only
+    return snapshot;
+}
+
+// process wide, the difference over a playback tells the mapped and the decoder paths apart
+static void ah_io_counters(AudioHandler::IoCounters &io)
+{
+#if defined(MA_WIN32)
+    PROCESS_MEMORY_COUNTERS pmc;
+    IO_COUNTERS ioc;
+    io.majorFaults = GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)) ? pmc.PageFaultCount : 0; // no split there
+    io.minorFaults = 0;
+    io.readBytes = GetProcessIoCounters(GetCurrentProcess(), &ioc) ? ioc.ReadTransferCount : 0;
+#else
+    struct rusage ru;
+    if (getrusage(RUSAGE_SELF, &ru) != 0)
+        memset(&ru, 0, sizeof(ru));
+    io.majorFaults = (uint64_t)ru.ru_majflt;
+    io.minorFaults = (uint64_t)ru.ru_minflt;
+    io.readBytes = (uint64_t)ru.ru_inblock * 512;
+#endif
+}
+
+// closes the playback file, reports the I/O it took
+void AudioHandler::closeDecoder()
+{
+    if (!pc.decoder)
+        return;
+    bool mapped = pc.decoder->pBackendVTable == &g_ma_decoding_backend_vtable_wavmap;
+    pc.decoder = nullptr;
+    if (pc.log) {
+        IoCounters io;
+        ah_io_counters(io);
+        pc.log->LogMsg(LOG_DBG, "Playback I/O (%s): %llu major / %llu minor page faults, %llu KiB read",
+            mapped ? "mapped" : "decoder",
+            (unsigned long long)(io.majorFaults - pc.ioStart.majorFaults),
+            (unsigned long long)(io.minorFaults - pc.ioStart.minorFaults),
+            (unsigned long long)((io.readBytes - pc.ioStart.readBytes) >> 10));
+    }
+}
+
+// command thread, with the mutex held
+void AudioHandler::notify(const Notification &notification)
+{
+    pc.publish(); // listeners see the new state
+
+    if (!pc.notificationQueued) {
+        pc.notificationCbProc(notification, pc.notificationCbUserData);
+        return;
+    }
+
+    size_t tail = pc.notificationTail.load(std::memory_order_relaxed);
+    if (tail - pc.notificationHead.load(std::memory_order_acquire) == privateContext::NotificationQueueSize) {
+        // nobody dispatches, don't wait for it
+        if (pc.log) pc.log->LogMsg(LOG_WARN, "Notification queue full, event 0x%02x dropped", (unsigned)notification.event);
+        return;
+    }
+    privateContext::QueuedNotification &qn = pc.notificationQueue[tail % privateContext::NotificationQueueSize];
+    qn.cbProc = pc.notificationCbProc;
+    qn.userData = pc.notificationCbUserData;
+    qn.event = notification.event;
+    qn.dataStr.assign(notification.dataStr); // keeps the slot capacity
+    qn.dataU64 = notification.dataU64;
+    pc.notificationTail.store(tail + 1, std::memory_order_release);
+    if (pc.notificationWakeupProc)
+        pc.notificationWakeupProc(pc.notificationCbUserData);
+}
+
+// stops the main device and keeps it open for the next start of the same device
+void AudioHandler::parkDevice()
+{
+    if (!pc.device)
+        return;
+    if (pc.devicePoolStale.exchange(false)) {
+        // externally stopped, probably gone along with the pooled ones
+        pc.device = nullptr;
+        for (auto &pd : pc.devicePool)
+            pd.device = nullptr;
+        return;
+    }
+    if (ma_device_is_started(pc.device.get()) && ma_device_stop(pc.device.get()) != MA_SUCCESS) {
+        pc.device = nullptr;
+        return;
+    }
+    auto &pd = pc.devicePool[pc.device->type == ma_device_type_playback ? 0 : 1];
+    pd.device = std::move(pc.device); // the one parked before is closed
+    pd.name = pc.deviceName;
+    pd.period = pc.devicePeriod;
+    pd.channels = pc.deviceChannels;
+}
+
+// the pooled device matching the config and the selected device, if any
+AudioHandler::ma_unique_device AudioHandler::takePooledDevice(const ma_device_config &config, const std::string &name)
+{
+    bool playback = config.deviceType == ma_device_type_playback;
+    auto &pd = pc.devicePool[playback ? 0 : 1];
+    // a native format request matches whatever the device has
+    if (!pd.device || pd.name != name || pd.device->sampleRate != config.sampleRate
+        || pd.period != config.periodSizeInFrames
+        || (playback ? pd.device->playback.format != config.playback.format || pd.device->playback.channels != config.playback.channels
+                     : (config.capture.format != ma_format_unknown && pd.device->capture.format != config.capture.format)
+                       || (pd.channels != config.capture.channels // a native one serves a request for its channel count
+                           && (pd.channels || pd.device->capture.channels != config.capture.channels))))
+        return nullptr;
+    return std::move(pd.device);
+}
+
+// channel count of the selected capture device opened with its native count, 0 if not known;
+// the parked device tells it without a query
+ma_uint32 AudioHandler::nativeCaptureChannels()
+{
+    const auto &pd = pc.devicePool[1];
+    std::string name;
+    ma_device_id id;
+    {
+        std::lock_guard<std::mutex> lock(pc.device_mutex);
+        name = pc.captureDevices.selectedName;
+        id = pc.captureDevices.selectedId;
+    }
+    if (pd.device && !pd.channels && pd.name == name)
+        return pd.device->capture.channels;
+
+    ma_device_info info;
+    if (ma_context_get_device_info(pc.context.get(), ma_device_type_capture, name.empty() ? nullptr : &id, &info) != MA_SUCCESS)
+        return 0;
+    ma_uint32 native = 0;
+    for (ma_uint32 i = 0; i < info.nativeDataFormatCount; ++i)
+        native = std::max(native, info.nativeDataFormats[i].channels); // 0 is any
+    return native;
+}
+
 void AudioHandler::commandProc()
 {
     ma_result result;
@@ -678,22 +1807,49 @@ void AudioHandler::commandProc()
     ma_decoder_config decoderConfig;
     static const std::string default_device("default");  // for notifications
     const std::string *lastDeviceName = &default_device;
+    bool deviceReused = false;                           // retry with a fresh one if it fails to start
+
+    auto initStart = std::chrono::steady_clock::now();
+    result = pc.initContext();
+    if (result != MA_SUCCESS) {
+        std::lock_guard<std::timed_mutex> lock(pc.mutex);
+        pc.backendError = result;
+        pc.publish();
+        if (pc.log) pc.log->LogMsg(LOG_ERR, "Failed to init audio context: %s", ma_result_description(result));
+        pc.cond.notify_all();
+        return;
+    }
+    if (pc.log) pc.log->LogMsg(LOG_DBG, "Audio context initialized in %.1f ms",
+        std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - initStart).count());
+    pc.enumWorker = std::thread(&AudioHandler::enumerateProc, this);
 
     {
         std::lock_guard<std::timed_mutex> lock(pc.mutex);
         pc.state |= StateReady; // ready for commands
+        pc.publish();
         pc.cond.notify_all();
     }
+    bool rejected;
+    auto reject = [this, &rejected](Error error) {
+        pc.stateError = error;
+        rejected = true;
+    };
     do {
-        Cmd cc = pc.cmdQueue.pendingCommand();
+        Cmd cc = pc.cmdQueue.pendingCommand(pc.device && pc.tunable ? XrunPollInterval : std::chrono::milliseconds(0));
         std::lock_guard<std::timed_mutex> lock(pc.mutex);
+        if (pc.retuneRequested.exchange(false, std::memory_order_relaxed) && !pc.retunePending) {
+            // after the current command, see ah_xrun()
+            pc.retunePending = true;
+            pc.cmdQueue.internalCommand(CmdRetuneDevice);
+        }
         DBG("AudioHandler: cmd %u sarg %s uarg %llu farg %g\n", cc.cmd, cc.argStr.c_str(), cc.argU64, cc.argF32);
+        rejected = false;
         switch(cc.cmd) {
         case CmdNone:
             break;
         case CmdPlay:
             if (cc.fromuser && !pc.state.canPlay(!cc.argStr.empty())) {
-                pc.stateError = ErrorInvalidSequence;
+                reject(ErrorInvalidSequence);
                 break;
             }
             if (pc.state.isPlaying() && cc.argStr == pc.lastFileName) { // already playing and same file requested
@@ -713,13 +1869,16 @@ void AudioHandler::commandProc()
             }
 
             decoderConfig = ma_decoder_config_init(sampleFormat, channels, sampleRateHz);
- #if defined(HAVE_OPUS)
-            decoderConfig.pCustomBackendUserData = NULL;  /* In this example our backend objects are contained within a ma_decoder_ex object to avoid a malloc. Our vtables need to know about this. */
-            decoderConfig.ppCustomBackendVTables = pCustomBackendVTables;
-            decoderConfig.customBackendCount     = sizeof(pCustomBackendVTables) / sizeof(pCustomBackendVTables[0]);
- #endif // defined(HAVE_OPUS)
+            {
+                size_t skip = pc.mappedPlayback ? 0 : 1;
+                decoderConfig.pCustomBackendUserData = NULL;  /* In this example our backend objects are contained within a ma_decoder_ex object to avoid a malloc. Our vtables need to know about this. */
+                decoderConfig.ppCustomBackendVTables = pCustomBackendVTables + skip;
+                decoderConfig.customBackendCount     = (ma_uint32)(sizeof(pCustomBackendVTables) / sizeof(pCustomBackendVTables[0]) - skip);
+            }
 
             pc.encoder = nullptr;
+            closeDecoder();
+            ah_io_counters(pc.ioStart);
             pc.decoder = ma_unique_decoder(new ma_decoder());
             if (!pc.decoder
                 || (result = decoder_init_file(pc.lastFileName.c_str(), &decoderConfig, pc.decoder.get())) != MA_SUCCESS) {
@@ -736,36 +1895,48 @@ void AudioHandler::commandProc()
             pc.state = StatePlayback|StatePause;
             pc.cmdQueue.internalCommand(CmdResume);
 
-            if (pc.log) pc.log->LogMsg(LOG_DBG, "Playing file: %s (%s)", pc.lastFileName.c_str(), framesToTime(pc.length).c_str());
+            if (pc.log) pc.log->LogMsg(LOG_DBG, "Playing file: %s (%s%s)", pc.lastFileName.c_str(), framesToTime(pc.length).c_str(),
+                                       pc.decoder->pBackendVTable == &g_ma_decoding_backend_vtable_wavmap ? ", mapped" : "");
             if (pc.notificationCbMask & EventPlayFile)
-                pc.notificationCbProc({EventPlayFile, pc.lastFileName, 0}, pc.notificationCbUserData);
+                notify({EventPlayFile, pc.lastFileName, 0});
             break;
         case CmdCapture:
             if (cc.fromuser && !pc.state.canCapture()) {
-                pc.stateError = ErrorInvalidSequence;
+                reject(ErrorInvalidSequence);
                 break;
             }
 
-            pc.decoder = nullptr;
+            closeDecoder();
             pc.encoder = nullptr;
 
+            pc.captureFrames = 0;
             pc.state = StateCapture|StatePause;
             pc.cmdQueue.internalCommand(CmdResume);
             break;
         case CmdRecord:
             if (cc.fromuser && !pc.state.canRecord()) {
-                pc.stateError = ErrorInvalidSequence;
+                reject(ErrorInvalidSequence);
                 break;
             }
             if (cc.argStr.empty()) {
-                pc.stateError = ErrorInvalidCmdArg;
+                reject(ErrorInvalidCmdArg);
                 break;
             }
             pc.lastFileName = cc.argStr;
 
-            encoderConfig = ma_encoder_config_init(ma_encoding_format_wav, recordFormat, channels, sampleRateHz);
+            // as many channels as the capture device has, a running one is kept
+            {
+                ma_uint32 recordChannels = pc.captureChannels;
+                if (pc.device && pc.device->type == ma_device_type_capture)
+                    recordChannels = pc.device->capture.channels;
+                else if (!recordChannels) // native, a stop before has parked the device
+                    recordChannels = nativeCaptureChannels();
+                if (!recordChannels)
+                    recordChannels = channels;
+                encoderConfig = ma_encoder_config_init(ma_encoding_format_wav, recordFormat, recordChannels, sampleRateHz);
+            }
 
-            pc.decoder = nullptr;
+            closeDecoder();
             pc.encoder = ma_unique_encoder(new ma_encoder());
             if (!pc.encoder
                 || (result = encoder_init_file(pc.lastFileName.c_str(), &encoderConfig, pc.encoder.get())) != MA_SUCCESS) {
@@ -777,19 +1948,20 @@ void AudioHandler::commandProc()
                 break;
             }
             pc.encoder->pUserData = &pc;
+            pc.captureFrames = 0;
             pc.state = StateRecord|StatePause;
             pc.cmdQueue.internalCommand(CmdResume);
 
             if (pc.log) pc.log->LogMsg(LOG_DBG, "Recording to file: %s", pc.lastFileName.c_str());
             if (pc.notificationCbMask & EventRecordFile)
-                pc.notificationCbProc({EventRecordFile, pc.lastFileName, 0}, pc.notificationCbUserData);
+                notify({EventRecordFile, pc.lastFileName, 0});
             break;
         case CmdRewind:
             cc.argU64 = 0;
             // fall through
         case CmdSeek:
             if (cc.fromuser && !pc.state.canSeek()) {
-                pc.stateError = ErrorInvalidSequence;
+                reject(ErrorInvalidSequence);
                 break;
             }
             if (!pc.decoder)
@@ -807,11 +1979,11 @@ void AudioHandler::commandProc()
 
             if (pc.log) pc.log->LogMsg(LOG_DBG, "%s: seek to %llu", pc.lastFileName.c_str(), cc.argU64);
             if (pc.notificationCbMask & EventSeek)
-                pc.notificationCbProc({EventSeek, pc.lastFileName, cc.argU64}, pc.notificationCbUserData);
+                notify({EventSeek, pc.lastFileName, cc.argU64});
             break;
         case CmdPause:
             if (cc.fromuser && !pc.state.canPause()) {
-                pc.stateError = ErrorInvalidSequence;
+                reject(ErrorInvalidSequence);
                 break;
             }
             pc.state |= StatePause;
@@ -826,21 +1998,27 @@ void AudioHandler::commandProc()
                     break;
                 }
             }
+            for (auto &gd : pc.groupDevices) {
+                if (gd->device && ma_device_is_started(gd->device.get())) {
+                    gd->started = false;
+                    ma_device_stop(gd->device.get());
+                }
+            }
 
             if (pc.notificationCbMask & EventPause)
-                pc.notificationCbProc({EventPause, *lastDeviceName,
-                    (uint64_t)(pc.device ? (pc.device->type == ma_device_type_playback ? EventOpPlayback : (pc.encoder ? EventOpRecord : EventOpCapture)) : EventOpNone)},
-                    pc.notificationCbUserData);
+                notify({EventPause, *lastDeviceName,
+                    (uint64_t)(pc.device ? (pc.device->type == ma_device_type_playback ? EventOpPlayback : (pc.encoder ? EventOpRecord : EventOpCapture)) : EventOpNone)});
             break;
         case CmdResume:
             if (cc.fromuser && !pc.state.canResume()) {
-                pc.stateError = ErrorInvalidSequence;
+                reject(ErrorInvalidSequence);
                 break;
             }
             if (!pc.device || (pc.device->type == ma_device_type_playback && (pc.state & StateMask) != StatePlayback)) { // no device or inappropriate device type
                 Devices *devices;
                 const ma_device_id **ppConfigDeviceId;
 
+                parkDevice(); // playback device on the capture after EOF, kept for the next file
                 if (pc.state.isPlaying()) {
                     if (!pc.decoder) { // invalid state
                         if (pc.log) pc.log->LogMsg(LOG_DBG, "Invalid playback state");
@@ -855,68 +2033,109 @@ void AudioHandler::commandProc()
                     deviceConfig.dataCallback       = ah_play_callback;     // This function will be called when miniaudio needs more data.
                     deviceConfig.notificationCallback = ah_device_callback; // This function will be called when device state changes.
                     deviceConfig.pUserData          = &pc;                  // Can be accessed from the device object (device.pUserData).
-                    deviceConfig.periodSizeInFrames = frameDataCbInterval;
 
                     devices = &pc.playbackDevices;
                     ppConfigDeviceId = &deviceConfig.playback.pDeviceID;
                 } else {
                     deviceConfig = ma_device_config_init(ma_device_type_capture);
 
-                    deviceConfig.capture.format     = sampleFormat;     // Set to ma_format_unknown to use the device's native format.
-                    deviceConfig.capture.channels   = channels;         // Set to 0 to use the device's native channel count.
+                    deviceConfig.capture.format     = captureFormat;    // Set to ma_format_unknown to use the device's native format.
+                    deviceConfig.capture.channels   = pc.encoder ? pc.encoder->config.channels : pc.captureChannels; // Set to 0 to use the device's native channel count.
                     deviceConfig.sampleRate         = sampleRateHz;     // Set to 0 to use the device's native sample rate.
                     deviceConfig.dataCallback       = ah_capture_callback;  // This function will be called when miniaudio needs more data.
                     deviceConfig.notificationCallback = ah_device_callback; // This function will be called when device state changes.
                     deviceConfig.pUserData          = &pc;              // Can be accessed from the device object (device.pUserData).
-                    deviceConfig.periodSizeInFrames = frameDataCbInterval;
 
                     devices = &pc.captureDevices;
                     ppConfigDeviceId = &deviceConfig.capture.pDeviceID;
                 }
+                // the low latency mode runs small periods, the consumers accumulate to their hop
+                deviceConfig.periodSizeInFrames = frameDataCbInterval;
+                if (pc.tunedPeriod) {
+                    deviceConfig.periodSizeInFrames = std::min(pc.tunedPeriod, frameDataCbInterval);
+                    deviceConfig.performanceProfile = ma_performance_profile_low_latency; // also the miniaudio default
+                }
 
                 // select the device
                 {
+                    bool hasPreferred;
+                    {
+                        std::lock_guard<std::mutex> lock(pc.device_mutex);
+                        hasPreferred = !devices->preferred.empty();
+                    }
+                    // the default device needs no list, the first one is not waited for then
+                    auto snapshot = waitDeviceSnapshot(hasPreferred);
+                    bool playback = devices == &pc.playbackDevices;
+                    const auto &list = playback ? snapshot->playback : snapshot->capture;
+                    int defaultIdx = playback ? snapshot->playbackDefault : snapshot->captureDefault;
                     std::lock_guard<std::mutex> lock(pc.device_mutex);
                     if (!devices->preferred.empty()) {
-                        for (size_t i = 0; i < devices->list.size(); ++i) {
-                            if (match(devices->list[i].name, devices->preferred)) {
-                                devices->selectedId = devices->list[i].id;
-                                devices->selectedName = devices->list[i].name;
+                        for (size_t i = 0; i < list.size(); ++i) {
+                            if (match(list[i].name, devices->preferred)) {
+                                devices->selectedId = list[i].id;
+                                devices->selectedName = list[i].name;
                                 *ppConfigDeviceId = &devices->selectedId;
                                 break;
                             }
                         }
                     }
-                    if (devices->defaultIdx > -1) // enumerated
+                    if (defaultIdx > -1) // enumerated
                     {
                         if (!*ppConfigDeviceId) {
-                            devices->selectedId = devices->list[devices->defaultIdx].id;
-                            devices->selectedName = devices->list[devices->defaultIdx].name;
+                            devices->selectedId = list[defaultIdx].id;
+                            devices->selectedName = list[defaultIdx].name;
                         }
                         lastDeviceName = &devices->selectedName;
                     }
                 }
 
-                pc.device = ma_unique_device(new ma_device());
-                if (!pc.device
-                    || (result = ma_device_init(pc.context.get(), &deviceConfig, pc.device.get())) != MA_SUCCESS) {
-                    pc.backendError = pc.device ? result : MA_OUT_OF_MEMORY;
-                    pc.device = nullptr;
-                    if (pc.log) pc.log->LogMsg(LOG_ERR, "Failed to open%s device: %s", pc.device ? (pc.device->type == ma_device_type_playback ? " playback" : " capture") : "",
-                        ma_result_description(pc.backendError));
-                    pc.cmdQueue.set(CmdStop);
-                    break;
+                ma_uint32 pooledChannels = pc.devicePool[devices == &pc.playbackDevices ? 0 : 1].channels;
+                pc.device = takePooledDevice(deviceConfig, devices->selectedName);
+                deviceReused = (bool)pc.device;
+                if (!pc.device) {
+                    pc.device = ma_unique_device(new ma_device());
+                    if (!pc.device
+                        || (result = ma_device_init(pc.context.get(), &deviceConfig, pc.device.get())) != MA_SUCCESS) {
+                        pc.backendError = pc.device ? result : MA_OUT_OF_MEMORY;
+                        pc.device = nullptr;
+                        if (pc.log) pc.log->LogMsg(LOG_ERR, "Failed to open%s device: %s", pc.device ? (pc.device->type == ma_device_type_playback ? " playback" : " capture") : "",
+                            ma_result_description(pc.backendError));
+                        pc.cmdQueue.set(CmdStop);
+                        break;
+                    }
                 }
+                pc.deviceName = devices->selectedName;
+                pc.devicePeriod = deviceConfig.periodSizeInFrames;
+                pc.deviceChannels = deviceReused ? pooledChannels : deviceConfig.capture.channels; // a native one stays native
+                pc.tunable = pc.tunedPeriod && deviceConfig.periodSizeInFrames < frameDataCbInterval;
                 if (pc.device->type == ma_device_type_playback)
                     ma_atomic_float_set(&pc.device->masterVolumeFactor, pc.playbackVolumeFactor);
 
-                if (pc.log) pc.log->LogMsg(LOG_DBG, "Opened %s device: %s",
-                    pc.device->type == ma_device_type_playback ? "playback" : "capture",
-                    devices->selectedName.c_str());
+                if (pc.log) {
+                    bool playback = pc.device->type == ma_device_type_playback;
+                    ma_uint32 period = playback ? pc.device->playback.internalPeriodSizeInFrames : pc.device->capture.internalPeriodSizeInFrames;
+                    ma_uint32 periods = playback ? pc.device->playback.internalPeriods : pc.device->capture.internalPeriods;
+                    pc.log->LogMsg(LOG_DBG, "%s %s device: %s, %u x %u frames period%s", deviceReused ? "Reusing" : "Opened",
+                        playback ? "playback" : "capture", devices->selectedName.c_str(), periods, period,
+                        pc.tunedPeriod ? ", low latency" : "");
+                }
             }
 
             if (!ma_device_is_started(pc.device.get())) {
+                pc.clockRestart.store(true, std::memory_order_release);
+                pc.retuneRequested = false;
+                pc.retunePending = false;
                 result = ma_device_start(pc.device.get());
+                if (result != MA_SUCCESS && deviceReused) {
+                    // went bad while parked, open it anew
+                    if (pc.log) pc.log->LogMsg(LOG_DBG, "Failed to restart %s device: %s",
+                        pc.device->type == ma_device_type_playback ? "playback" : "capture",
+                        ma_result_description(result));
+                    pc.device = nullptr;
+                    deviceReused = false;
+                    pc.cmdQueue.internalCommand(CmdResume);
+                    break;
+                }
                 if (result != MA_SUCCESS) {
                     pc.backendError = result;
                     if (pc.log) pc.log->LogMsg(LOG_ERR, "Failed to start %s device: %s",
@@ -926,12 +2145,16 @@ void AudioHandler::commandProc()
                     break;
                 }
             }
+            deviceReused = false;
             pc.state &= ~StatePause;
+            if (pc.state.isCapOrRec()) {
+                for (auto &gd : pc.groupDevices)
+                    groupDeviceStart(*gd); // not fatal, errors are logged
+            }
 
             if (pc.notificationCbMask & EventResume)
-                pc.notificationCbProc({EventResume, *lastDeviceName,
-                (uint64_t)(pc.device ? (pc.device->type == ma_device_type_playback ? EventOpPlayback : (pc.encoder ? EventOpRecord : EventOpCapture)) : EventOpNone)},
-                pc.notificationCbUserData);
+                notify({EventResume, *lastDeviceName,
+                (uint64_t)(pc.device ? (pc.device->type == ma_device_type_playback ? EventOpPlayback : (pc.encoder ? EventOpRecord : EventOpCapture)) : EventOpNone)});
             break;
         case CmdTogglePause:
             if (pc.state.canPause())
@@ -939,40 +2162,20 @@ void AudioHandler::commandProc()
             else if (pc.state.canResume())
                 pc.cmdQueue.internalCommand(CmdResume);
             else
-                pc.stateError = ErrorInvalidSequence;
+                reject(ErrorInvalidSequence);
             break;
         case CmdEnumerateDevices:
-            if (pc.log) pc.log->LogMsg(LOG_DBG, "Enumerating devices...");
-            {
-                std::lock_guard<std::mutex> lock(pc.device_mutex);
-                pc.playbackDevices.list.clear();
-                pc.playbackDevices.defaultIdx = -1;
-                pc.captureDevices.list.clear();
-                pc.captureDevices.defaultIdx = -1;
-
-                result = ma_context_enumerate_devices(pc.context.get(), ah_device_enum_callback, &pc);
-            }
-            if (result != MA_SUCCESS) {
-                pc.backendError = result;
-                if (pc.log) pc.log->LogMsg(LOG_ERR, "Failed to enumerate devices: %s", ma_result_description(result));
-            }
+            ah_request_enumeration(&pc);
             break;
         case CmdSwitchPlaybackDevice:
         case CmdSwitchCaptureDevice:
             if (cc.fromuser) {
+                // matched against the device list on the device start
                 std::lock_guard<std::mutex> lock(pc.device_mutex);
                 if (cc.cmd == CmdSwitchPlaybackDevice)
                     pc.playbackDevices.preferred = cc.argStr;
                 else
                     pc.captureDevices.preferred = cc.argStr;
-
-                if (pc.playbackDevices.list.empty() && pc.captureDevices.list.empty()) {
-                    // probably not enumerated yet
-                    // reverse order
-                    pc.cmdQueue.internalCommand(cc.cmd);
-                    pc.cmdQueue.internalCommand(CmdEnumerateDevices);
-                    break;
-                }
             }
             // only restart when changing active device
             if (pc.device &&
@@ -987,6 +2190,8 @@ void AudioHandler::commandProc()
                 // pause is active, safe to destroy the device
                 pc.device = nullptr;
             }
+            // nor keep the previous one around
+            pc.devicePool[cc.cmd == CmdSwitchPlaybackDevice ? 0 : 1].device = nullptr;
             // just copy the preferred name to selected,
             // will be updated by the actual device name on device start
             if (cc.cmd == CmdSwitchPlaybackDevice)
@@ -996,7 +2201,7 @@ void AudioHandler::commandProc()
             break;
         case CmdSetPlaybackVolume:
             if (cc.argF32 < 0.0f || cc.argF32 > 1.0f) {
-                pc.stateError = ErrorInvalidCmdArg;
+                reject(ErrorInvalidCmdArg);
                 break;
             }
             pc.playbackVolumeFactor = cc.argF32;
@@ -1006,6 +2211,53 @@ void AudioHandler::commandProc()
         case CmdSetPlaybackFileName:
             pc.playbackFileName = cc.argStr; pc.state.hasPlaybackFile = !cc.argStr.empty();
             break;
+        case CmdAddCaptureDevice:
+            pc.groupDevices.emplace_back(new GroupDevice(&pc, (unsigned)pc.groupDevices.size(), cc.argStr));
+            if (pc.state.isCapOrRec() && !pc.state.isPaused() && pc.device)
+                groupDeviceStart(*pc.groupDevices.back());
+            break;
+        case CmdClearCaptureDevices:
+            for (auto &gd : pc.groupDevices)
+                groupDeviceClose(*gd);
+            pc.groupDevices.clear();
+            break;
+        case CmdSetCaptureChannels:
+            if (cc.fromuser) {
+                if ((ma_uint32)cc.argU64 == pc.captureChannels)
+                    break;
+                pc.captureChannels = (ma_uint32)cc.argU64;
+            }
+            // reopen a running capture, a recording keeps its file format
+            if (pc.device && pc.device->type == ma_device_type_capture && !pc.encoder) {
+                if (!pc.state.isPaused()) {
+                    // reverse order, as for the device switch
+                    pc.cmdQueue.internalCommand(CmdResume);
+                    pc.cmdQueue.internalCommand(cc.cmd);
+                    pc.cmdQueue.internalCommand(CmdPause);
+                    break;
+                }
+                pc.device = nullptr;
+            }
+            break;
+        case CmdRetuneDevice:
+            // xruns in the low latency mode, reopen the device with twice the period
+            if (!pc.device || !pc.tunedPeriod || pc.devicePeriod >= frameDataCbInterval) {
+                pc.retunePending = false;
+                break;
+            }
+            if (!pc.state.isPaused()) {
+                // reverse order, as for the device switch
+                pc.cmdQueue.internalCommand(CmdResume);
+                pc.cmdQueue.internalCommand(cc.cmd);
+                pc.cmdQueue.internalCommand(CmdPause);
+                break;
+            }
+            pc.tunedPeriod = std::min(pc.devicePeriod * 2, frameDataCbInterval);
+            if (pc.log) pc.log->LogMsg(LOG_WARN, "%s device xruns at %u frames period, backing off to %u",
+                pc.device->type == ma_device_type_playback ? "Playback" : "Capture", pc.devicePeriod, pc.tunedPeriod);
+            pc.devicePool[pc.device->type == ma_device_type_playback ? 0 : 1].device = nullptr;
+            pc.device = nullptr;
+            break;
         case CmdStop:
         {
             NotificationEventOp op = pc.device ? (pc.device->type == ma_device_type_playback ? EventOpPlayback : (pc.encoder ? EventOpRecord : EventOpCapture)) : EventOpNone;
@@ -1015,13 +2267,15 @@ void AudioHandler::commandProc()
             }
             // reset state
             pc.state   = StateIdle;
-            pc.device  = nullptr;
+            parkDevice();
+            for (auto &gd : pc.groupDevices)
+                groupDeviceClose(*gd);
             pc.encoder = nullptr;
-            pc.decoder = nullptr;
+            closeDecoder();
             pc.length  = 0;
 
             if (pc.notificationCbMask & EventStop)
-                pc.notificationCbProc({EventStop, *lastDeviceName, (uint64_t)op}, pc.notificationCbUserData);
+                notify({EventStop, *lastDeviceName, (uint64_t)op});
             break;
         }
         case CmdExit:
@@ -1031,15 +2285,33 @@ void AudioHandler::commandProc()
             if (pc.log) pc.log->LogMsg(LOG_DBG, "Invalid command %u", cc.cmd);
             break;
         }
+        if (cc.fromuser && cc.cmd <= CmdExit) {
+            CommandStats &st = pc.cmdStats[cc.cmd];
+            double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - cc.issued).count();
+            size_t bucket = 0;
+            while (bucket < LatencyBuckets - 1 && us >= (double)(1ull << bucket))
+                bucket++;
+            st.executed++;
+            st.rejected += rejected;
+            st.maxUs = std::max(st.maxUs, us);
+            st.latency[bucket]++;
+        }
+        pc.publish();
         if (!pc.state.isReady())
             break;
     } while (true);
 
     std::lock_guard<std::timed_mutex> lock(pc.mutex);
     pc.device  = nullptr;
+    for (auto &pd : pc.devicePool)
+        pd.device = nullptr;
+    for (auto &gd : pc.groupDevices)
+        groupDeviceClose(*gd);
+    pc.groupDevices.clear();
     pc.encoder = nullptr;
     pc.decoder = nullptr;
     pc.state   = StateExit;
     pc.length  = 0;
+    pc.publish();
     pc.cmdQueue.clear();
 }
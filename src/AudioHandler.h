@@ -5,7 +5,9 @@
 #include <thread>
 #include <mutex>
 #include <condition_variable>
-#include <deque>
+#include <atomic>
+#include <memory>
+#include <chrono>
 
 #include "Logger.hpp"
 
@@ -27,10 +29,22 @@
 
 class AudioHandler {
 public:
+    enum Backend {
+        BackendDefault = 0, // platform default backends, in miniaudio priority order
+        BackendNull         // miniaudio null backend, no real hardware involved, for tests and benchmarks
+    };
+
+    enum ThreadPriority {
+        PriorityDefault = 0,    // the backend default, the highest of the normal ones
+        PriorityRealtime        // SCHED_FIFO or the like, where the backend and the limits allow it
+    };
+
     enum Format {
         // abstract ma_format
         FormatAny = ma_format_unknown,
+        FormatU8  = ma_format_u8,
         FormatS16 = ma_format_s16,
+        FormatS24 = ma_format_s24,
         FormatS32 = ma_format_s32,
         FormatF32 = ma_format_f32
     };
@@ -53,7 +67,7 @@ public:
 
     enum Command {
         CmdNone     = 0,
-        CmdStop,         // Stop current operation and close device and file
+        CmdStop,         // Stop current operation and close file, the device is kept open for reuse
         CmdPlay,         // Playback, with optional file argument
         CmdCapture,      // Capture
         CmdRecord,       // Record, file argument required
@@ -67,6 +81,10 @@ public:
         CmdSwitchCaptureDevice,  // Switch input to another device
         CmdSetPlaybackVolume,    // set playback volume
         CmdSetPlaybackFileName,  // set file name for next playback command
+        CmdAddCaptureDevice,     // Add device to the capture group, device name argument
+        CmdClearCaptureDevices,  // Close and remove all capture group devices
+        CmdSetCaptureChannels,   // Main capture device channel count, 0 for the native one
+        CmdRetuneDevice, // Reopen the main device with a longer period, internal, see setLowLatency()
         CmdExit          // Signal command thread to cleanup and exit
     };
 
@@ -102,6 +120,46 @@ public:
 
     typedef void (*frameDataCb) (Format format, uint32_t channels, const void *pData, uint32_t frameCount, void *userData);
     typedef void (*notificationCb) (const Notification &notification, void *userData);
+    typedef void (*wakeupCb) (void *userData);
+    typedef void (*groupFrameDataCb) (unsigned device, Format format, uint32_t channels, const void *pData, uint32_t frameCount, uint64_t timelinePos, void *userData);
+
+    struct GroupDeviceStats {
+        std::string name;     // opened device name, empty if the device could not be opened
+        uint64_t framesIn;    // frames captured by the device
+        uint64_t framesOut;   // frames delivered to the callback, including inserted ones
+        uint64_t slipped;     // frames dropped or inserted to follow the common timeline
+        uint64_t overruns;    // frames lost because the worker did not keep up
+        double driftPpm;      // measured clock drift relative to the main capture device
+    };
+
+    // frame data subscriber counters since the subscriber was added
+    struct SubscriberStats {
+        uint64_t framesIn;    // frames offered by the device callbacks
+        uint64_t framesOut;   // frames delivered to the subscriber callback
+        uint64_t overruns;    // frames dropped because the subscriber ring was full
+    };
+
+    // main device timing, the counters run since the handler creation
+    struct LatencyStats {
+        uint32_t periodFrames;  // device period as granted by the backend, 0 if no device is running
+        uint32_t periods;       // periods in the device buffer
+        double bufferMs;        // frames queued in the device: the whole buffer for playback, a period for capture
+        double callbackAvgMs;   // frame data callback, subscribers and encoder, the handler share of the path
+        double callbackMaxMs;
+        uint64_t xruns;         // callbacks missed and frames the device clock lost against the wall clock
+        uint32_t tunedPeriod;   // period the low latency mode runs with, 0 if off, see setLowLatency()
+    };
+
+    // user commands of a kind since the handler creation, completion latency is from the push to the command done
+    static constexpr size_t LatencyBuckets = 24;    // [0] under 1 us, [i] under 2^i us, the last one takes the rest
+    struct CommandStats {
+        uint64_t issued;      // pushed to the queue
+        uint64_t executed;    // carried out by the command thread, rejected ones included
+        uint64_t rejected;    // refused in the current state or for the argument
+        uint64_t coalesced;   // dropped for a later one of the same kind
+        double maxUs;
+        uint64_t latency[LatencyBuckets];
+    };
 
 private:
     template <typename UT, UT fn_uninit>
@@ -137,54 +195,216 @@ private:
         Cmd(Command initial, const char *arg) : Cmd(initial) { if (arg) argStr = arg; }
         Cmd(Command initial, std::string const &arg) : Cmd(initial) { argStr = arg; }
         Cmd &operator=(Command newCmd) { cmd = newCmd; argU64 = 0; argF32 = 0.0f; argStr.clear(); return *this; }
+        // same as the constructors, but keeps the string capacity
+        void assign(Command newCmd)                        { *this = newCmd; }
+        void assign(Command newCmd, uint64_t arg)          { *this = newCmd; argU64 = arg; }
+        void assign(Command newCmd, float arg)             { *this = newCmd; argF32 = arg; }
+        void assign(Command newCmd, const char *arg)       { *this = newCmd; if (arg) argStr = arg; }
+        void assign(Command newCmd, std::string const &arg) { *this = newCmd; argStr = arg; }
+        void assign(Cmd const &other)                      { *this = other; }
 
         Command cmd;
         ma_uint64 argU64;
         ma_float argF32;
         std::string argStr;
         bool fromuser;
+        std::chrono::steady_clock::time_point issued; // user commands only
     };
+    // Multiple producer, single consumer command queue.
+    // Producers never lock: commands are filled into pooled nodes (heap only when the pool is exhausted)
+    // and pushed onto a lock-free stack, the command thread takes the whole stack at once
+    // and sorts it into its own list. The consumer is woken through the condition variable only if it sleeps.
+    // User commands that supersede each other (seek, volume, device switch) are coalesced,
+    // only the latest pending one of a kind is executed.
+    // Internal commands go in front of the pending ones, in reverse order of pushing.
     struct CmdQueue {
-        bool empty() {
-            std::lock_guard<std::mutex> lock(mutex);
-            return queue.empty();
+        CmdQueue() : incoming(nullptr), head(nullptr), tail(nullptr), waiting(false), poolHint(0) {}
+        ~CmdQueue() {
+            take();
+            while (head)
+                release(pop());
         }
+
         void clear() {
-            std::lock_guard<std::mutex> lock(mutex);
-            queue.clear();
-            cond.notify_one();
+            push(ModeReset, false, CmdNone);
         }
         void set(const Cmd &cmd) {
-            std::lock_guard<std::mutex> lock(mutex);
-            queue.clear();
-            queue.push_back(cmd);
-            cond.notify_one();
+            push(ModeReset, false, cmd);
         }
-        void internalCommand(const Cmd &cmd) {
-            std::lock_guard<std::mutex> lock(mutex);
-            queue.push_front(cmd);
-            cond.notify_one();
+        template<typename... Args>
+        void internalCommand(Args&&... args) {
+            push(ModeFront, false, std::forward<Args>(args)...);
         }
-        void userCommand(const Cmd &cmd) {
-            std::lock_guard<std::mutex> lock(mutex);
-            queue.push_back(cmd);
-            queue.back().fromuser = true;
-            cond.notify_one();
+        template<typename... Args>
+        void userCommand(Args&&... args) {
+            push(ModeBack, true, std::forward<Args>(args)...);
         }
-        Cmd const pendingCommand() {
-            std::unique_lock<std::mutex> lock(mutex);
-            if (queue.empty())
-                cond.wait(lock, [this]{ return !queue.empty(); } );
+        // command thread only, blocks until there is a command,
+        // or for the given time at most if it is not zero, CmdNone then
+        Cmd const pendingCommand(std::chrono::milliseconds timeout = std::chrono::milliseconds(0)) {
+            for (;;) {
+                take();
+                if (head) {
+                    Node *node = pop();
+                    Cmd cmd(node->cmd);
+                    release(node);
+                    return cmd;
+                }
+                std::unique_lock<std::mutex> lock(mutex);
+                waiting.store(true);
+                bool woken = true;
+                if (timeout.count())
+                    woken = cond.wait_for(lock, timeout, [this]{ return incoming.load() != nullptr; });
+                else
+                    cond.wait(lock, [this]{ return incoming.load() != nullptr; });
+                waiting.store(false);
+                if (!woken)
+                    return Cmd();
+            }
+        }
+
+    private:
+        static constexpr size_t PoolSize = 64;
+        enum Mode { ModeBack, ModeFront, ModeReset };
+        struct Node {
+            Cmd cmd;
+            Node *next = nullptr;
+            Mode mode = ModeBack;
+            bool pooled = true;
+            std::atomic<bool> busy{false};
+        };
 
-            Cmd cmd(queue.front());
-            queue.pop_front();
+        template<typename... Args>
+        void push(Mode mode, bool fromuser, Args&&... args) {
+            Node *node = acquire();
+            node->cmd.assign(std::forward<Args>(args)...);
+            node->cmd.fromuser = fromuser;
+            if (fromuser) {
+                node->cmd.issued = std::chrono::steady_clock::now();
+                issued[node->cmd.cmd].fetch_add(1, std::memory_order_relaxed);
+            }
+            node->mode = mode;
+            node->next = incoming.load(std::memory_order_relaxed);
+            while (!incoming.compare_exchange_weak(node->next, node, std::memory_order_seq_cst, std::memory_order_relaxed))
+                ;
+            if (waiting.load()) {
+                // the consumer either has not checked yet or sleeps already
+                std::lock_guard<std::mutex> lock(mutex);
+                cond.notify_one();
+            }
+        }
 
-            return cmd;
+        Node *acquire() {
+            size_t start = poolHint.load(std::memory_order_relaxed);
+            for (size_t i = 0; i < PoolSize; i++) {
+                Node &node = pool[(start + i) % PoolSize];
+                if (!node.busy.load(std::memory_order_relaxed) && !node.busy.exchange(true, std::memory_order_acquire)) {
+                    poolHint.store((start + i + 1) % PoolSize, std::memory_order_relaxed);
+                    return &node;
+                }
+            }
+            Node *node = new Node();
+            node->pooled = false;
+            return node;
         }
 
-        std::deque<Cmd> queue;
+        void release(Node *node) {
+            if (node->pooled)
+                node->busy.store(false, std::memory_order_release);
+            else
+                delete node;
+        }
+
+        static bool supersedes(Command cmd, Command pending) {
+            switch (cmd) {
+            case CmdSeek:
+            case CmdRewind:
+                return pending == CmdSeek || pending == CmdRewind;
+            case CmdSetPlaybackVolume:
+            case CmdSetCaptureChannels:
+            case CmdSwitchPlaybackDevice:
+            case CmdSwitchCaptureDevice:
+                return pending == cmd;
+            default:
+                return false;
+            }
+        }
+
+        // moves the pushed commands into the consumer list, in push order
+        void take() {
+            Node *list = incoming.exchange(nullptr, std::memory_order_acquire);
+            Node *ordered = nullptr;
+            while (list) {
+                Node *next = list->next;
+                list->next = ordered;
+                ordered = list;
+                list = next;
+            }
+            while (ordered) {
+                Node *node = ordered;
+                ordered = ordered->next;
+                node->next = nullptr;
+                switch (node->mode) {
+                case ModeReset:
+                    while (head)
+                        release(pop());
+                    if (node->cmd.cmd == CmdNone) {
+                        release(node);
+                        break;
+                    }
+                    // fall through
+                case ModeFront:
+                    node->next = head;
+                    head = node;
+                    if (!tail)
+                        tail = node;
+                    break;
+                case ModeBack:
+                    if (supersedes(node->cmd.cmd, node->cmd.cmd)) { // a coalescing kind, drop the pending one
+                        for (Node **pn = &head, *prev = nullptr; *pn; ) {
+                            Node *pending = *pn;
+                            if (pending->cmd.fromuser && supersedes(node->cmd.cmd, pending->cmd.cmd)) {
+                                coalesced[pending->cmd.cmd].fetch_add(1, std::memory_order_relaxed);
+                                *pn = pending->next;
+                                if (tail == pending)
+                                    tail = prev;
+                                release(pending);
+                            } else {
+                                prev = pending;
+                                pn = &pending->next;
+                            }
+                        }
+                    }
+                    if (tail)
+                        tail->next = node;
+                    else
+                        head = node;
+                    tail = node;
+                    break;
+                }
+            }
+        }
+
+        Node *pop() {
+            Node *node = head;
+            head = node->next;
+            if (!head)
+                tail = nullptr;
+            return node;
+        }
+
+    public:
+        std::atomic<uint64_t> issued[CmdExit + 1] = {};    // user commands, see CommandStats
+        std::atomic<uint64_t> coalesced[CmdExit + 1] = {};
+
+    private:
+        Node pool[PoolSize];
+        std::atomic<Node*> incoming; // pushed, newest first
+        Node *head, *tail;           // consumer list
+        std::atomic<bool> waiting;
+        std::atomic<size_t> poolHint;
         std::mutex mutex;
-        std::condition_variable_any cond;
+        std::condition_variable cond;
     };
 
 public:
@@ -230,16 +450,92 @@ public:
             std::string name;
             ma_device_id id;
         };
-        std::vector<Device> list;
-        int defaultIdx;
+        std::vector<Device> list;   // from the latest enumeration
+        int defaultIdx;             // -1 if not enumerated yet
         std::string preferred;
         std::string selectedName;
         ma_device_id selectedId;
     };
 
+    // enumeration result, published by the enumeration worker and never modified afterwards
+    struct DeviceSnapshot {
+        std::vector<Devices::Device> playback;
+        std::vector<Devices::Device> capture;
+        int playbackDefault = -1;
+        int captureDefault = -1;
+    };
+
+    // process I/O counters, sampled around a playback
+    struct IoCounters {
+        uint64_t majorFaults = 0;   // all the page faults on Windows
+        uint64_t minorFaults = 0;
+        uint64_t readBytes = 0;
+    };
+
+    struct privateContext;
+
+    // additional capture device of the capture group, runs on the shared context,
+    // delivers its frames to the group callback from own worker thread, aligned to the main capture device timeline
+    struct GroupDevice {
+        GroupDevice(privateContext *_ppc, unsigned _index, const std::string &_preferred);
+        ~GroupDevice();
+
+        privateContext *ppc;
+        const unsigned index;
+        const std::string preferred;    // preferred device name, partial match
+        std::string name;               // opened device name
+        ma_unique_device device;
+        ma_pcm_rb rb;                   // device thread -> worker
+        bool rbReady;
+        ma_event dataEvent;             // signaled on new data
+        std::thread worker;
+        std::atomic<bool> running;
+        std::atomic<uint64_t> framesIn;
+        std::atomic<uint64_t> framesOut;
+        std::atomic<uint64_t> slipped;
+        std::atomic<uint64_t> overruns;
+        std::atomic<int64_t> timelineOffset; // main device timeline position of the first frame, -1 if not synced yet
+        std::atomic<bool> started;      // false while stopped on purpose
+        uint64_t startIn;               // counters at the device start, for drift estimation
+        uint64_t startMaster;
+    };
+
+    // frame data subscriber, the device callbacks copy the frames into its own ring and never wait for it,
+    // the frames are delivered from the subscriber worker thread, or by pollSubscriber() if it has none
+    struct Subscriber {
+        Subscriber(frameDataCb _cbProc, void *_userData, bool _polled);
+        ~Subscriber();
+
+        // ring chunk header, the frames follow, chunks are 8 byte aligned so a header never wraps
+        struct Chunk {
+            uint16_t format;
+            uint16_t channels;
+            uint32_t frames;
+        };
+        static constexpr size_t ChunkAlign = sizeof(Chunk);
+
+        const frameDataCb cbProc;
+        void * const userData;
+        const bool polled;
+        ma_rb rb;                       // device thread -> consumer, chunks of frames as delivered by the device
+        bool rbReady;
+        std::unique_ptr<char[]> chunk;  // consumer copy of a chunk that wraps the ring
+        ma_event dataEvent;             // signaled on new data, the worker only
+        std::thread worker;
+        std::atomic<bool> running;
+        std::atomic<uint64_t> framesIn;
+        std::atomic<uint64_t> framesOut;
+        std::atomic<uint64_t> overruns;
+    };
+
     struct privateContext {
-        privateContext(logger::Logger*);
+        privateContext(logger::Logger*, Backend);
         ~privateContext();
+        ma_result initContext();
+        void publish();
+
+
+        Backend backend;
 
         State state;
         union {
@@ -253,46 +549,139 @@ public:
         std::string playbackFileName;
         std::string lastFileName;
         bool updatePlaybackFileName;
+        bool mappedPlayback;
         ma_uint64 length;
         Cmd playbackEOFcmd;
         float playbackVolumeFactor;
+        IoCounters ioStart;             // at the playback file open
+        CommandStats cmdStats[CmdExit + 1]; // command thread side, issued and coalesced come from the queue
+        std::atomic<uint64_t> callbackMisses; // device callbacks that could not get the lock in time, their frames are lost
 
         ma_unique_context context;
         ma_unique_device device;
+        std::string deviceName;         // selected device name the device is opened with
+        ma_uint32 captureChannels;      // see setCaptureChannels()
+        ma_uint32 devicePeriod;         // period the device is opened with
+        ma_uint32 deviceChannels;       // capture channels requested, 0 native
         ma_unique_encoder encoder;
         ma_unique_decoder decoder;
         ma_decoder_config decoderConfig;
 
-        std::mutex device_mutex;
-        Devices playbackDevices;
+        // stopped main devices are kept open, so switching between modes only restarts them
+        struct PooledDevice {
+            ma_unique_device device;
+            std::string name;
+            ma_uint32 period;
+            ma_uint32 channels;
+        };
+        PooledDevice devicePool[2];             // [0] playback, [1] capture
+        std::atomic<bool> devicePoolStale;      // a device was lost, the pooled ones can't be trusted either
+
+        std::mutex device_mutex;        // preferred and selected devices
+        Devices playbackDevices;        // list and defaultIdx are not used, see deviceSnapshot
         Devices captureDevices;
 
+        // device enumeration runs on its own worker, only the very first device start waits for it
+        std::shared_ptr<const DeviceSnapshot> deviceSnapshot; // std::atomic_load / std::atomic_store only
+        std::thread enumWorker;
+        std::mutex enumMutex;
+        std::condition_variable enumCond;     // wakes the worker up
+        std::condition_variable snapshotCond; // a snapshot is published
+        bool enumRequested;
+        bool enumExit;
+
         frameDataCb frameDataCbProc;
         void *frameDataCbUserData;
 
         notificationCb notificationCbProc;
         void *notificationCbUserData;
         unsigned notificationCbMask;
+        wakeupCb notificationWakeupProc;
+        bool notificationQueued;
+
+        // notifications waiting for dispatchNotifications(), single producer ring, the command thread fills it
+        struct QueuedNotification {
+            notificationCb cbProc;
+            void *userData;
+            NotificationEvent event;
+            std::string dataStr;
+            uint64_t dataU64;
+        };
+        static constexpr size_t NotificationQueueSize = 64;
+        QueuedNotification notificationQueue[NotificationQueueSize];
+        std::atomic<size_t> notificationHead;   // next to dispatch
+        std::atomic<size_t> notificationTail;   // next to fill
+
+        std::vector<std::unique_ptr<GroupDevice>> groupDevices;
+        std::atomic<groupFrameDataCb> groupFrameDataCbProc;
+        void *groupFrameDataCbUserData;
+        std::atomic<uint64_t> captureFrames; // main capture device timeline, frames since capture start
+
+        // see setThreadPriority()
+        std::atomic<ThreadPriority> threadPriority;
+        std::atomic<uint64_t> audioCpus;
+        std::atomic<uint64_t> workerCpus;
+
+        // see setLowLatency(), the period is mutex side, the tuner doubles it on xruns
+        ma_uint32 lowLatencyPeriod;             // requested, 0 if off
+        ma_uint32 tunedPeriod;                  // the next device opens with it
+        std::atomic<bool> tunable;              // the running device has room to back off
+        std::atomic<bool> retuneRequested;      // set by the device callback, the command thread queues the retune
+        bool retunePending;                     // queued, command thread only
+
+        // main device timing, see getLatencyStats(), the clock fields belong to the device callback thread
+        std::atomic<bool> clockRestart;         // the device is (re)started, the next callback takes a new base
+        std::chrono::steady_clock::time_point clockBase;
+        std::chrono::steady_clock::time_point lastXrun;
+        uint64_t clockFrames;                   // frames passed since the base
+        std::atomic<uint64_t> xruns;
+        std::atomic<uint64_t> callbacks;
+        std::atomic<uint64_t> callbackNs;
+        std::atomic<uint64_t> callbackMaxNs;
+
+        // slot index is the subscriber id, a slot is only changed with the mutex held,
+        // the device callbacks walk the slots under the same lock
+        static constexpr unsigned MaxSubscribers = 8;
+        std::unique_ptr<Subscriber> subscribers[MaxSubscribers];
 
         logger::Logger *log;
 
         std::timed_mutex mutex;
         std::condition_variable_any cond;
+
+        // lock-free view of the state for the pollers, a seqlock over the fields below,
+        // written by publish() with the mutex held, the cursor is kept by the playback callback on its own
+        std::atomic<uint32_t> pubSeq;           // odd while being written
+        std::atomic<unsigned> pubState;
+        std::atomic<bool> pubHasPlaybackFile;
+        std::atomic<uint64_t> pubLength;        // 0 unless operational
+        std::atomic<bool> pubHasCursor;         // a file is open, the position is the cursor, otherwise the length
+        std::atomic<uint64_t> cursor;
+        std::atomic<int> pubError;              // the last error not taken by getError() yet
+        int pubErrorLast;                       // mutex side, the error published last
+        std::atomic<int> errorTaken;            // the error getError() took but could not clear, the next publish() does
     };
 
 public:
     AudioHandler(logger::Logger *logptr = nullptr, uint32_t _sampleRateHz = 44100, uint32_t _channels = 2, Format _sampleFormat = FormatF32, Format _recordFormat = FormatF32);
     // _frameDataCbInterval is the preferred interval, in frames, frame data callback would be called,
     // it is not guaranteed that this value would have effect, as it depends on OS audio subsystem
-    AudioHandler(logger::Logger *logptr, uint32_t _sampleRateHz, uint32_t _channels, Format _sampleFormat, Format _recordFormat, uint32_t _frameDataCbInterval);
+    // _lazyInit defers the backend init to init(), a static handler costs nothing before main() then
+    AudioHandler(logger::Logger *logptr, uint32_t _sampleRateHz, uint32_t _channels, Format _sampleFormat, Format _recordFormat, uint32_t _frameDataCbInterval, Backend _backend = BackendDefault, bool _lazyInit = false);
     ~AudioHandler();
 
+    // init: start the backend init on the command thread of a lazily initialized handler, returns at once,
+    // commands issued before and meanwhile are carried out as soon as the backend is ready,
+    // the state is ready then, backend error is set on failure
+    // _frameDataCbInterval replaces the constructor one unless 0
+    void init(uint32_t _frameDataCbInterval = 0);
+
     // callbacks
     // Do not call from within the callback any AudioHandler functions that marked as can block, as this end up in a dead lock
     // attachFrameDataCb: add frame data callback of type
     // void frameDataCb(Format format, uint32_t channels, const void *pData, uint32_t frameCount, void *userData)
     // where
-    //   format:     sample format
+    //   format:     sample format, the capture format while capturing, see setCaptureFormat()
     //   channels:   number of channels
     //   pData:      frame array pointer
     //   frameCount: number of frames in the frame array
@@ -314,25 +703,77 @@ public:
     //   EventPause:      dataStr - name of the paused device, or "default" if unknown/not enumerated, dataU64 - NotificationEventOp
     //   EventResume:     dataStr - name of the resumed device, or "default" if unknown/not enumerated, dataU64 - NotificationEventOp
     //   EventStop:       dataStr - name of the stopped device, or "default" if unknown/not enumerated, dataU64 - NotificationEventOp
+    // the callback is called from the command thread unless queued, then notifications wait in a queue
+    // until dispatchNotifications() delivers them on the thread calling it, and the command thread never runs
+    // application code; wakeupProc, if any, is called from the command thread on every queued notification
+    // with the same userData, it has to be short and thread safe, e.g. wake the UI event loop up
     // can block
-    void attachNotificationCb(unsigned mask, notificationCb cbProc, void *userData = nullptr);
+    void attachNotificationCb(unsigned mask, notificationCb cbProc, void *userData = nullptr, bool queued = false, wakeupCb wakeupProc = nullptr);
+    // dispatchNotifications: deliver the queued notifications, in order, call from a single thread,
+    // returns the number delivered
+    size_t dispatchNotifications();
     // removeFrameDataCb: remove frame data callback
     // can block
     void removeNotificationCb();
+    // attachGroupFrameDataCb: add capture group frame data callback of type
+    // void groupFrameDataCb(unsigned device, Format format, uint32_t channels, const void *pData, uint32_t frameCount, uint64_t timelinePos, void *userData)
+    // where
+    //   device:      capture group device index, in order of addCaptureDevice() calls
+    //   timelinePos: position of the first frame on the main capture device timeline
+    //   other arguments are the same as for frameDataCb
+    // the callback is called from the device own worker thread, not from the audio thread,
+    // devices are delivered in parallel, so the callback has to be reentrant across devices;
+    // attach before adding devices
+    void attachGroupFrameDataCb(groupFrameDataCb cbProc, void *userData = nullptr);
+    // removeGroupFrameDataCb: remove capture group frame data callback
+    void removeGroupFrameDataCb();
+    // addSubscriber: add an independent consumer of the frame data, the callback is of frameDataCb type;
+    // the device callbacks copy the frames into the subscriber own ring of the given number of callback intervals
+    // and go on, the frames that do not fit are dropped and counted as overruns, so a slow subscriber
+    // delays neither the device nor the other subscribers;
+    // the callback is called from the subscriber worker thread, or, if polled, only from pollSubscriber()
+    // the ring is sized for the frame data callback interval of up to SubscriberChannels channels,
+    // add subscribers after init() with lazy init;
+    // returns the subscriber id, or -1 if there are no free slots or the ring could not be allocated
+    // can block
+    int addSubscriber(frameDataCb cbProc, void *userData = nullptr, bool polled = false, unsigned periods = 8);
+    static constexpr uint32_t SubscriberChannels = 8;
+    // removeSubscriber: remove the subscriber, pending frames are discarded, there are no callbacks after the return;
+    // a polled subscriber has to be removed from the thread polling it
+    // can block
+    void removeSubscriber(int id);
+    // pollSubscriber: deliver the frames pending for a polled subscriber on the calling thread,
+    // call from a single thread, returns the number of frames delivered
+    size_t pollSubscriber(int id);
+    // getSubscriberStats: subscriber counters
+    // return value indicates if the request was successful
+    // can block
+    bool getSubscriberStats(int id, SubscriberStats &stats);
 
     // devices
-    // enumerate: enumerate available audio devices
+    // enumerate: request a refresh of available audio devices, does not wait for it,
+    // the list is also refreshed periodically and when a device is stopped or rerouted
     void enumerate();
-    // getPlaybackDevices: get playback devices with the lock aquired
-    const Devices &getPlaybackDevices();
-    // getCaptureDevices: get playback devices with the lock aquired
-    const Devices &getCaptureDevices();
-    // unlockDevices: unlock devices lock
-    void unlockDevices();
+    // getPlaybackDevices: get a copy of the latest playback devices list along with the selection
+    Devices getPlaybackDevices();
+    // getCaptureDevices: get a copy of the latest capture devices list along with the selection
+    Devices getCaptureDevices();
     // setPreferredPlaybackDevice: set or reset preferred payback device
     void setPreferredPlaybackDevice(const char *deviceName = nullptr);
     // setPreferredCaptureDevice: set or reset preferred capture device
     void setPreferredCaptureDevice(const char *deviceName = nullptr);
+    // addCaptureDevice: add capture device to the capture group, partial name match as for setPreferredCaptureDevice(),
+    // group devices are opened and started along with the main capture device
+    void addCaptureDevice(const char *deviceName);
+    // clearCaptureDevices: close and remove all capture group devices
+    void clearCaptureDevices();
+    // getCaptureGroupStats: capture group devices counters
+    // can block
+    bool getCaptureGroupStats(std::vector<GroupDeviceStats> &stats);
+    // getCommandStats: user command statistics indexed by Command, and the device callbacks missed,
+    // return value indicates if the request was successful
+    // can block
+    bool getCommandStats(std::vector<CommandStats> &stats, uint64_t *callbackMisses = nullptr);
     // setPlaybackVolumeFactor: set playback volume factor (0~1)
     void setPlaybackVolumeFactor(const float &volumeFactor = 1.0f);
     // getPlaybackVolumeFactor: get playback volume factor (0~1)
@@ -350,6 +791,40 @@ public:
     void setPlaybackFileName(const char *fileName);
     // setUpdatePlaybackFileName: update PlaybackFileName after successful record
     void setUpdatePlaybackFileName(bool newval) { pc.updatePlaybackFileName = newval; } // safe to modify directly
+    // setMappedPlayback: play uncompressed WAV/RF64 files right from a memory mapping instead of the decoder,
+    // on by default, takes effect with the next file opened
+    void setMappedPlayback(bool newval) { pc.mappedPlayback = newval; } // ditto
+    // setCaptureFormat: sample format the main capture device delivers to the frame data callback,
+    // FormatAny takes the device native one and spares the conversion, default is the sample format;
+    // capture group devices and playback keep the sample format
+    // call before init()
+    void setCaptureFormat(Format format) { captureFormat = (ma_format)format; }
+    // setCaptureChannels: channel count of the main capture device, 0 takes the device native one,
+    // the frame data callback gets the count the device opened with; default is the handler channels;
+    // a running capture device is reopened with it, a recording keeps the count its device has
+    void setCaptureChannels(uint32_t captureChannels);
+    // setThreadPriority: priority the backend creates its audio threads with, the capture group
+    // and subscriber workers are made realtime too with PriorityRealtime;
+    // audioCpus pins the threads the device callbacks run on, workerCpus the workers, 0 leaves them unpinned;
+    // refusals of the system are logged and otherwise ignored;
+    // applies to the devices and workers started afterwards, call before the first start
+    // can block
+    void setThreadPriority(ThreadPriority priority, uint64_t audioCpus = 0, uint64_t workerCpus = 0);
+    // setLowLatency: open the main device with the low latency profile and periods of the given frames
+    // instead of the frame data callback interval, the frame data comes in blocks of about a period then,
+    // the consumers accumulate to their own hop; 0 turns it off;
+    // a second xrun within XrunBackoffWindow doubles the period, up to the callback interval, and reopens the device;
+    // capture group devices keep the callback interval;
+    // takes effect with the next device open
+    // can block
+    void setLowLatency(uint32_t periodFrames);
+    static constexpr uint32_t LowLatencyPeriodMin = 32;
+    static constexpr std::chrono::seconds XrunBackoffWindow{10};
+    static constexpr std::chrono::milliseconds XrunPollInterval{50}; // the command thread picks up a backoff request
+    // getLatencyStats: main device timing, see LatencyStats
+    // return value indicates if the request was successful
+    // can block
+    bool getLatencyStats(LatencyStats &stats);
     // stop: stop the current operation and reset state
     void stop();
     // play: start playing a specified file or file preselected earlier,
@@ -382,11 +857,11 @@ public:
     // state
     // get the current state, optionaly with current file length and position
     // return value indicates if the request was successful
-    // can block
+    // lock-free, the state as of the last command done, the position as of the last playback callback
     bool getState(State &state, uint64_t *lenInPcmFrames = nullptr, uint64_t *posInPcmFrames = nullptr);
-    // get error, if any, with optional description
+    // get error, if any, with optional description, the error is reported once
     // return value indicates if the request was successful
-    // can block
+    // lock-free
     bool getError(int *error = nullptr, const char **description = nullptr);
 
     // utility
@@ -398,12 +873,20 @@ public:
     const ma_uint32 channels;
     const ma_format sampleFormat;
     const ma_format recordFormat;
-    const ma_uint32 frameDataCbInterval;
+    ma_uint32 frameDataCbInterval; // fixed once the command thread runs
+    ma_format captureFormat;       // ditto
 
 private:
-    constexpr bool isOperational() { return !pc.state.isIdle() && pc.backendError == MA_SUCCESS; }
-
     void commandProc();
+    void enumerateProc();
+    std::shared_ptr<const DeviceSnapshot> waitDeviceSnapshot(bool wait = true);
+    bool groupDeviceStart(GroupDevice &gd);
+    void groupDeviceClose(GroupDevice &gd);
+    void parkDevice();
+    void closeDecoder();
+    void notify(const Notification &notification);
+    ma_unique_device takePooledDevice(const ma_device_config &config, const std::string &name);
+    ma_uint32 nativeCaptureChannels();
 
     privateContext pc;
 
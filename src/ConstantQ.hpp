@@ -0,0 +1,104 @@
+#pragma once
+
+#define _USE_MATH_DEFINES
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <algorithm> // min, max
+
+#include <fft4g.hpp>
+
+// Constant-Q transform over the analyzer FFT output, one bin per semitone.
+// Precomputes the sparse spectral kernel (J. C. Brown, M. S. Puckette, "An efficient algorithm
+// for the calculation of a constant Q transform", 1992): each key is a Hann windowed complex
+// exponential of Q periods, transformed to the frequency domain and thresholded, so a transform
+// is a single sparse matrix-vector product with the frame spectrum.
+// Kernels longer than the FFT frame are truncated, lower keys get the frame resolution then.
+// The kernel is immutable after construction and can be shared between analyzers.
+class ConstantQ {
+public:
+    // fftsize: frame size, sample_freq: Hz, fmin: the lowest key frequency, keys: number of semitones,
+    // threshold: kernel coefficients below it relative to the key peak are dropped
+    ConstantQ(size_t fftsize, double sample_freq, double _fmin, size_t keys, double threshold = 0.0054) :
+        fmin(_fmin),
+        key_end(keys)
+    {
+        const double Q = 1.0 / (std::pow(2.0, 1.0 / 12.0) - 1.0);
+        fft4g fft((int)fftsize);
+        std::vector<double> re(fftsize), im(fftsize);
+        std::vector<Coef> key_coefs;
+
+        for (size_t k = 0; k < keys; ++k) {
+            double freq = fmin * std::pow(2.0, (double)k / 12.0);
+            size_t len = std::min(fftsize, (size_t)std::ceil(Q * sample_freq / freq));
+            size_t start = (fftsize - len) / 2; // centered, where the frame window peaks
+            double wsum = 0.0;
+
+            std::fill(re.begin(), re.end(), 0.0);
+            std::fill(im.begin(), im.end(), 0.0);
+            for (size_t i = 0; i < len; ++i) {
+                double w = 0.5 - 0.5 * std::cos(2.0 * M_PI * (double)i / (double)len);
+                double phase = 2.0 * M_PI * freq * (double)i / sample_freq;
+                re[start + i] =  w * std::cos(phase);
+                im[start + i] = -w * std::sin(phase);
+                wsum += w;
+            }
+            fft.rdft(1, re.data());
+            fft.rdft(1, im.data());
+
+            // kernel spectrum K = FFT(re) + i * FFT(im), positive frequencies only
+            double peak = 0.0;
+            key_coefs.clear();
+            for (size_t m = 1; m < fftsize / 2; ++m) {
+                double kre = re[m * 2] - im[m * 2 + 1];
+                double kim = re[m * 2 + 1] + im[m * 2];
+                peak = std::max(peak, kre * kre + kim * kim);
+                key_coefs.push_back({ (uint32_t)m, kre, kim });
+            }
+
+            // keep the conjugate, scaled to match the magnitude of an FFT bin of the Hann windowed frame
+            double scale = 1.0 / (2.0 * wsum);
+            double thres = peak * threshold * threshold;
+            for (const auto &c : key_coefs)
+                if (c.re * c.re + c.im * c.im >= thres)
+                    kernel.push_back({ c.bin, c.re * scale, -c.im * scale });
+            key_end[k] = kernel.size();
+        }
+    }
+
+    // computes the key magnitudes from the rdft output of the frame, out has size() elements
+    void transform(const double *fft_data, float *out) const
+    {
+        size_t i = 0;
+        for (size_t k = 0; k < key_end.size(); ++k) {
+            double sre = 0.0, sim = 0.0;
+            for (; i < key_end[k]; ++i) {
+                const Coef &c = kernel[i];
+                double xre = fft_data[c.bin * 2], xim = fft_data[c.bin * 2 + 1];
+                sre += xre * c.re - xim * c.im;
+                sim += xre * c.im + xim * c.re;
+            }
+            out[k] = (float)std::sqrt(sre * sre + sim * sim);
+        }
+    }
+
+    // number of keys
+    size_t size() const { return key_end.size(); }
+
+    // center frequency of the key, Hz
+    double get_freq(size_t key) const { return fmin * std::pow(2.0, (double)key / 12.0); }
+
+    // kernel coefficients in total, the cost of a transform
+    size_t get_nonzeros() const { return kernel.size(); }
+
+private:
+    struct Coef {
+        uint32_t bin;
+        double re, im;
+    };
+
+    double fmin;
+    std::vector<Coef> kernel;    // all keys, bin ascending within a key
+    std::vector<size_t> key_end; // end of each key in the kernel
+};
@@ -0,0 +1,264 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include <imgui.h>
+
+// On-disk cache of a built font atlas: the alpha8 texture and the glyph tables of every font.
+// Load() maps the file and sets the atlas up without decompressing or rasterizing anything,
+// on a miss the caller builds the atlas as usual and Save()s it.
+// The key has to cover everything the atlas is built from: font data, sizes, ranges and scale,
+// the ImGui version and the struct layouts are checked here.
+// Fonts come back in the order they were added, merged sources are part of their destination font.
+// Mouse cursor shapes are not restored, they are only drawn with io.MouseDrawCursor set.
+class FontAtlasCache {
+public:
+#if defined(_WIN32)
+    typedef wchar_t path_char_t;
+#else
+    typedef char path_char_t;
+#endif
+
+    // FNV-1a, chain the calls to key several blocks
+    static uint64_t Hash(const void *data, size_t size, uint64_t hash = 14695981039346656037ull)
+    {
+        const unsigned char *p = (const unsigned char*)data;
+        for (size_t i = 0; i < size; i++)
+            hash = (hash ^ p[i]) * 1099511628211ull;
+        return hash;
+    }
+
+    // false if the file is missing, stale or damaged, the atlas is left cleared then
+    static bool Load(ImFontAtlas *atlas, const path_char_t *path, uint64_t key)
+    {
+        Mapping map(path);
+        const unsigned char *p = map.data, *end = map.data + map.size;
+        Header h;
+        if (!map.data || !Read(p, end, h) || memcmp(h.magic, Magic, sizeof(h.magic)) || h.version != IMGUI_VERSION_NUM
+            || h.layout != Layout() || h.key != key || h.width <= 0 || h.height <= 0 || h.fonts == 0 || h.fonts > 64)
+            return false;
+
+        atlas->Clear();
+        // sources first, fonts point into the vector
+        atlas->ConfigData.resize((int)h.fonts);
+        for (uint32_t i = 0; i < h.fonts; i++) {
+            FontRecord fr;
+            if (!Read(p, end, fr) || (size_t)(end - p) < (size_t)fr.glyphs * sizeof(GlyphRecord)) {
+                atlas->Clear();
+                return false;
+            }
+            ImFontConfig &cfg = atlas->ConfigData[(int)i];
+            cfg = ImFontConfig();
+            cfg.FontDataOwnedByAtlas = false;
+            cfg.SizePixels = fr.size;
+            memcpy(cfg.Name, fr.name, sizeof(cfg.Name) < sizeof(fr.name) ? sizeof(cfg.Name) : sizeof(fr.name));
+            cfg.Name[sizeof(cfg.Name) - 1] = '\0';
+
+            ImFont *font = IM_NEW(ImFont)();
+            atlas->Fonts.push_back(font);
+            cfg.DstFont = font;
+            font->ConfigData = &cfg;
+            font->ConfigDataCount = 1;
+            font->ContainerAtlas = atlas;
+            font->FontSize = fr.size;
+            font->Ascent = fr.ascent;
+            font->Descent = fr.descent;
+            font->Glyphs.reserve((int)fr.glyphs);
+            for (uint32_t g = 0; g < fr.glyphs; g++) {
+                GlyphRecord gr;
+                Read(p, end, gr);
+                font->AddGlyph(nullptr, (ImWchar)gr.codepoint, gr.x0, gr.y0, gr.x1, gr.y1, gr.u0, gr.v0, gr.u1, gr.v1, gr.advanceX);
+                font->Glyphs.back().Colored = gr.colored != 0;
+            }
+        }
+
+        size_t pixels = (size_t)h.width * (size_t)h.height;
+        if ((size_t)(end - p) != pixels) {
+            atlas->Clear();
+            return false;
+        }
+        atlas->TexPixelsAlpha8 = (unsigned char*)IM_ALLOC(pixels);
+        memcpy(atlas->TexPixelsAlpha8, p, pixels);
+        atlas->TexWidth = h.width;
+        atlas->TexHeight = h.height;
+        atlas->TexUvScale = h.uvScale;
+        atlas->TexUvWhitePixel = h.uvWhitePixel;
+        memcpy(atlas->TexUvLines, h.uvLines, sizeof(atlas->TexUvLines));
+        for (ImFont *font : atlas->Fonts)
+            font->BuildLookupTable();
+        atlas->TexReady = true;
+        return true;
+    }
+
+    // call right after Build(), before the backend converts the texture
+    static bool Save(ImFontAtlas *atlas, const path_char_t *path, uint64_t key)
+    {
+        if (!atlas->TexReady || !atlas->TexPixelsAlpha8 || atlas->Fonts.empty())
+            return false;
+
+        // written aside and renamed, a reader never sees a partial file
+#if defined(_WIN32)
+        std::wstring tmp = std::wstring(path) + L".tmp";
+        FILE *f = _wfopen(tmp.c_str(), L"wb");
+#else
+        std::string tmp = std::string(path) + ".tmp";
+        FILE *f = fopen(tmp.c_str(), "wb");
+#endif
+        if (!f)
+            return false;
+
+        Header h = {};
+        memcpy(h.magic, Magic, sizeof(h.magic));
+        h.version = IMGUI_VERSION_NUM;
+        h.layout = Layout();
+        h.key = key;
+        h.width = atlas->TexWidth;
+        h.height = atlas->TexHeight;
+        h.uvScale = atlas->TexUvScale;
+        h.uvWhitePixel = atlas->TexUvWhitePixel;
+        memcpy(h.uvLines, atlas->TexUvLines, sizeof(h.uvLines));
+        h.fonts = (uint32_t)atlas->Fonts.Size;
+        bool ok = fwrite(&h, sizeof(h), 1, f) == 1;
+        for (const ImFont *font : atlas->Fonts) {
+            FontRecord fr = {};
+            if (font->ConfigData)
+                memcpy(fr.name, font->ConfigData->Name, sizeof(fr.name) < sizeof(font->ConfigData->Name) ? sizeof(fr.name) : sizeof(font->ConfigData->Name));
+            fr.size = font->FontSize;
+            fr.ascent = font->Ascent;
+            fr.descent = font->Descent;
+            fr.glyphs = (uint32_t)font->Glyphs.Size;
+            ok = ok && fwrite(&fr, sizeof(fr), 1, f) == 1;
+            for (const ImFontGlyph &g : font->Glyphs) {
+                GlyphRecord gr = { g.Codepoint, g.Colored, g.AdvanceX, g.X0, g.Y0, g.X1, g.Y1, g.U0, g.V0, g.U1, g.V1 };
+                ok = ok && fwrite(&gr, sizeof(gr), 1, f) == 1;
+            }
+        }
+        ok = ok && fwrite(atlas->TexPixelsAlpha8, (size_t)atlas->TexWidth * atlas->TexHeight, 1, f) == 1;
+        ok = fclose(f) == 0 && ok;
+
+#if defined(_WIN32)
+        ok = ok && MoveFileExW(tmp.c_str(), path, MOVEFILE_REPLACE_EXISTING);
+        if (!ok)
+            _wremove(tmp.c_str());
+#else
+        ok = ok && rename(tmp.c_str(), path) == 0;
+        if (!ok)
+            remove(tmp.c_str());
+#endif
+        return ok;
+    }
+
+private:
+    static constexpr char Magic[8] = { 'I', 'M', 'V', 'P', 'M', 'F', 'A', '1' };
+
+    struct Header {
+        char magic[8];
+        uint32_t version;   // IMGUI_VERSION_NUM
+        uint32_t layout;    // Layout()
+        uint64_t key;
+        int32_t width, height;
+        ImVec2 uvScale;
+        ImVec2 uvWhitePixel;
+        ImVec4 uvLines[IM_DRAWLIST_TEX_LINES_WIDTH_MAX + 1];
+        uint32_t fonts;     // FontRecord and its glyphs each, followed by the pixels
+    };
+
+    struct FontRecord {
+        char name[40];
+        float size, ascent, descent;
+        uint32_t glyphs;
+    };
+
+    struct GlyphRecord {
+        uint32_t codepoint;
+        uint32_t colored;
+        float advanceX, x0, y0, x1, y1, u0, v0, u1, v1;
+    };
+
+    // the records are native, a file from another build or platform is just a miss
+    static constexpr uint32_t Layout()
+    {
+        return (uint32_t)(sizeof(ImWchar) | sizeof(void*) << 4 | sizeof(Header) << 8 | sizeof(GlyphRecord) << 20);
+    }
+
+    template<typename T>
+    static bool Read(const unsigned char *&p, const unsigned char *end, T &value)
+    {
+        if ((size_t)(end - p) < sizeof(T))
+            return false;
+        memcpy(&value, p, sizeof(T));
+        p += sizeof(T);
+        return true;
+    }
+
+    // read-only view of the whole file
+    struct Mapping {
+        const unsigned char *data = nullptr;
+        size_t size = 0;
+
+#if defined(_WIN32)
+        HANDLE mapping = NULL;
+
+        Mapping(const wchar_t *path)
+        {
+            HANDLE file = CreateFileW(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+            if (file == INVALID_HANDLE_VALUE)
+                return;
+            LARGE_INTEGER fsize;
+            if (GetFileSizeEx(file, &fsize) && fsize.QuadPart > 0)
+                mapping = CreateFileMappingW(file, NULL, PAGE_READONLY, 0, 0, NULL);
+            CloseHandle(file);
+            if (!mapping)
+                return;
+            data = (const unsigned char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            if (data)
+                size = (size_t)fsize.QuadPart;
+        }
+
+        ~Mapping()
+        {
+            if (data)
+                UnmapViewOfFile(data);
+            if (mapping)
+                CloseHandle(mapping);
+        }
+#else
+        Mapping(const char *path)
+        {
+            int fd = open(path, O_RDONLY);
+            if (fd < 0)
+                return;
+            struct stat sb;
+            if (fstat(fd, &sb) == 0 && sb.st_size > 0) {
+                void *map = mmap(nullptr, (size_t)sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (map != MAP_FAILED) {
+                    data = (const unsigned char*)map;
+                    size = (size_t)sb.st_size;
+                }
+            }
+            close(fd);
+        }
+
+        ~Mapping()
+        {
+            if (data)
+                munmap((void*)data, size);
+        }
+#endif
+
+        Mapping(const Mapping&) = delete;
+        Mapping& operator=(const Mapping&) = delete;
+    };
+};
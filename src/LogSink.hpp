@@ -0,0 +1,234 @@
+#pragma once
+
+#include <cstdio>
+#include <ctime>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+#if defined(_WIN32)
+#include <io.h>     // _commit, _fileno
+#else
+#include <unistd.h> // fsync
+#endif
+
+#include "Logger.hpp"
+
+namespace logger {
+
+// Persistent log file fed from a Logger.
+// A background thread polls the logger ring and writes new entries out, producers do nothing extra,
+// so logging cost and the callers timing are the same with or without the sink.
+// Writes are buffered and flushed once per poll, the file is synced to the disk every sync interval
+// and rotated to path.1 .. path.<keep> when it grows over max_size.
+// Entries overwritten in the ring before a poll gets to them are reported as lost,
+// entries polled while the file can not be reopened after a rotation are dropped and reported as such.
+class LogSink {
+public:
+    LogSink(Logger &log) :
+        mLog(log),
+        mFile(nullptr),
+        mSize(0),
+        mMaxSize(0),
+        mKeep(0),
+        mNextN(0),
+        mDropped(0),
+        mStop(false)
+    {
+    }
+
+    ~LogSink()
+    {
+        Close();
+    }
+
+    LogSink(const LogSink&) = delete;
+    LogSink& operator=(const LogSink&) = delete;
+
+    // appends to the file, entries still in the logger ring go first
+    bool Open(const char *path, size_t max_size = 8 << 20, unsigned keep = 3,
+              std::chrono::milliseconds poll = std::chrono::milliseconds(100),
+              std::chrono::milliseconds sync = std::chrono::seconds(5))
+    {
+        Close();
+        mPath = path;
+        mMaxSize = max_size;
+        mKeep = keep;
+        mPoll = poll;
+        mSync = sync;
+        if (!OpenFile("a"))
+            return false;
+        mNextN = mLog.LastN() - mLog.Size() + 1;
+        mDropped = 0;
+        mStop = false;
+        mThread = std::thread(&LogSink::Run, this);
+        return true;
+    }
+
+    // writes out everything logged so far and closes the file
+    void Close()
+    {
+        if (!mThread.joinable())
+            return;
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mStop = true;
+        }
+        mCond.notify_one();
+        mThread.join();
+    }
+
+    bool IsOpen() { return mThread.joinable(); }
+
+    const std::string& GetPath() { return mPath; }
+
+private:
+    bool OpenFile(const char *mode)
+    {
+        mFile = fopen(mPath.c_str(), mode);
+        if (!mFile)
+            return false;
+        setvbuf(mFile, nullptr, _IOFBF, 64 << 10);
+        fseek(mFile, 0, SEEK_END);
+        long size = ftell(mFile);
+        mSize = size > 0 ? (size_t)size : 0;
+        return true;
+    }
+
+    void Run()
+    {
+        auto synced = std::chrono::steady_clock::now();
+        std::unique_lock<std::mutex> lock(mMutex);
+        for (;;)
+        {
+            bool stop = mCond.wait_for(lock, mPoll, [this] { return mStop; });
+            lock.unlock();
+            Drain();
+            auto now = std::chrono::steady_clock::now();
+            if (stop || now - synced >= mSync)
+            {
+                Sync();
+                synced = now;
+            }
+            lock.lock();
+            if (stop)
+                break;
+        }
+        if (mFile)
+            fclose(mFile);
+        mFile = nullptr;
+    }
+
+    void Drain()
+    {
+        Logger::Entry entry;
+        unsigned long long last = mLog.LastN();
+        unsigned long long first = last - mLog.Size() + 1; // the oldest entry still in the ring
+        if (!mFile && !OpenFile("a")) // the rotation could not open a new one, try again every poll
+        {
+            mDropped += last + 1 - mNextN;
+            mNextN = last + 1;
+            return;
+        }
+        bool written = false;
+        if (mDropped)
+        {
+            Write(time(nullptr), nullptr, "%llu log messages dropped, the log file could not be opened", mDropped);
+            mDropped = 0;
+            written = true;
+        }
+        if (mFile && mNextN < first)
+        {
+            Write(time(nullptr), nullptr, "%llu log messages lost", first - mNextN);
+            mNextN = first;
+            written = true;
+        }
+        for ( ; mFile && mNextN <= last; mNextN++)
+        {
+            if (!mLog.GetEntry(mNextN, entry))
+            {
+                if (mLog.IsPending(mNextN))
+                    break; // keep the order, pick it up on the next poll
+                continue;
+            }
+            Write(entry.Ts, Logger::Lvl2Str(entry.Lvl), "%s", entry.Msg);
+            written = true;
+        }
+        if (!mFile) // a rotation failed midway, the rest goes with the next poll or counts as dropped
+            return;
+        if (written)
+            fflush(mFile);
+    }
+
+    template<typename... Args>
+    void Write(time_t ts, const char *lvl, const char *fmt, Args... args)
+    {
+        struct tm tm;
+#if defined(_WIN32)
+        localtime_s(&tm, &ts);
+#else
+        localtime_r(&ts, &tm);
+#endif
+        char time_str[32];
+        strftime(time_str, sizeof(time_str), "%Y-%m-%d %H:%M:%S", &tm);
+        int len = fprintf(mFile, "%s %s: ", time_str, lvl ? lvl : "LOG");
+        len += fprintf(mFile, fmt, args...);
+        len += fprintf(mFile, "\n");
+        if (len > 0)
+            mSize += (size_t)len;
+        if (mMaxSize && mSize >= mMaxSize)
+            Rotate();
+    }
+
+    void Sync()
+    {
+        if (!mFile)
+            return;
+        fflush(mFile);
+#if defined(_WIN32)
+        _commit(_fileno(mFile));
+#else
+        fsync(fileno(mFile));
+#endif
+    }
+
+    // shifts path -> path.1 -> ... -> path.<keep>, the oldest one is dropped
+    void Rotate()
+    {
+        Sync();
+        fclose(mFile);
+        mFile = nullptr;
+        if (mKeep)
+        {
+            std::string to = mPath + "." + std::to_string(mKeep);
+            remove(to.c_str());
+            for (unsigned i = mKeep; i > 1; i--)
+            {
+                std::string from = mPath + "." + std::to_string(i - 1);
+                rename(from.c_str(), to.c_str());
+                to = from;
+            }
+            rename(mPath.c_str(), to.c_str());
+        }
+        OpenFile("w");
+    }
+
+    Logger &mLog;
+    FILE *mFile;
+    std::string mPath;
+    size_t mSize;
+    size_t mMaxSize;
+    unsigned mKeep;
+    std::chrono::milliseconds mPoll;
+    std::chrono::milliseconds mSync;
+    unsigned long long mNextN; // the next entry to write
+    unsigned long long mDropped; // entries skipped while the file was not open
+    std::thread mThread;
+    std::mutex mMutex;
+    std::condition_variable mCond;
+    bool mStop;
+};
+
+} // namespace logger
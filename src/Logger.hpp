@@ -1,9 +1,12 @@
 #pragma once
 
+#include <cstdio>
 #include <cstring>
+#include <cstddef>
 #include <memory>
-#include <forward_list>
-#include <mutex>
+#include <atomic>
+#include <tuple>
+#include <type_traits>
 #include <ctime>
 
 namespace logger {
@@ -16,94 +19,140 @@ enum LOG_LVL {
     LOG_MAXLVL = LOG_DBG
 };
 
+// Message log kept in a fixed ring of preallocated slots.
+// Logging is wait-free and never allocates, so it can be done from the audio threads:
+// a writer claims the next entry number with an atomic counter and fills the slot in place.
+// Messages with numeric arguments only are stored unformatted and formatted by the reader,
+// the format has to be a string literal then. Readers never block writers, an entry that is
+// overwritten while being read is reported as gone.
 class Logger {
 public:
+    static constexpr size_t MsgSize = 256; // longer messages are truncated
 
     typedef struct {
         unsigned long long N;
         time_t Ts;
         LOG_LVL Lvl;
-        std::unique_ptr<const char[]> Msg;
+        char Msg[MsgSize];
     } Entry;
 
     typedef void (*MsgCB)(void *param);
 
+    // MaxSize is rounded up to a power of two
     Logger(LOG_LVL Lvl = LOG_INFO, size_t MaxSize = 200) :
-        mSize(0),
-        mMaxSize(MaxSize),
+        mMask(RoundUp(MaxSize) - 1),
+        mSlots(new Slot[mMask + 1]),
         mLastN(0),
+        mFirstN(0),
+        mDropped(0),
         mLvl(Lvl),
         mCB(nullptr),
         mCBparam(nullptr)
     {
     }
-    const std::forward_list<Entry>& LockEntries() { mMutex.lock(); return mEntries; }
-    void UnlockEntries() { mMutex.unlock(); }
 
     void LogMsg(LOG_LVL lvl, const char *msg) {
-        if (lvl > mLvl)
+        if (lvl > mLvl || *msg == '\0')
             return;
-        int len = (int)strlen(msg);
-        if (len == 0)
+        unsigned long long n;
+        Slot *slot = Claim(n);
+        if (!slot)
             return;
-        std::unique_ptr<char[]> buf(new char[len + 1]);
-        memcpy(buf.get(), msg, len);
-        // terminate and get rid of trailing new line
-        buf[len] = '\0';
-        while(--len >= 0 && (buf[len] == '\r' || buf[len] == '\n'))
-            buf[len] = '\0';
-        mMutex.lock();
-        mEntries.emplace_front(Entry({++mLastN, time(nullptr), lvl, std::move(buf)}));
-        mSize++;
-        if (mSize > mMaxSize)
-            mEntries.resize(mSize = mMaxSize);
-        mMutex.unlock();
-        if (mCB)
-            mCB(mCBparam);
+        size_t len = strnlen(msg, MsgSize - 1);
+        slot->Ts = time(nullptr);
+        slot->Lvl = lvl;
+        slot->Format = nullptr;
+        memcpy(slot->Data, msg, len);
+        slot->Data[len] = '\0';
+        Publish(slot, n);
     }
 
     template<typename... Args>
     void LogMsg(LOG_LVL lvl, const char *fmt, Args&&... args) {
         if (lvl > mLvl)
             return;
-        int len = snprintf(nullptr, 0, fmt, std::forward<Args>(args)...);
-        if (len <= 0)
+        unsigned long long n;
+        Slot *slot = Claim(n);
+        if (!slot)
             return;
-        std::unique_ptr<char[]> buf(new char[len + 1]);
-        snprintf(buf.get(), len + 1, fmt, std::forward<Args>(args)...);
+        slot->Ts = time(nullptr);
+        slot->Lvl = lvl;
+        if constexpr (Deferrable<std::decay_t<Args>...>()) {
+            // numbers only, the reader formats them
+            slot->Fmt = fmt;
+            slot->Format = &FormatPacked<std::decay_t<Args>...>;
+            unsigned char *p = slot->Data;
+            ((memcpy(p, &args, sizeof(args)), p += sizeof(args)), ...);
+        } else {
+            slot->Format = nullptr;
+            snprintf((char*)slot->Data, MsgSize, fmt, std::forward<Args>(args)...);
+        }
+        Publish(slot, n);
+    }
+
+    // copies entry N, formatting it if needed, trailing new lines are stripped,
+    // false if the entry is not written yet, gone or empty
+    bool GetEntry(unsigned long long N, Entry &entry) const {
+        if (N == 0 || N <= mFirstN.load(std::memory_order_acquire))
+            return false;
+        const Slot &slot = mSlots[N & mMask];
+        unsigned long long seq = slot.Seq.load(std::memory_order_acquire);
+        if (seq != 2 * N + 2)
+            return false;
+        entry.N = N;
+        entry.Ts = slot.Ts;
+        entry.Lvl = slot.Lvl;
+        FormatFn format = slot.Format;
+        const char *fmt = slot.Fmt;
+        unsigned char data[MsgSize];
+        memcpy(data, slot.Data, MsgSize);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.Seq.load(std::memory_order_relaxed) != seq)
+            return false; // overwritten while copying
+
+        if (format)
+            format(entry.Msg, fmt, data);
+        else
+            memcpy(entry.Msg, data, MsgSize);
+        entry.Msg[MsgSize - 1] = '\0';
         // get rid of trailing new line
-        while(--len >= 0 && (buf[len] == '\r' || buf[len] == '\n'))
-            buf[len] = '\0';
-        mMutex.lock();
-        mEntries.emplace_front(Entry({++mLastN, time(nullptr), lvl, std::move(buf)}));
-        mSize++;
-        if (mSize > mMaxSize)
-            mEntries.resize(mSize = mMaxSize);
-        mMutex.unlock();
-        if (mCB)
-            mCB(mCBparam);
+        int len = (int)strlen(entry.Msg);
+        while(--len >= 0 && (entry.Msg[len] == '\r' || entry.Msg[len] == '\n'))
+            entry.Msg[len] = '\0';
+        return entry.Msg[0] != '\0';
     }
+
+    // true while entry N is claimed by a writer but not published yet,
+    // GetEntry() failing otherwise means the entry is cleared, overwritten, dropped or empty
+    bool IsPending(unsigned long long N) const {
+        if (N == 0 || N <= mFirstN.load(std::memory_order_acquire))
+            return false;
+        const Slot &slot = mSlots[N & mMask];
+        if (slot.Skipped.load(std::memory_order_acquire) >= N)
+            return false; // dropped, the slot holds another writer
+        return slot.Seq.load(std::memory_order_acquire) < 2 * N + 2;
+    }
+
+    // entry numbers keep counting, cleared entries are gone for the readers
     void Clear() {
-        mMutex.lock();
-        mEntries.clear();
-        mSize = 0;
-        mLastN = 0;
-        mMutex.unlock();
+        mFirstN.store(mLastN.load(std::memory_order_relaxed), std::memory_order_release);
         if (mCB)
             mCB(mCBparam);
     }
     void Trim(size_t newsize) {
-        if (newsize >= mSize)
+        unsigned long long last = LastN();
+        if (last - mFirstN.load(std::memory_order_relaxed) <= newsize)
             return;
-        mMutex.lock();
-        mEntries.resize(newsize);
-        mSize = newsize;
-        mMutex.unlock();
+        mFirstN.store(last - newsize, std::memory_order_release);
         if (mCB)
             mCB(mCBparam);
     }
-    size_t Size() { return mSize; }
-    unsigned long long LastN() { return mLastN; }
+    size_t Size() {
+        unsigned long long size = LastN() - mFirstN.load(std::memory_order_relaxed);
+        return size > mMask + 1 ? mMask + 1 : (size_t)size;
+    }
+    unsigned long long LastN() { return mLastN.load(std::memory_order_acquire); }
+    unsigned long long Dropped() { return mDropped.load(std::memory_order_relaxed); } // messages lost to slot collisions
     void SetLevel(LOG_LVL lvl) { mLvl = lvl; }
     LOG_LVL GetLevel() { return mLvl; }
     void SetMsgCB(MsgCB cb, void *param = nullptr) { mCB = cb; mCBparam = param; };
@@ -111,12 +160,74 @@ public:
                                                                || (int)lvl < 0 ? "" : L2S[lvl]; }
 
 private:
-    std::mutex mMutex;
-    std::forward_list<Entry> mEntries;
-    size_t mSize;
-    const size_t mMaxSize;
-    unsigned long long mLastN;
-    LOG_LVL mLvl;
+    typedef int (*FormatFn)(char *buf, const char *fmt, const unsigned char *data);
+
+    struct Slot {
+        std::atomic<unsigned long long> Seq{0}; // 2N + 1 while entry N is being written, 2N + 2 when done
+        std::atomic<unsigned long long> Skipped{0}; // the latest entry dropped on this slot
+        time_t Ts;
+        LOG_LVL Lvl;
+        FormatFn Format;                        // nullptr if Data is the message text
+        const char *Fmt;
+        alignas(std::max_align_t) unsigned char Data[MsgSize]; // message text or packed arguments
+    };
+
+    static size_t RoundUp(size_t size) {
+        size_t res = 2;
+        while (res < size)
+            res <<= 1;
+        return res;
+    }
+
+    template<typename... T>
+    static constexpr bool Deferrable() {
+        return ((std::is_arithmetic_v<T> || std::is_enum_v<T>) && ...) && (sizeof(T) + ... + 0) <= MsgSize;
+    }
+
+    template<typename T>
+    static T Unpack(const unsigned char *data, size_t &offset) {
+        T value;
+        memcpy(&value, data + offset, sizeof(value));
+        offset += sizeof(value);
+        return value;
+    }
+
+    template<typename... T>
+    static int FormatPacked(char *buf, const char *fmt, const unsigned char *data) {
+        size_t offset = 0;
+        std::tuple<T...> args{ Unpack<T>(data, offset)... }; // braced, unpacked left to right
+        return std::apply([&](auto... a) { return snprintf(buf, MsgSize, fmt, a...); }, args);
+    }
+
+    // claims the slot of the next entry, nullptr if a writer a whole ring apart is still in there
+    Slot* Claim(unsigned long long &n) {
+        n = mLastN.fetch_add(1, std::memory_order_relaxed) + 1;
+        Slot *slot = &mSlots[n & mMask];
+        unsigned long long seq = slot->Seq.load(std::memory_order_relaxed);
+        if ((seq & 1) || seq > 2 * n || !slot->Seq.compare_exchange_strong(seq, 2 * n + 1, std::memory_order_relaxed)) {
+            // marks the entry as gone for IsPending(), drops on the same slot are a ring apart, the latest one stays
+            unsigned long long skipped = slot->Skipped.load(std::memory_order_relaxed);
+            while (skipped < n && !slot->Skipped.compare_exchange_weak(skipped, n, std::memory_order_release))
+                ;
+            mDropped.fetch_add(1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        std::atomic_thread_fence(std::memory_order_release);
+        return slot;
+    }
+
+    void Publish(Slot *slot, unsigned long long n) {
+        slot->Seq.store(2 * n + 2, std::memory_order_release);
+        if (mCB)
+            mCB(mCBparam);
+    }
+
+    const size_t mMask;
+    std::unique_ptr<Slot[]> mSlots;
+    std::atomic<unsigned long long> mLastN;
+    std::atomic<unsigned long long> mFirstN;   // entries up to and including it are cleared
+    std::atomic<unsigned long long> mDropped;
+    std::atomic<LOG_LVL> mLvl;
     MsgCB mCB;
     void* mCBparam;
     static constexpr const char* L2S[] = { "ERR", "WARN", "INFO", "DBG" };
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cmath>
+#include <chrono>
+#include <string>
+
+#include "Analyzer.hpp"
+#include "pitchstream.h"
+
+#if !defined(_WIN32)
+#include <sys/types.h>
+#endif
+
+// pitch stream writer, publishes analysis frames into POSIX shared memory,
+// see pitchstream.h for the layout and the reader side
+class PitchStream {
+public:
+    PitchStream() :
+        header(nullptr),
+        map_size(0)
+    {
+    }
+
+    ~PitchStream()
+    {
+        close();
+    }
+
+    PitchStream(const PitchStream&) = delete;
+    PitchStream& operator=(const PitchStream&) = delete;
+
+    // creates the shared memory object, slots is rounded up to a power of two,
+    // spectrum: publish FFT magnitudes along with the pitch
+    bool open(const char *shm_name, size_t slots = 256, bool spectrum = false)
+    {
+#if !defined(_WIN32)
+        close();
+
+        uint32_t count = 2;
+        while (count < slots)
+            count <<= 1;
+        uint32_t bins = spectrum ? (uint32_t)(Analyzer::FFTSIZE / 2) : 0;
+        uint32_t slot_size = (uint32_t)((sizeof(pitchstream_slot) + sizeof(float) * bins + 63) & ~(size_t)63); // cache line aligned
+        uint32_t header_size = (uint32_t)((sizeof(pitchstream_header) + 63) & ~(size_t)63);
+        size_t size = header_size + (size_t)count * slot_size;
+
+        name = shm_name && *shm_name ? shm_name : PITCHSTREAM_DEFAULT_NAME;
+        int fd = shm_open(name.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0644);
+        if (fd < 0)
+            return false;
+        if (ftruncate(fd, (off_t)size) != 0) {
+            ::close(fd);
+            shm_unlink(name.c_str());
+            return false;
+        }
+        void *map = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (map == MAP_FAILED) {
+            shm_unlink(name.c_str());
+            return false;
+        }
+
+        header = (pitchstream_header*)map;
+        map_size = size;
+        header->header_size = header_size;
+        header->slot_count = count;
+        header->slot_size = slot_size;
+        header->spectrum_bins = bins;
+        header->sample_rate = (uint32_t)Analyzer::SAMPLE_FREQ;
+        header->analyze_interval = (uint32_t)Analyzer::ANALYZE_INTERVAL;
+        header->writer_pid = (uint64_t)getpid();
+        __atomic_store_n(&header->write_seq, 0, __ATOMIC_RELAXED);
+        header->version = PITCHSTREAM_VERSION;
+        __atomic_store_n(&header->magic, PITCHSTREAM_MAGIC, __ATOMIC_RELEASE); // valid from now on
+        return true;
+#else
+        (void)shm_name; (void)slots; (void)spectrum;
+        return false;
+#endif // !_WIN32
+    }
+
+    void close()
+    {
+#if !defined(_WIN32)
+        if (!header)
+            return;
+        munmap(header, map_size);
+        shm_unlink(name.c_str());
+        header = nullptr;
+        map_size = 0;
+#endif // !_WIN32
+    }
+
+    bool is_open() { return header != nullptr; }
+
+    const std::string& get_name() { return name; }
+
+    // publishes the last analyzed frame, single writer, call from the analysis thread
+    void publish(Analyzer &analyzer)
+    {
+        if (!header)
+            return;
+
+        uint64_t index = header->write_seq; // only this thread writes it
+        pitchstream_slot *slot = pitchstream_slot_at(header, index);
+
+        __atomic_store_n(&slot->seq, 2 * index + 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+
+        double freq = analyzer.get_peak_freq();
+        slot->frame.index = index;
+        slot->frame.analyze_cnt = analyzer.Analyzer::get_total_analyze_cnt();
+        slot->frame.timestamp = std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+        slot->frame.freq = freq;
+        slot->frame.level = analyzer.get_level();
+        slot->frame.cents = Analyzer::freq_to_cent(freq);
+        slot->frame.confidence = (float)analyzer.get_confidence();
+        if (header->spectrum_bins) {
+            const double *fft = analyzer.Analyzer::get_fft_buf().get();
+            float *spectrum = pitchstream_spectrum(slot);
+            for (uint32_t i = 0; i < header->spectrum_bins; ++i)
+                spectrum[i] = (float)std::sqrt(Analyzer::power(fft[i * 2], fft[i * 2 + 1]));
+        }
+
+        __atomic_store_n(&slot->seq, 2 * index + 2, __ATOMIC_RELEASE);
+        __atomic_store_n(&header->write_seq, index + 1, __ATOMIC_RELEASE);
+    }
+
+    // Analyzer callback adapter, param is the PitchStream
+    static void analyze_cb(Analyzer &analyzer, void *param)
+    {
+        ((PitchStream*)param)->publish(analyzer);
+    }
+
+private:
+    pitchstream_header *header;
+    size_t map_size;
+    std::string name;
+};
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+
+// Ring of columns kept in a texture, a column per analysis frame, the newest one at the ring position.
+// A view that runs over the texture end is drawn as two spans instead of relying on repeat sampling,
+// so it works with clamp-to-edge samplers on any backend.
+struct TextureRingSpan {
+    size_t first;   // texture column
+    size_t count;
+};
+
+// splits the view of count columns up to and including the newest one into spans in drawing order,
+// oldest first, returns their number: 0 to 2
+inline size_t TextureRingSpans(size_t size, size_t newest, size_t count, TextureRingSpan spans[2])
+{
+    if (!size || !count)
+        return 0;
+    if (count > size)
+        count = size;
+    size_t end = newest % size + 1; // texture column past the newest one
+    size_t n = 0;
+    if (count > end)
+    {
+        // wraps around the ring, the older part is at the texture end
+        spans[n++] = { size - (count - end), count - end };
+        count = end;
+    }
+    spans[n++] = { end - count, count };
+    return n;
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#endif
+
+// Scheduling and memory controls for the audio and analysis threads.
+// Everything here is best effort: false means the system refused, e.g. no CAP_SYS_NICE,
+// RLIMIT_RTPRIO or RLIMIT_MEMLOCK too low, and the thread or the process goes on as it was.
+class ThreadTuning {
+public:
+    // FIFO priority of the threads the audio depends on, below the device threads the backends
+    // put at the top of the range, above anything that is not realtime
+    static constexpr int WorkerPriority = 80;
+
+    // "0-3,6" style list of the first 64 cpus to a mask, an empty list is 0, no pinning;
+    // the mask is left as is if the list is invalid
+    static bool ParseCpuList(const char *list, uint64_t &mask)
+    {
+        uint64_t m = 0;
+        for (const char *p = list; *p; ) {
+            char *end;
+            unsigned long first = strtoul(p, &end, 10), last = first;
+            if (end == p)
+                return false;
+            if (*end == '-') {
+                p = end + 1;
+                last = strtoul(p, &end, 10);
+                if (end == p)
+                    return false;
+            }
+            if (first > last || last > 63)
+                return false;
+            for (unsigned long i = first; i <= last; i++)
+                m |= 1ull << i;
+            p = end;
+            if (*p == ',')
+                p++;
+            else if (*p)
+                return false;
+        }
+        mask = m;
+        return true;
+    }
+
+    // realtime FIFO scheduling of the calling thread, the priority is clamped to the system range;
+    // the time critical priority on Windows
+    static bool SetRealtime(int priority)
+    {
+#if defined(_WIN32)
+        (void)priority;
+        return SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL) != 0;
+#else
+        int lo = sched_get_priority_min(SCHED_FIFO), hi = sched_get_priority_max(SCHED_FIFO);
+        sched_param sp = {};
+        sp.sched_priority = priority < lo ? lo : priority > hi ? hi : priority;
+        return pthread_setschedparam(pthread_self(), SCHED_FIFO, &sp) == 0;
+#endif
+    }
+
+    // pins the calling thread to the cpus of the mask, 0 leaves it as is
+    static bool SetAffinity(uint64_t mask)
+    {
+        if (!mask)
+            return true;
+#if defined(_WIN32)
+        return SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)mask) != 0;
+#elif defined(__linux__)
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int i = 0; i < 64; i++)
+            if (mask >> i & 1)
+                CPU_SET(i, &set);
+        return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+        return false; // affinity hints only
+#endif
+    }
+
+    // keeps the process memory resident, so the audio path takes no page faults;
+    // later allocations are locked too only with an unlimited RLIMIT_MEMLOCK, with a limit they would
+    // start failing once it is reached, allocate and prefault the audio buffers before the call then
+    static bool LockMemory()
+    {
+#if defined(_WIN32)
+        return false; // no process wide lock, the working set is managed by the system
+#else
+        int flags = MCL_CURRENT;
+        struct rlimit rl;
+        if (getrlimit(RLIMIT_MEMLOCK, &rl) == 0 && rl.rlim_cur == RLIM_INFINITY)
+            flags |= MCL_FUTURE;
+        return mlockall(flags) == 0;
+#endif
+    }
+};
@@ -0,0 +1,225 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// Read-only memory mapping of an uncompressed WAV file: PCM 8/16/24/32 bit, 32 bit float,
+// plain or extensible format chunk, RIFF or RF64 container, so recordings over 4 GB work too.
+// The samples are used right from the mapping, the kernel pages them in as they are touched;
+// Advise() asks for the pages ahead of the cursor so the audio thread rarely waits on a fault.
+// Anything else fails Open() and is left for a regular decoder.
+// The mapping of a file over the address space of a 32-bit build fails the same way.
+class WavMap {
+public:
+#if defined(_WIN32)
+    typedef wchar_t path_char_t;
+#else
+    typedef char path_char_t;
+#endif
+
+    enum SampleFormat {
+        FormatNone = 0,
+        FormatU8,
+        FormatS16,
+        FormatS24,
+        FormatS32,
+        FormatF32
+    };
+
+    static constexpr size_t ReadAhead = 1 << 20; // bytes Advise() keeps requested past the cursor
+
+    WavMap() {}
+    ~WavMap() { Close(); }
+
+    WavMap(const WavMap&) = delete;
+    WavMap& operator=(const WavMap&) = delete;
+
+    bool Open(const path_char_t *path)
+    {
+        Close();
+        if (!Map(path) || !Parse()) {
+            Close();
+            return false;
+        }
+#if !defined(_WIN32)
+        madvise((void*)mFile, mFileSize, MADV_SEQUENTIAL);
+#endif
+        Advise(0);
+        return true;
+    }
+
+    void Close()
+    {
+#if defined(_WIN32)
+        if (mFile)
+            UnmapViewOfFile(mFile);
+#else
+        if (mFile)
+            munmap((void*)mFile, mFileSize);
+#endif
+        mFile = nullptr;
+        mFileSize = 0;
+        mData = nullptr;
+        mFrames = 0;
+        mFormat = FormatNone;
+        mAdvisedFrom = mAdvised = 0;
+    }
+
+    bool IsOpen() const { return mData != nullptr; }
+
+    SampleFormat Format() const { return mFormat; }
+    uint32_t Channels() const { return mChannels; }
+    uint32_t SampleRate() const { return mSampleRate; }
+    uint32_t BytesPerFrame() const { return mBlockAlign; }
+    uint64_t Frames() const { return mFrames; }
+
+    // the first sample of the frame, frame <= Frames()
+    const unsigned char *FrameData(uint64_t frame) const { return mData + frame * mBlockAlign; }
+
+    // keeps ReadAhead bytes past the frame requested from the disk, cheap when there is nothing new to ask for
+    void Advise(uint64_t frame)
+    {
+#if defined(_WIN32)
+        (void)frame; // the file is opened for sequential scan, the cache manager reads ahead by itself
+#else
+        size_t from = (size_t)(FrameData(frame) - mFile);
+        if (from >= mAdvisedFrom && from < mAdvised && (mAdvised - from > ReadAhead / 2 || mAdvised == mFileSize))
+            return; // still well ahead
+        static const size_t page = (size_t)sysconf(_SC_PAGESIZE);
+        size_t start = from / page * page;
+        size_t end = std::min<size_t>(mFileSize, from + ReadAhead);
+        if (start >= end)
+            return;
+        madvise((void*)(mFile + start), end - start, MADV_WILLNEED);
+        mAdvisedFrom = start;
+        mAdvised = end;
+#endif
+    }
+
+private:
+    const unsigned char *mFile = nullptr;
+    size_t mFileSize = 0;
+    const unsigned char *mData = nullptr;
+    uint64_t mFrames = 0;
+    SampleFormat mFormat = FormatNone;
+    uint32_t mChannels = 0;
+    uint32_t mSampleRate = 0;
+    uint32_t mBlockAlign = 0;
+    size_t mAdvisedFrom = 0;    // file range Advise() has requested the pages of
+    size_t mAdvised = 0;
+
+    static uint16_t U16(const unsigned char *p) { return (uint16_t)(p[0] | p[1] << 8); }
+    static uint32_t U32(const unsigned char *p) { return (uint32_t)U16(p) | (uint32_t)U16(p + 2) << 16; }
+    static uint64_t U64(const unsigned char *p) { return (uint64_t)U32(p) | (uint64_t)U32(p + 4) << 32; }
+
+    bool Parse()
+    {
+        const unsigned char *p = mFile, *end = mFile + mFileSize;
+        if (mFileSize < 12 || (memcmp(p, "RIFF", 4) && memcmp(p, "RF64", 4)) || memcmp(p + 8, "WAVE", 4))
+            return false;
+        bool rf64 = !memcmp(p, "RF64", 4);
+        uint64_t dataSize64 = 0;
+        uint16_t tag = 0, bits = 0;
+        bool fmt = false;
+        for (p += 12; end - p >= 8; ) {
+            uint64_t size = U32(p + 4);
+            const unsigned char *body = p + 8;
+            if (!memcmp(p, "ds64", 4) && size >= 16 && (size_t)(end - body) >= 16)
+                dataSize64 = U64(body + 8);
+            else if (!memcmp(p, "fmt ", 4) && size >= 16 && (size_t)(end - body) >= 16) {
+                tag = U16(body);
+                mChannels = U16(body + 2);
+                mSampleRate = U32(body + 4);
+                mBlockAlign = U16(body + 12);
+                bits = U16(body + 14);
+                if (tag == 0xFFFE && size >= 40 && (size_t)(end - body) >= 40)
+                    tag = U16(body + 24); // WAVE_FORMAT_EXTENSIBLE, the subformat GUID starts with the tag
+                fmt = true;
+            }
+            else if (!memcmp(p, "data", 4)) {
+                if (rf64 && size == 0xFFFFFFFF)
+                    size = dataSize64;
+                // a recording cut short has no sizes written, take whatever is there
+                uint64_t avail = (uint64_t)(end - body);
+                if (size == 0 || size > avail)
+                    size = avail;
+                if (!fmt || !SetFormat(tag, bits))
+                    return false;
+                mData = body;
+                mFrames = size / mBlockAlign;
+                return true;
+            }
+            if (size > (uint64_t)(end - body))
+                return false;
+            p = body + size + (size & 1);
+        }
+        return false;
+    }
+
+    bool SetFormat(uint16_t tag, uint16_t bits)
+    {
+        if (mChannels == 0 || mSampleRate == 0 || mBlockAlign != mChannels * (bits / 8))
+            return false;
+        if (tag == 1) { // PCM
+            switch (bits) {
+            case 8:  mFormat = FormatU8;  return true;
+            case 16: mFormat = FormatS16; return true;
+            case 24: mFormat = FormatS24; return true;
+            case 32: mFormat = FormatS32; return true;
+            }
+        }
+        else if (tag == 3 && bits == 32) { // IEEE float
+            mFormat = FormatF32;
+            return true;
+        }
+        return false;
+    }
+
+#if defined(_WIN32)
+    bool Map(const wchar_t *path)
+    {
+        HANDLE file = CreateFileW(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        if (file == INVALID_HANDLE_VALUE)
+            return false;
+        LARGE_INTEGER fsize;
+        HANDLE mapping = NULL;
+        if (GetFileSizeEx(file, &fsize) && fsize.QuadPart > 0 && (uint64_t)fsize.QuadPart <= (uint64_t)SIZE_MAX)
+            mapping = CreateFileMappingW(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        CloseHandle(file);
+        if (!mapping)
+            return false;
+        mFile = (const unsigned char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        CloseHandle(mapping); // the view keeps it
+        if (mFile)
+            mFileSize = (size_t)fsize.QuadPart;
+        return mFile != nullptr;
+    }
+#else
+    bool Map(const char *path)
+    {
+        int fd = open(path, O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat sb;
+        if (fstat(fd, &sb) == 0 && sb.st_size > 0 && (uint64_t)sb.st_size <= (uint64_t)SIZE_MAX) {
+            void *map = mmap(nullptr, (size_t)sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (map != MAP_FAILED) {
+                mFile = (const unsigned char*)map;
+                mFileSize = (size_t)sb.st_size;
+            }
+        }
+        close(fd);
+        return mFile != nullptr;
+    }
+#endif
+};
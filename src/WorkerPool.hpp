@@ -0,0 +1,182 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <type_traits>
+
+// Persistent fork-join thread pool.
+// run() spreads count jobs over the workers and the calling thread and returns
+// when all of them are done. Workers sleep between runs, no allocation is done per run.
+class WorkerPool {
+public:
+    // workers: number of threads besides the caller, ~0 picks hardware concurrency - 1
+    explicit WorkerPool(size_t workers = ~(size_t)0) :
+        jobFn(nullptr),
+        jobCtx(nullptr),
+        jobCount(0),
+        generation(0),
+        active(0),
+        threadFn(nullptr),
+        threadCtx(nullptr),
+        threadGeneration(0),
+        threadPending(0),
+        quit(false),
+        next(0),
+        remaining(0)
+    {
+        if (workers == ~(size_t)0)
+        {
+            unsigned int hc = std::thread::hardware_concurrency();
+            workers = hc > 1 ? hc - 1 : 0;
+        }
+        threads.reserve(workers);
+        for (size_t i = 0; i < workers; ++i)
+            threads.emplace_back(&WorkerPool::workerProc, this);
+    }
+
+    ~WorkerPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            quit = true;
+        }
+        cv.notify_all();
+        for (auto &t : threads)
+            t.join();
+    }
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    // number of worker threads, not counting the caller
+    size_t size() const { return threads.size(); }
+
+    // runs job(index) for index in [0, count), blocks until all jobs are done
+    template<typename F>
+    void run(size_t count, F &&job)
+    {
+        if (count == 0)
+            return;
+        if (count == 1 || threads.empty())
+        {
+            for (size_t i = 0; i < count; ++i)
+                job(i);
+            return;
+        }
+        runJobs(count, [](void *ctx, size_t i) { (*(typename std::remove_reference<F>::type*)ctx)(i); }, &job);
+    }
+
+    // runs fn() once on every worker thread, e.g. to set its priority or affinity, blocks until done;
+    // call from the thread calling run(), not during a run
+    template<typename F>
+    void each_thread(F &&fn)
+    {
+        if (threads.empty())
+            return;
+        std::unique_lock<std::mutex> lock(mtx);
+        threadFn = [](void *ctx) { (*(typename std::remove_reference<F>::type*)ctx)(); };
+        threadCtx = &fn;
+        threadPending = threads.size();
+        ++threadGeneration;
+        cv.notify_all();
+        doneCv.wait(lock, [this] { return threadPending == 0; });
+    }
+
+private:
+    typedef void (*JobFn)(void *ctx, size_t index);
+    typedef void (*ThreadFn)(void *ctx);
+
+    std::vector<std::thread> threads;
+    std::mutex mtx;
+    std::condition_variable cv;      // workers wait here for a new run
+    std::condition_variable doneCv;  // caller waits here for the run completion
+    JobFn jobFn;
+    void *jobCtx;
+    size_t jobCount;
+    unsigned long long generation;
+    size_t active;                   // workers participating in the current run
+    ThreadFn threadFn;               // each_thread() request
+    void *threadCtx;
+    unsigned long long threadGeneration;
+    size_t threadPending;            // workers yet to run it
+    bool quit;
+    std::atomic<size_t> next;        // next job index to take
+    std::atomic<size_t> remaining;   // jobs not yet finished
+
+    void runJobs(size_t count, JobFn fn, void *ctx)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            jobFn = fn;
+            jobCtx = ctx;
+            jobCount = count;
+            next.store(0, std::memory_order_relaxed);
+            remaining.store(count, std::memory_order_relaxed);
+            ++generation;
+        }
+        cv.notify_all();
+
+        work(fn, ctx, count);
+
+        std::unique_lock<std::mutex> lock(mtx);
+        doneCv.wait(lock, [this] { return remaining.load(std::memory_order_acquire) == 0 && active == 0; });
+    }
+
+    void work(JobFn fn, void *ctx, size_t count)
+    {
+        size_t i;
+        while ((i = next.fetch_add(1, std::memory_order_relaxed)) < count)
+        {
+            fn(ctx, i);
+            if (remaining.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                doneCv.notify_one();
+            }
+        }
+    }
+
+    void workerProc()
+    {
+        unsigned long long seen = 0, threadSeen = 0;
+        std::unique_lock<std::mutex> lock(mtx);
+        for (;;)
+        {
+            cv.wait(lock, [&] { return quit || generation != seen || threadGeneration != threadSeen; });
+            if (quit)
+                break;
+            if (threadGeneration != threadSeen)
+            {
+                threadSeen = threadGeneration;
+                ThreadFn fn = threadFn;
+                void *ctx = threadCtx;
+                lock.unlock();
+                fn(ctx);
+                lock.lock();
+                if (--threadPending == 0)
+                    doneCv.notify_one();
+                continue;
+            }
+            seen = generation;
+            // a late wakeup may find the run already finished, its context is gone by then
+            if (remaining.load(std::memory_order_acquire) == 0)
+                continue;
+
+            JobFn fn = jobFn;
+            void *ctx = jobCtx;
+            size_t count = jobCount;
+            ++active;
+            lock.unlock();
+
+            work(fn, ctx, count);
+
+            lock.lock();
+            if (--active == 0)
+                doneCv.notify_one();
+        }
+    }
+};
@@ -0,0 +1,804 @@
+// AudioHandler benchmark on the miniaudio null backend, no audio hardware is needed
+#define NOMINMAX
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <vector>
+#include <memory>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cinttypes>
+#include <cmath>
+
+#include "Analyzer.hpp"
+#include "AudioHandler.h"
+#include "ThreadTuning.hpp"
+
+typedef std::chrono::steady_clock bench_clock;
+
+struct DeviceCtx
+{
+    std::vector<std::unique_ptr<Analyzer>> analyzers; // load factor copies
+    std::atomic<uint64_t> events;
+    std::atomic<uint64_t> busy_ns;
+
+    DeviceCtx(size_t load) : events(0), busy_ns(0)
+    {
+        for (size_t i = 0; i < load; i++)
+            analyzers.emplace_back(new Analyzer());
+    }
+};
+
+struct BenchCtx
+{
+    std::vector<std::unique_ptr<DeviceCtx>> devices;
+};
+
+static void groupCb(unsigned device, AudioHandler::Format format, uint32_t channels, const void *pData, uint32_t frameCount, uint64_t timelinePos, void *userData)
+{
+    (void)format; (void)timelinePos;
+    BenchCtx *ctx = (BenchCtx*)userData;
+    if (device >= ctx->devices.size())
+        return;
+    DeviceCtx &dev = *ctx->devices[device];
+
+    auto start = bench_clock::now();
+    for (auto &a : dev.analyzers) // the devices are opened as f32
+        a->addFrames(pData, Analyzer::InputF32, frameCount, channels);
+    dev.events += frameCount;
+    dev.busy_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(bench_clock::now() - start).count();
+}
+
+// runs capture with ndev group devices for the given time, returns analyses per second
+static double run_group(size_t ndev, size_t load, unsigned seconds)
+{
+    BenchCtx ctx;
+    for (size_t i = 0; i < ndev; i++)
+        ctx.devices.emplace_back(new DeviceCtx(load));
+
+    AudioHandler ah(nullptr, (uint32_t)Analyzer::SAMPLE_FREQ, 2, AudioHandler::FormatF32, AudioHandler::FormatF32,
+                    (uint32_t)Analyzer::ANALYZE_INTERVAL, AudioHandler::BackendNull);
+    ah.attachGroupFrameDataCb(groupCb, &ctx);
+    ah.enumerate();
+    for (size_t i = 0; i < ndev; i++)
+        ah.addCaptureDevice(""); // any, the null backend has a single capture device
+    ah.capture();
+
+    std::this_thread::sleep_for(std::chrono::seconds(seconds));
+
+    std::vector<AudioHandler::GroupDeviceStats> stats;
+    while (!ah.getCaptureGroupStats(stats))
+        std::this_thread::yield();
+    ah.stop();
+    ah.removeGroupFrameDataCb();
+
+    double total = 0.0;
+    printf("devices: %zu, load: %zu\n", ndev, load);
+    printf("  dev   events/s  us/event   busy%%   slipped  overruns  drift,ppm\n");
+    for (size_t i = 0; i < ndev; i++)
+    {
+        DeviceCtx &dev = *ctx.devices[i];
+        uint64_t events = dev.events / Analyzer::ANALYZE_INTERVAL * load;
+        double rate = (double)events / seconds;
+        double us = events ? (double)dev.busy_ns / 1000.0 / events : 0.0;
+        double busy = (double)dev.busy_ns / 1e7 / seconds;
+        total += rate;
+        if (i < stats.size())
+            printf("  %3zu %10.1f %9.2f %7.2f %9" PRIu64 " %9" PRIu64 " %10.1f%s\n", i, rate, us, busy,
+                   stats[i].slipped, stats[i].overruns, stats[i].driftPpm, stats[i].name.empty() ? " (not opened)" : "");
+    }
+    printf("  total %.1f analyses/s\n", total);
+
+    return total;
+}
+
+static void stopCb(const AudioHandler::Notification &notification, void *userData)
+{
+    (void)notification;
+    ((std::atomic<uint64_t>*)userData)->fetch_add(1, std::memory_order_release);
+}
+
+static void wait_stops(std::atomic<uint64_t> &stops, uint64_t count)
+{
+    while (stops.load(std::memory_order_acquire) < count)
+        std::this_thread::yield();
+}
+
+// command queue latency and throughput, stop on an idle handler is the cheapest command with a notification
+static void run_commands(size_t producers, size_t count)
+{
+    std::atomic<uint64_t> stops(0);
+    AudioHandler ah(nullptr, (uint32_t)Analyzer::SAMPLE_FREQ, 2, AudioHandler::FormatF32, AudioHandler::FormatF32,
+                    (uint32_t)Analyzer::ANALYZE_INTERVAL, AudioHandler::BackendNull);
+    ah.attachNotificationCb(AudioHandler::EventStop, stopCb, &stops);
+
+    // round trip, one command at a time
+    const size_t rounds = 1000;
+    std::vector<double> lat(rounds);
+    for (size_t i = 0; i < rounds; i++)
+    {
+        auto start = bench_clock::now();
+        ah.stop();
+        wait_stops(stops, i + 1);
+        lat[i] = std::chrono::duration<double, std::micro>(bench_clock::now() - start).count();
+    }
+    std::sort(lat.begin(), lat.end());
+    printf("latency, us: p50 %.1f  p99 %.1f  max %.1f\n", lat[rounds / 2], lat[rounds * 99 / 100], lat.back());
+
+    // flood from several threads
+    uint64_t base = stops;
+    std::vector<std::thread> threads;
+    std::vector<double> enqueue_ns(producers);
+    auto start = bench_clock::now();
+    for (size_t p = 0; p < producers; p++)
+        threads.emplace_back([&ah, &enqueue_ns, p, count, producers] {
+            auto t0 = bench_clock::now();
+            for (size_t i = 0; i < count / producers; i++)
+                ah.stop();
+            enqueue_ns[p] = std::chrono::duration<double, std::nano>(bench_clock::now() - t0).count() / (double)(count / producers);
+        });
+    for (auto &t : threads)
+        t.join();
+    wait_stops(stops, base + count / producers * producers);
+    double elapsed = std::chrono::duration<double>(bench_clock::now() - start).count();
+    double enqueue = 0.0;
+    for (double ns : enqueue_ns)
+        enqueue += ns / producers;
+    printf("throughput, %zu producers: %.0f commands/s, enqueue %.1f ns/command\n", producers, (double)(count / producers * producers) / elapsed, enqueue);
+
+    // a flood of superseding commands, only the pending one survives
+    base = stops;
+    start = bench_clock::now();
+    for (size_t i = 0; i < count; i++)
+        ah.setPlaybackVolumeFactor((float)(i % 100) / 100.0f);
+    ah.stop();
+    wait_stops(stops, base + 1);
+    elapsed = std::chrono::duration<double>(bench_clock::now() - start).count();
+    float volume = -1.0f;
+    ah.getPlaybackVolumeFactor(volume);
+    printf("coalescing: %zu volume changes settled in %.2f ms, final %.2f (expected %.2f)\n", count, elapsed * 1000.0, volume, (float)((count - 1) % 100) / 100.0f);
+}
+
+struct SwitchCtx
+{
+    std::atomic<uint64_t> resumes{0};
+    std::atomic<uint64_t> stops{0};
+};
+
+static void switchCb(const AudioHandler::Notification &notification, void *userData)
+{
+    SwitchCtx *ctx = (SwitchCtx*)userData;
+    (notification.event == AudioHandler::EventResume ? ctx->resumes : ctx->stops).fetch_add(1, std::memory_order_release);
+}
+
+static void print_latency(const char *name, std::vector<double> &lat)
+{
+    std::sort(lat.begin(), lat.end());
+    printf("  %-18s p50 %8.1f  p99 %8.1f  max %8.1f\n", name, lat[lat.size() / 2], lat[lat.size() * 99 / 100], lat.back());
+}
+
+// mode switch latency, from the command to the device running, the way the UI does it: stop, then start
+static void run_switches(size_t count)
+{
+    const char *file = "ahbench_play.wav";
+    const char *record_file = "ahbench_record.wav";
+    SwitchCtx ctx;
+    AudioHandler ah(nullptr, (uint32_t)Analyzer::SAMPLE_FREQ, 2, AudioHandler::FormatF32, AudioHandler::FormatF32,
+                    (uint32_t)Analyzer::ANALYZE_INTERVAL, AudioHandler::BackendNull);
+    ah.attachNotificationCb(AudioHandler::EventResume | AudioHandler::EventStop, switchCb, &ctx);
+    ah.setPlaybackEOFaction(AudioHandler::CmdPause); // no extra notifications
+
+    auto start_op = [&ah, &ctx](int op, const char *file) {
+        uint64_t resumes = ctx.resumes;
+        auto start = bench_clock::now();
+        if (op == 0)
+            ah.capture();
+        else if (op == 1)
+            ah.record(file);
+        else
+            ah.play(file);
+        while (ctx.resumes.load(std::memory_order_acquire) == resumes)
+            std::this_thread::yield();
+        return std::chrono::duration<double, std::micro>(bench_clock::now() - start).count();
+    };
+    auto stop = [&ah, &ctx] {
+        uint64_t stops = ctx.stops;
+        ah.stop();
+        while (ctx.stops.load(std::memory_order_acquire) == stops)
+            std::this_thread::yield();
+    };
+
+    // the first ones open the devices
+    double cold_capture = start_op(0, file);
+    stop();
+    double cold_record = start_op(1, file);
+    std::this_thread::sleep_for(std::chrono::milliseconds(100)); // something to play
+    stop();
+    double cold_play = start_op(2, file);
+    stop();
+    printf("switch latency, us\n");
+    printf("  first capture %.1f, record %.1f, playback %.1f\n", cold_capture, cold_record, cold_play);
+
+    std::vector<double> capture, record, play;
+    for (size_t i = 0; i < count; i++)
+    {
+        capture.push_back(start_op(0, file));
+        stop();
+        record.push_back(start_op(1, record_file));
+        stop();
+        play.push_back(start_op(2, file));
+        stop();
+    }
+    print_latency("capture", capture);
+    print_latency("record", record);
+    print_latency("playback", play);
+    remove(file);
+    remove(record_file);
+}
+
+static void countCb(AudioHandler::Format format, uint32_t channels, const void *pData, uint32_t frameCount, void *userData)
+{
+    (void)format; (void)channels; (void)pData;
+    ((std::atomic<uint64_t>*)userData)->fetch_add(frameCount, std::memory_order_relaxed);
+}
+
+// upper bound of the latency bucket the share of the commands falls into
+static double latency_percentile(const AudioHandler::CommandStats &st, double share)
+{
+    uint64_t total = 0, seen = 0;
+    for (uint64_t n : st.latency)
+        total += n;
+    for (size_t i = 0; i < AudioHandler::LatencyBuckets; i++)
+    {
+        seen += st.latency[i];
+        if (seen && seen >= share * total)
+            return i == AudioHandler::LatencyBuckets - 1 ? st.maxUs : (double)(1ull << i);
+    }
+    return 0.0;
+}
+
+// randomized command sequences from several threads against a running handler,
+// afterwards a stop has to go through and leave it idle, the per command latency is reported by the handler
+static int run_stress(size_t producers, size_t count)
+{
+    const char *file = "ahbench_play.wav";
+    const char *record_file = "ahbench_record.wav";
+    std::atomic<uint64_t> stops(0);
+    std::atomic<uint64_t> frames(0);
+    AudioHandler ah(nullptr, (uint32_t)Analyzer::SAMPLE_FREQ, 2, AudioHandler::FormatF32, AudioHandler::FormatF32,
+                    (uint32_t)Analyzer::ANALYZE_INTERVAL, AudioHandler::BackendNull);
+    ah.attachFrameDataCb(countCb, &frames);
+    ah.attachNotificationCb(AudioHandler::EventStop, stopCb, &stops);
+
+    // something to play and seek in
+    ah.record(file);
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    ah.stop();
+    wait_stops(stops, 1);
+    AudioHandler::State state;
+    uint64_t length = 0;
+    while (!ah.getState(state))
+        std::this_thread::yield();
+    ah.play(file);
+    while (!ah.getState(state, &length) || !length)
+        std::this_thread::yield();
+
+    auto start = bench_clock::now();
+    std::vector<std::thread> threads;
+    for (size_t p = 0; p < producers; p++)
+        threads.emplace_back([&ah, file, record_file, length, p, count, producers] {
+            uint32_t rng = 2463534242u + (uint32_t)p * 7919u; // xorshift32
+            auto next = [&rng] { rng ^= rng << 13; rng ^= rng >> 17; rng ^= rng << 5; return rng; };
+            for (size_t i = 0; i < count / producers; i++)
+            {
+                switch (next() % 10)
+                {
+                case 0: ah.play(file); break;
+                case 1: ah.capture(); break;
+                case 2: ah.record(record_file); break;
+                case 3: ah.pause(); break;
+                case 4: ah.resume(); break;
+                case 5: ah.togglePause(); break;
+                case 6: ah.seek(next() % length); break;
+                case 7: ah.rewind(); break;
+                case 8: ah.stop(); break;
+                case 9: ah.setPlaybackVolumeFactor((float)(next() % 101) / 100.0f); break;
+                }
+                // leave the devices some time to run in between
+                std::this_thread::sleep_for(std::chrono::microseconds(next() % 500));
+            }
+        });
+    for (auto &t : threads)
+        t.join();
+
+    // everything pushed before is done once the last stop is; a stop queued earlier may be the one
+    // notified, an idle state that holds for a while tells the last one is done too
+    ah.stop();
+    auto deadline = bench_clock::now() + std::chrono::seconds(5);
+    auto idle_since = bench_clock::time_point::max();
+    bool settled = false;
+    while (!settled && bench_clock::now() < deadline)
+    {
+        auto now = bench_clock::now();
+        if (!ah.getState(state) || !state.isIdle())
+            idle_since = bench_clock::time_point::max();
+        else if (idle_since == bench_clock::time_point::max())
+            idle_since = now;
+        else
+            settled = now - idle_since >= std::chrono::milliseconds(100);
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    // the settling hold itself is not part of the run
+    double elapsed = std::chrono::duration<double>((settled ? idle_since : bench_clock::now()) - start).count();
+
+    std::vector<AudioHandler::CommandStats> stats;
+    uint64_t misses = 0;
+    while (!ah.getCommandStats(stats, &misses))
+        std::this_thread::yield();
+
+    static const char *names[] = { "none", "stop", "play", "capture", "record", "pause", "resume", "toggle pause", "seek", "rewind",
+                                   "enumerate", "playback device", "capture device", "volume" };
+    printf("%zu commands from %zu producers in %.2f s, %.1f s of audio delivered, %" PRIu64 " callbacks missed\n",
+           count / producers * producers, producers, elapsed, (double)frames / Analyzer::SAMPLE_FREQ, misses);
+    printf("  %-15s %8s %8s %8s %9s %8s %8s %8s %8s\n", "command", "issued", "executed", "rejected", "coalesced", "dropped", "p50,us", "p99,us", "max,us");
+    for (size_t i = 1; i < stats.size() && i < sizeof(names) / sizeof(names[0]); i++)
+    {
+        const AudioHandler::CommandStats &st = stats[i];
+        if (!st.issued)
+            continue;
+        // dropped: cleared from the queue by an error stop
+        printf("  %-15s %8" PRIu64 " %8" PRIu64 " %8" PRIu64 " %9" PRIu64 " %8" PRIu64 " %8.0f %8.0f %8.0f\n", names[i], st.issued, st.executed, st.rejected,
+               st.coalesced, st.issued - std::min(st.issued, st.executed + st.coalesced), latency_percentile(st, 0.5), latency_percentile(st, 0.99), st.maxUs);
+    }
+    if (!settled)
+        printf("FAILED: the handler did not settle after the final stop\n");
+
+    remove(file);
+    remove(record_file);
+    return settled ? 0 : 1;
+}
+
+struct PlayCtx
+{
+    Analyzer analyzer;
+    uint64_t frames = 0;
+    uint64_t busy_ns = 0;
+    std::atomic<uint64_t> stops{0};
+};
+
+static void playCb(AudioHandler::Format format, uint32_t channels, const void *pData, uint32_t frameCount, void *userData)
+{
+    (void)format;
+    PlayCtx *ctx = (PlayCtx*)userData;
+    auto start = bench_clock::now();
+    ctx->analyzer.addFrames(pData, Analyzer::InputF32, frameCount, channels);
+    ctx->frames += frameCount;
+    ctx->busy_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(bench_clock::now() - start).count();
+}
+
+// plays the file with the mapped path and with the decoder, the handler reports the I/O each one took,
+// drop the page cache before the run for cold file numbers
+static void run_playback(const char *file, unsigned seconds)
+{
+    for (int mapped = 1; mapped >= 0; mapped--)
+    {
+        logger::Logger log(logger::LOG_DBG);
+        PlayCtx ctx;
+        AudioHandler ah(&log, (uint32_t)Analyzer::SAMPLE_FREQ, 2, AudioHandler::FormatF32, AudioHandler::FormatF32,
+                        (uint32_t)Analyzer::ANALYZE_INTERVAL, AudioHandler::BackendNull);
+        ah.attachFrameDataCb(playCb, &ctx);
+        ah.attachNotificationCb(AudioHandler::EventStop, stopCb, &ctx.stops);
+        ah.setMappedPlayback(mapped != 0);
+        ah.play(file);
+        std::this_thread::sleep_for(std::chrono::seconds(seconds));
+        ah.stop();
+        wait_stops(ctx.stops, 1);
+
+        printf("%s: %.1f s played, callback %.2f us/1k frames\n", mapped ? "mapped" : "decoder",
+               (double)ctx.frames / Analyzer::SAMPLE_FREQ, ctx.frames ? (double)ctx.busy_ns / ctx.frames : 0.0);
+        logger::Logger::Entry entry;
+        for (unsigned long long n = log.LastN() - log.Size() + 1; n <= log.LastN(); n++)
+            if (log.GetEntry(n, entry) && (!strncmp(entry.Msg, "Playing", 7) || !strncmp(entry.Msg, "Playback I/O", 12)))
+                printf("  %s\n", entry.Msg);
+    }
+}
+
+struct SubscriberCtx
+{
+    Analyzer analyzer;
+    uint64_t frames = 0;
+    unsigned delay_us = 0; // simulated slow consumer
+};
+
+static void subscriberCb(AudioHandler::Format format, uint32_t channels, const void *pData, uint32_t frameCount, void *userData)
+{
+    (void)format;
+    SubscriberCtx *ctx = (SubscriberCtx*)userData;
+    ctx->analyzer.addFrames(pData, Analyzer::InputF32, frameCount, channels);
+    ctx->frames += frameCount;
+    if (ctx->delay_us)
+        std::this_thread::sleep_for(std::chrono::microseconds(ctx->delay_us));
+}
+
+// captures with several frame data subscribers: one on own thread, one polled from here and a slow one
+// taking twice the callback interval per chunk, only the slow one may lose frames
+static int run_fanout(unsigned seconds)
+{
+    const char *names[] = { "worker", "polled", "slow" };
+    SubscriberCtx ctx[3];
+    ctx[2].delay_us = (unsigned)(2e6 * Analyzer::ANALYZE_INTERVAL / Analyzer::SAMPLE_FREQ);
+    AudioHandler ah(nullptr, (uint32_t)Analyzer::SAMPLE_FREQ, 2, AudioHandler::FormatF32, AudioHandler::FormatF32,
+                    (uint32_t)Analyzer::ANALYZE_INTERVAL, AudioHandler::BackendNull);
+    int ids[3] = { ah.addSubscriber(subscriberCb, &ctx[0]),
+                   ah.addSubscriber(subscriberCb, &ctx[1], true),
+                   ah.addSubscriber(subscriberCb, &ctx[2]) };
+    ah.capture();
+
+    auto end = bench_clock::now() + std::chrono::seconds(seconds);
+    while (bench_clock::now() < end)
+    {
+        ah.pollSubscriber(ids[1]);
+        std::this_thread::sleep_for(std::chrono::milliseconds(20)); // a UI frame or so
+    }
+    ah.stop();
+    ah.pollSubscriber(ids[1]);
+
+    bool ok = true;
+    printf("  subscriber   frames in  frames out  overruns\n");
+    for (size_t i = 0; i < 3; i++)
+    {
+        AudioHandler::SubscriberStats st;
+        while (!ah.getSubscriberStats(ids[i], st))
+            std::this_thread::yield();
+        ah.removeSubscriber(ids[i]);
+        printf("  %-10s %11" PRIu64 " %11" PRIu64 " %9" PRIu64 "\n", names[i], st.framesIn, st.framesOut, st.overruns);
+        if (i < 2 && st.overruns)
+            ok = false;
+    }
+    if (!ok)
+        printf("FAILED: a subscriber lost frames to the slow one\n");
+
+    return ok ? 0 : 1;
+}
+
+static void channelsCb(AudioHandler::Format format, uint32_t channels, const void *pData, uint32_t frameCount, void *userData)
+{
+    (void)format; (void)pData; (void)frameCount;
+    ((std::atomic<uint32_t>*)userData)->store(channels, std::memory_order_relaxed);
+}
+
+// captures with the native channel count, as the per-channel mode does, then records the way the
+// applications do, a stop and a record; the file has to keep every native channel
+static int run_native(void)
+{
+    const char *file = "ahbench_native.wav";
+    std::atomic<uint64_t> stops(0);
+    std::atomic<uint32_t> channels(0);
+    // a mono handler, so a fall back to its count shows even on the stereo null device
+    AudioHandler ah(nullptr, (uint32_t)Analyzer::SAMPLE_FREQ, 1, AudioHandler::FormatF32, AudioHandler::FormatF32,
+                    (uint32_t)Analyzer::ANALYZE_INTERVAL, AudioHandler::BackendNull);
+    ah.attachFrameDataCb(channelsCb, &channels);
+    ah.attachNotificationCb(AudioHandler::EventStop, stopCb, &stops);
+    ah.setCaptureChannels(0);
+
+    ah.capture();
+    while (!channels.load(std::memory_order_relaxed))
+        std::this_thread::yield();
+    uint32_t native = channels.exchange(0, std::memory_order_relaxed);
+    ah.stop();
+    wait_stops(stops, 1);
+
+    ah.record(file);
+    while (!channels.load(std::memory_order_relaxed))
+        std::this_thread::yield();
+    uint32_t recorded = channels.load(std::memory_order_relaxed);
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    ah.stop();
+    wait_stops(stops, 2);
+
+    uint16_t file_channels = 0;
+    FILE *f = fopen(file, "rb");
+    if (f)
+    {
+        unsigned char header[24];
+        if (fread(header, 1, sizeof(header), f) == sizeof(header))
+            file_channels = (uint16_t)(header[22] | header[23] << 8); // the canonical fmt chunk
+        fclose(f);
+    }
+    remove(file);
+
+    printf("native capture %u channels, recording %u channels, file %u channels\n", native, recorded, file_channels);
+    if (recorded != native || file_channels != native)
+    {
+        printf("FAILED: the recording does not keep the native channels\n");
+        return 1;
+    }
+    return 0;
+}
+
+struct JitterCtx
+{
+    bench_clock::time_point last;
+    bool started = false;
+    uint64_t count = 0;
+    double max_us = 0.0;
+    uint64_t hist[AudioHandler::LatencyBuckets] = {}; // [0] under 1 us, [i] under 2^i us
+    std::atomic<uint64_t> stops{0};
+};
+
+// deviation of the callback interval from the period the frames stand for, on the audio thread
+static void jitterCb(AudioHandler::Format format, uint32_t channels, const void *pData, uint32_t frameCount, void *userData)
+{
+    (void)format; (void)channels; (void)pData;
+    JitterCtx *ctx = (JitterCtx*)userData;
+    auto now = bench_clock::now();
+    if (ctx->started)
+    {
+        double us = std::fabs(std::chrono::duration<double, std::micro>(now - ctx->last).count() - frameCount * 1e6 / Analyzer::SAMPLE_FREQ);
+        size_t bucket = 0;
+        while (bucket < AudioHandler::LatencyBuckets - 1 && us >= (double)(1ull << bucket))
+            bucket++;
+        ctx->hist[bucket]++;
+        ctx->count++;
+        ctx->max_us = std::max(ctx->max_us, us);
+    }
+    ctx->last = now;
+    ctx->started = true;
+}
+
+// callback interval jitter of the null backend device, with the realtime controls off and on,
+// load threads spin on all cpus meanwhile; the priority and the memory lock need the limits to allow them
+static void run_jitter(unsigned seconds, size_t load, uint64_t cpus)
+{
+    std::atomic<bool> spin(true);
+    std::vector<std::thread> spinners;
+    for (size_t i = 0; i < load; i++)
+        spinners.emplace_back([&spin] { while (spin.load(std::memory_order_relaxed)); });
+
+    for (int rt = 0; rt < 2; rt++)
+    {
+        logger::Logger log(logger::LOG_WARN);
+        JitterCtx ctx;
+        AudioHandler ah(&log, (uint32_t)Analyzer::SAMPLE_FREQ, 2, AudioHandler::FormatF32, AudioHandler::FormatF32,
+                        (uint32_t)Analyzer::ANALYZE_INTERVAL, AudioHandler::BackendNull);
+        if (rt)
+        {
+            ah.setThreadPriority(AudioHandler::PriorityRealtime, cpus, cpus);
+            if (!ThreadTuning::LockMemory())
+                printf("memory lock refused\n");
+        }
+        ah.attachFrameDataCb(jitterCb, &ctx);
+        ah.attachNotificationCb(AudioHandler::EventStop, stopCb, &ctx.stops);
+        ah.capture();
+        std::this_thread::sleep_for(std::chrono::seconds(seconds));
+        ah.stop();
+        wait_stops(ctx.stops, 1);
+
+        printf("%s: %" PRIu64 " intervals, %.2f ms period, max deviation %.1f us, load %zu\n", rt ? "realtime" : "default",
+               ctx.count, Analyzer::ANALYZE_INTERVAL * 1e3 / Analyzer::SAMPLE_FREQ, ctx.max_us, load);
+        for (size_t i = 0; i < AudioHandler::LatencyBuckets; i++)
+            if (ctx.hist[i])
+                printf("  %s %8.0f us %10" PRIu64 " %7.3f%%\n", i == AudioHandler::LatencyBuckets - 1 ? ">=" : " <",
+                       (double)(1ull << (i == AudioHandler::LatencyBuckets - 1 ? i - 1 : i)), ctx.hist[i], 100.0 * ctx.hist[i] / ctx.count);
+        logger::Logger::Entry entry;
+        for (unsigned long long n = log.LastN() - log.Size() + 1; n <= log.LastN(); n++)
+            if (log.GetEntry(n, entry))
+                printf("  %s\n", entry.Msg);
+    }
+
+    spin = false;
+    for (auto &t : spinners)
+        t.join();
+}
+
+struct LatencyCtx
+{
+    Analyzer analyzer;
+    std::atomic<int> stalls{0};     // callbacks to come that stall, the device falls behind
+    uint64_t analyses = 0;
+    double sum_ms = 0.0;            // callback entry to the analysis done
+    double max_ms = 0.0;
+    std::atomic<uint64_t> stops{0};
+};
+
+// analysis on the audio thread, as the applications do, timed in the callbacks an analysis completes in
+static void latencyCb(AudioHandler::Format format, uint32_t channels, const void *pData, uint32_t frameCount, void *userData)
+{
+    (void)format;
+    LatencyCtx *ctx = (LatencyCtx*)userData;
+    auto entry = bench_clock::now();
+    if (ctx->stalls.load(std::memory_order_relaxed) > 0)
+    {
+        ctx->stalls--;
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+
+    size_t count = ctx->analyzer.get_total_analyze_cnt();
+    ctx->analyzer.addFrames(pData, Analyzer::InputF32, frameCount, channels); // opened as f32
+    if (count != ctx->analyzer.get_total_analyze_cnt())
+    {
+        double ms = std::chrono::duration<double, std::milli>(bench_clock::now() - entry).count();
+        ctx->analyses++;
+        ctx->sum_ms += ms;
+        ctx->max_ms = std::max(ctx->max_ms, ms);
+    }
+}
+
+static void print_latency(const char *name, const AudioHandler::LatencyStats &ls, const LatencyCtx &ctx)
+{
+    double avg = ctx.analyses ? ctx.sum_ms / ctx.analyses : 0.0;
+    printf("%s: %u x %u frames period, %.1f ms buffer, analysis %.2f ms, max %.2f, newest frame to analysis %.1f ms\n",
+           name, ls.periods, ls.periodFrames, ls.bufferMs, avg, ctx.max_ms, ls.bufferMs + avg);
+    printf("  %" PRIu64 " analyses, callback %.3f ms, max %.3f, %" PRIu64 " xruns\n", ctx.analyses, ls.callbackAvgMs, ls.callbackMaxMs, ls.xruns);
+}
+
+// capture analyzed on the audio thread, the device at the callback interval against the low latency one
+// of the given period; then the low latency device is made to fall behind twice, the tuner has to back off
+static int run_latency(unsigned seconds, uint32_t period)
+{
+    bool ok = true;
+    for (int ll = 0; ll < 2; ll++)
+    {
+        logger::Logger log(logger::LOG_WARN);
+        std::unique_ptr<LatencyCtx> ctx(new LatencyCtx());
+        AudioHandler ah(&log, (uint32_t)Analyzer::SAMPLE_FREQ, 2, AudioHandler::FormatF32, AudioHandler::FormatF32,
+                        (uint32_t)Analyzer::ANALYZE_INTERVAL, AudioHandler::BackendNull);
+        if (ll)
+            ah.setLowLatency(period);
+        ah.attachFrameDataCb(latencyCb, ctx.get());
+        ah.attachNotificationCb(AudioHandler::EventStop, stopCb, &ctx->stops);
+        ah.capture();
+        std::this_thread::sleep_for(std::chrono::seconds(seconds));
+
+        AudioHandler::LatencyStats ls;
+        while (!ah.getLatencyStats(ls))
+            std::this_thread::yield();
+        print_latency(ll ? "low latency" : "callback interval", ls, *ctx);
+
+        if (ll)
+        {
+            for (int i = 0; i < 2; i++)
+            {
+                ctx->stalls = 1;
+                std::this_thread::sleep_for(std::chrono::seconds(1));
+            }
+            std::this_thread::sleep_for(std::chrono::seconds(1)); // reopened by now
+            AudioHandler::LatencyStats backed;
+            while (!ah.getLatencyStats(backed))
+                std::this_thread::yield();
+            printf("  stalled twice: %" PRIu64 " xruns, period %u -> %u frames\n", backed.xruns - ls.xruns, ls.tunedPeriod, backed.tunedPeriod);
+            if (backed.tunedPeriod <= ls.tunedPeriod)
+            {
+                printf("FAILED: the tuner did not back off\n");
+                ok = false;
+            }
+        }
+        ah.stop();
+        wait_stops(ctx->stops, 1);
+
+        logger::Logger::Entry entry;
+        for (unsigned long long n = log.LastN() - log.Size() + 1; n <= log.LastN(); n++)
+            if (log.GetEntry(n, entry))
+                printf("  %s\n", entry.Msg);
+    }
+
+    return ok ? 0 : 1;
+}
+
+int main(int argc, char **argv)
+{
+    size_t max_devices = std::max(1u, std::thread::hardware_concurrency());
+    size_t load = 1;
+    unsigned seconds = 5;
+    size_t commands = 0;
+    size_t producers = 1;
+    size_t switches = 0;
+    const char *play_file = nullptr;
+    size_t stress = 0;
+    bool fanout = false;
+    bool jitter = false;
+    uint64_t cpus = 0;
+    size_t spinners = 0;
+    uint32_t ll_period = 0;
+    bool native = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-n") && i + 1 < argc)
+            max_devices = (size_t)std::max(1L, std::strtol(argv[++i], NULL, 0));
+        else if (!strcmp(argv[i], "-x") && i + 1 < argc)
+            load = (size_t)std::max(1L, std::strtol(argv[++i], NULL, 0));
+        else if (!strcmp(argv[i], "-t") && i + 1 < argc)
+            seconds = (unsigned)std::max(1L, std::strtol(argv[++i], NULL, 0));
+        else if (!strcmp(argv[i], "-c") && i + 1 < argc)
+            commands = (size_t)std::max(1L, std::strtol(argv[++i], NULL, 0));
+        else if (!strcmp(argv[i], "-p") && i + 1 < argc)
+            producers = (size_t)std::max(1L, std::strtol(argv[++i], NULL, 0));
+        else if (!strcmp(argv[i], "-s") && i + 1 < argc)
+            switches = (size_t)std::max(1L, std::strtol(argv[++i], NULL, 0));
+        else if (!strcmp(argv[i], "-w") && i + 1 < argc)
+            play_file = argv[++i];
+        else if (!strcmp(argv[i], "-r") && i + 1 < argc)
+            stress = (size_t)std::max(1L, std::strtol(argv[++i], NULL, 0));
+        else if (!strcmp(argv[i], "-f"))
+            fanout = true;
+        else if (!strcmp(argv[i], "-j"))
+            jitter = true;
+        else if (!strcmp(argv[i], "-b") && i + 1 < argc)
+            spinners = (size_t)std::max(0L, std::strtol(argv[++i], NULL, 0));
+        else if (!strcmp(argv[i], "-k") && i + 1 < argc && ThreadTuning::ParseCpuList(argv[i + 1], cpus))
+            i++;
+        else if (!strcmp(argv[i], "-l") && i + 1 < argc)
+            ll_period = (uint32_t)std::max(1L, std::strtol(argv[++i], NULL, 0));
+        else if (!strcmp(argv[i], "-a"))
+            native = true;
+        else
+        {
+            printf("Usage: %s [-n max_devices] [-x load] [-t seconds]\n", argv[0]);
+            printf("  captures from 1..max_devices null backend devices at once,\n");
+            printf("  each one analyzed by load analyzers on own worker thread\n");
+            printf("       %s -c commands [-p producers]\n", argv[0]);
+            printf("  command queue latency, throughput and coalescing\n");
+            printf("       %s -s switches\n", argv[0]);
+            printf("  capture, record and playback switch latency\n");
+            printf("       %s -w file [-t seconds]\n", argv[0]);
+            printf("  file playback I/O, memory mapped and decoded\n");
+            printf("       %s -r commands [-p producers]\n", argv[0]);
+            printf("  randomized command sequences, per command latency and missed callbacks\n");
+            printf("       %s -f [-t seconds]\n", argv[0]);
+            printf("  frame data fan-out to a threaded, a polled and a slow subscriber\n");
+            printf("       %s -j [-t seconds] [-b busy_threads] [-k cpu_list]\n", argv[0]);
+            printf("  callback interval jitter with the default and the realtime priority,\n");
+            printf("  memory locked and the audio threads pinned to cpu_list, e.g. 2-3\n");
+            printf("       %s -l period [-t seconds]\n", argv[0]);
+            printf("  analysis latency at the callback interval and at the low latency period,\n");
+            printf("  the period tuner backing off on xruns\n");
+            printf("       %s -a\n", argv[0]);
+            printf("  recording after a capture with the native channel count\n");
+            return -1;
+        }
+    }
+
+    if (commands)
+    {
+        run_commands(producers, commands);
+        return 0;
+    }
+    if (switches)
+    {
+        run_switches(switches);
+        return 0;
+    }
+    if (stress)
+        return run_stress(producers, stress);
+    if (fanout)
+        return run_fanout(seconds);
+    if (ll_period)
+        return run_latency(seconds, ll_period);
+    if (native)
+        return run_native();
+    if (jitter)
+    {
+        run_jitter(seconds, spinners, cpus);
+        return 0;
+    }
+    if (play_file)
+    {
+        run_playback(play_file, seconds);
+        return 0;
+    }
+
+    double single = 0.0;
+    for (size_t n = 1; n <= max_devices; n++)
+    {
+        double total = run_group(n, load, seconds);
+        if (n == 1)
+            single = total;
+        else if (single > 0.0)
+            printf("  scaling %.2f of linear\n", total / single / n);
+    }
+
+    return 0;
+}
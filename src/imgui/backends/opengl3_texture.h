@@ -0,0 +1,49 @@
+#pragma once
+
+// Dynamic RGBA8 textures of the OpenGL backends, GL 1.1 calls only, the GL headers go first.
+// Kept apart from the backends so the spectrogram texture path can be checked offscreen, see spectest.cpp.
+
+#include <stdint.h>
+#include <vector>
+
+// returns 0 on failure, initial content is transparent black
+static inline GLuint GL3CreateTexture(int width, int height)
+{
+    GLint last_texture;
+    glGetIntegerv(GL_TEXTURE_BINDING_2D, &last_texture);
+    GLuint texture = 0;
+    glGenTextures(1, &texture);
+    if (!texture)
+        return 0;
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    std::vector<uint32_t> pixels((size_t)width * height, 0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+    glBindTexture(GL_TEXTURE_2D, last_texture);
+    if (glGetError() != GL_NO_ERROR)
+    {
+        glDeleteTextures(1, &texture);
+        return 0;
+    }
+    return texture;
+}
+
+// uploads a tightly packed rect of pixels
+static inline void GL3UpdateTexture(GLuint texture, int x, int y, int width, int height, const void* pixels)
+{
+    GLint last_texture;
+    glGetIntegerv(GL_TEXTURE_BINDING_2D, &last_texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+    glBindTexture(GL_TEXTURE_2D, last_texture);
+}
+
+static inline void GL3DestroyTexture(GLuint texture)
+{
+    glDeleteTextures(1, &texture);
+}
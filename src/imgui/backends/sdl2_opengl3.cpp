@@ -22,13 +22,18 @@
 #ifdef __EMSCRIPTEN__
 #include "../libs/emscripten/emscripten_mainloop_stub.h"
 #endif
+#include <atomic>
 
 #define IMGUI_BACKEND
 #include "imgui_local.h"
+#include "opengl3_texture.h"
 
 // Data
 static SDL_Window*              g_Window = nullptr;
 static ImGui::AppDragAndDropCb  g_DropCb = nullptr;
+static Uint32                   g_WakeupEvent = 0;     // SysWakeup() user event type, 0 if not registered
+static int                      g_BusyFrames = 0;      // frames to render without waiting after input
+static std::atomic<bool>        g_FrameRequested(false); // SysRequestFrame() since the last wait
 
        ImRect                   ImGui::SysWndPos  = ImRect(100, 100, 1280, 800);
        ImRect                   ImGui::SysWndMinMax  = ImRect(0, 0, 0, 0);
@@ -38,6 +43,24 @@ static ImGui::AppDragAndDropCb  g_DropCb = nullptr;
        float                    ImGui::SysWndScaling = 1.0f;
        bool                     ImGui::AppExit = false;
        bool                     ImGui::AppReconfigure = false;
+       double                   ImGui::SysWaitTimeout = 0.0;
+       double                   ImGui::SysRequestPoll = 0.0;
+
+// waits for an event up to SysWaitTimeout, in SysRequestPoll slices while frame requests are expected,
+// SysRequestFrame() can't push an event
+static bool WaitEvent(SDL_Event* event)
+{
+    double wait = ImGui::SysWaitTimeout;
+    double slice = ImGui::SysRequestPoll > 0.0 && ImGui::SysRequestPoll < wait ? ImGui::SysRequestPoll : wait;
+    for (;;)
+    {
+        if (SDL_WaitEventTimeout(event, (Sint32)(slice * 1000.0 + 0.5)))
+            return true;
+        wait -= slice;
+        if (wait <= 0.0 || g_FrameRequested.exchange(false, std::memory_order_relaxed))
+            return false;
+    }
+}
 
 // Main code
 int main(int argc, char* argv[])
@@ -52,6 +75,9 @@ int main(int argc, char* argv[])
         printf("Error: %s\n", SDL_GetError());
         return -1;
     }
+    g_WakeupEvent = SDL_RegisterEvents(1);
+    if (g_WakeupEvent == (Uint32)-1)
+        g_WakeupEvent = 0;
 
     // Decide GL+GLSL versions
 #if defined(IMGUI_IMPL_OPENGL_ES2)
@@ -170,8 +196,17 @@ int main(int argc, char* argv[])
         // - When io.WantCaptureKeyboard is true, do not dispatch keyboard input data to your main application, or clear/overwrite your copy of the keyboard data.
         // Generally you may always pass all inputs to dear imgui, and hide them from your application based on those two flags.
         SDL_Event event;
-        while (SDL_PollEvent(&event))
+        // block until an event, a wakeup, a frame request or the app timeout unless there is something to animate
+        bool pending = (g_BusyFrames > 0 || ImGui::SysWaitTimeout <= 0.0 || g_FrameRequested.exchange(false, std::memory_order_relaxed))
+                     ? SDL_PollEvent(&event)
+                     : WaitEvent(&event);
+        if (g_BusyFrames > 0)
+            g_BusyFrames--;
+        for (; pending; pending = SDL_PollEvent(&event))
         {
+            if (g_WakeupEvent && event.type == g_WakeupEvent)
+                continue;
+            g_BusyFrames = 3; // give ImGui a few frames to settle hover and active states
             ImGui_ImplSDL2_ProcessEvent(&event);
             if (event.type == SDL_QUIT)
                 ImGui::AppExit = true;
@@ -340,8 +375,39 @@ void ImGui::SysAcceptFiles(AppDragAndDropCb cb)
     SDL_EventState(SDL_DROPFILE, SDL_ENABLE);
 }
 
+void ImGui::SysWakeup()
+{
+    if (!g_WakeupEvent)
+        return;
+    SDL_Event event;
+    SDL_zero(event);
+    event.type = g_WakeupEvent;
+    SDL_PushEvent(&event);
+}
+
+void ImGui::SysRequestFrame()
+{
+    g_FrameRequested.store(true, std::memory_order_relaxed);
+}
+
 void ImGui::SysRejectFiles()
 {
     SDL_EventState(SDL_DROPFILE, SDL_DISABLE);
     g_DropCb = nullptr;
 }
+
+// dynamic textures
+ImTextureID ImGui::SysCreateTexture(int width, int height)
+{
+    return (ImTextureID)(intptr_t)GL3CreateTexture(width, height);
+}
+
+void ImGui::SysUpdateTexture(ImTextureID texture, int x, int y, int width, int height, const void* pixels)
+{
+    GL3UpdateTexture((GLuint)(intptr_t)texture, x, y, width, height, pixels);
+}
+
+void ImGui::SysDestroyTexture(ImTextureID texture)
+{
+    GL3DestroyTexture((GLuint)(intptr_t)texture);
+}
@@ -18,6 +18,7 @@
 #include "imgui_impl_vulkan.h"
 #include <stdio.h>          // printf, fprintf
 #include <stdlib.h>         // abort
+#include <string.h>         // memcpy
 #include <SDL3/SDL.h>
 #include <SDL3/SDL_vulkan.h>
 
@@ -36,6 +37,7 @@
 #ifdef _DEBUG
 #define APP_USE_VULKAN_DEBUG_REPORT
 #endif
+#include <atomic>
 
 #define IMGUI_BACKEND
 #include "imgui_local.h"
@@ -58,6 +60,9 @@ static ImGui_ImplVulkanH_Window g_MainWindowData;
 static uint32_t                 g_MinImageCount = 2;
 static bool                     g_SwapChainRebuild = false;
 static ImGui::AppDragAndDropCb  g_DropCb = nullptr;
+static Uint32                   g_WakeupEvent = 0;     // SysWakeup() user event type, 0 if not registered
+static int                      g_BusyFrames = 0;      // frames to render without waiting after input
+static std::atomic<bool>        g_FrameRequested(false); // SysRequestFrame() since the last wait
 
        ImRect                   ImGui::SysWndPos  = ImRect(100, 100, 1280, 800);
        ImRect                   ImGui::SysWndMinMax  = ImRect(0, 0, 0, 0);
@@ -67,6 +72,47 @@ static ImGui::AppDragAndDropCb  g_DropCb = nullptr;
        float                    ImGui::SysWndScaling = 1.0f;
        bool                     ImGui::AppExit = false;
        bool                     ImGui::AppReconfigure = false;
+       double                   ImGui::SysWaitTimeout = 0.0;
+       double                   ImGui::SysRequestPoll = 0.0;
+
+// waits for an event up to SysWaitTimeout, in SysRequestPoll slices while frame requests are expected,
+// SysRequestFrame() can't push an event
+static bool WaitEvent(SDL_Event* event)
+{
+    double wait = ImGui::SysWaitTimeout;
+    double slice = ImGui::SysRequestPoll > 0.0 && ImGui::SysRequestPoll < wait ? ImGui::SysRequestPoll : wait;
+    for (;;)
+    {
+        if (SDL_WaitEventTimeout(event, (Sint32)(slice * 1000.0 + 0.5)))
+            return true;
+        wait -= slice;
+        if (wait <= 0.0 || g_FrameRequested.exchange(false, std::memory_order_relaxed))
+            return false;
+    }
+}
+
+// Dynamic textures, see ImGui::SysCreateTexture()
+// pixels are kept in host memory, the dirty rect is copied into the image through the staging area
+// of the current frame before the render pass, so frames in flight never see a half written staging area
+struct SysTexture
+{
+    int                 Width = 0;
+    int                 Height = 0;
+    ImVector<ImU32>     Pixels;                         // RGBA8 host copy
+    int                 DirtyX0 = 0, DirtyY0 = 0;       // pending upload rect, empty if X0 >= X1
+    int                 DirtyX1 = 0, DirtyY1 = 0;
+    bool                Initialized = false;            // image left the undefined layout
+    VkImage             Image = VK_NULL_HANDLE;
+    VkDeviceMemory      ImageMemory = VK_NULL_HANDLE;
+    VkImageView         ImageView = VK_NULL_HANDLE;
+    VkSampler           Sampler = VK_NULL_HANDLE;
+    VkBuffer            Staging = VK_NULL_HANDLE;       // StagingFrames areas of the image size
+    VkDeviceMemory      StagingMemory = VK_NULL_HANDLE;
+    void*               StagingMap = nullptr;
+    uint32_t            StagingFrames = 0;
+    VkDescriptorSet     DescriptorSet = VK_NULL_HANDLE; // ImTextureID
+};
+static ImVector<SysTexture*>    g_Textures;
 
 static void check_vk_result(VkResult err)
 {
@@ -202,7 +248,7 @@ static void SetupVulkan(ImVector<const char*> instance_extensions)
     {
         VkDescriptorPoolSize pool_sizes[] =
         {
-            { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, IMGUI_IMPL_VULKAN_MINIMUM_IMAGE_SAMPLER_POOL_SIZE },
+            { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, IMGUI_IMPL_VULKAN_MINIMUM_IMAGE_SAMPLER_POOL_SIZE + 4 }, // + SysCreateTexture()
         };
         VkDescriptorPoolCreateInfo pool_info = {};
         pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
@@ -270,6 +316,89 @@ static void CleanupVulkanWindow()
     ImGui_ImplVulkanH_DestroyWindow(g_Instance, g_Device, &g_MainWindowData, g_Allocator);
 }
 
+static uint32_t FindMemoryType(VkMemoryPropertyFlags properties, uint32_t type_bits)
+{
+    VkPhysicalDeviceMemoryProperties prop;
+    vkGetPhysicalDeviceMemoryProperties(g_PhysicalDevice, &prop);
+    for (uint32_t i = 0; i < prop.memoryTypeCount; i++)
+        if ((prop.memoryTypes[i].propertyFlags & properties) == properties && type_bits & (1u << i))
+            return i;
+    return 0xFFFFFFFF;
+}
+
+static void DestroyTexture(SysTexture* tex)
+{
+    if (tex->DescriptorSet)
+        ImGui_ImplVulkan_RemoveTexture(tex->DescriptorSet);
+    if (tex->StagingMap)
+        vkUnmapMemory(g_Device, tex->StagingMemory);
+    vkDestroyBuffer(g_Device, tex->Staging, g_Allocator);
+    vkFreeMemory(g_Device, tex->StagingMemory, g_Allocator);
+    vkDestroySampler(g_Device, tex->Sampler, g_Allocator);
+    vkDestroyImageView(g_Device, tex->ImageView, g_Allocator);
+    vkDestroyImage(g_Device, tex->Image, g_Allocator);
+    vkFreeMemory(g_Device, tex->ImageMemory, g_Allocator);
+    IM_DELETE(tex);
+}
+
+// records the pending texture uploads, called before the render pass once the frame fence is signaled
+static void UploadTextures(VkCommandBuffer command_buffer, uint32_t frame)
+{
+    for (SysTexture* tex : g_Textures)
+    {
+        if (tex->DirtyX0 >= tex->DirtyX1 || tex->DirtyY0 >= tex->DirtyY1)
+            continue;
+        uint32_t area = frame;
+        if (area >= tex->StagingFrames)
+        {
+            // more swapchain images than staging areas after a swapchain rebuild, take the first one when it's free
+            vkQueueWaitIdle(g_Queue);
+            area = 0;
+        }
+
+        // copy the dirty rect rows into the staging area, tightly packed
+        int width = tex->DirtyX1 - tex->DirtyX0;
+        int height = tex->DirtyY1 - tex->DirtyY0;
+        VkDeviceSize offset = (VkDeviceSize)area * tex->Width * tex->Height * 4;
+        ImU32* dst = (ImU32*)((char*)tex->StagingMap + offset);
+        for (int y = 0; y < height; y++)
+            memcpy(dst + y * width, &tex->Pixels[(tex->DirtyY0 + y) * tex->Width + tex->DirtyX0], width * 4);
+
+        VkImageMemoryBarrier barrier = {};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.srcAccessMask = tex->Initialized ? VK_ACCESS_SHADER_READ_BIT : 0;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.oldLayout = tex->Initialized ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_UNDEFINED;
+        barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = tex->Image;
+        barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        barrier.subresourceRange.levelCount = 1;
+        barrier.subresourceRange.layerCount = 1;
+        vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+        VkBufferImageCopy region = {};
+        region.bufferOffset = offset;
+        region.bufferRowLength = width;
+        region.bufferImageHeight = height;
+        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.imageSubresource.layerCount = 1;
+        region.imageOffset = { tex->DirtyX0, tex->DirtyY0, 0 };
+        region.imageExtent = { (uint32_t)width, (uint32_t)height, 1 };
+        vkCmdCopyBufferToImage(command_buffer, tex->Staging, tex->Image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+        tex->Initialized = true;
+        tex->DirtyX0 = tex->DirtyX1 = tex->DirtyY0 = tex->DirtyY1 = 0;
+    }
+}
+
 static void FrameRender(ImGui_ImplVulkanH_Window* wd, ImDrawData* draw_data)
 {
     VkSemaphore image_acquired_semaphore  = wd->FrameSemaphores[wd->SemaphoreIndex].ImageAcquiredSemaphore;
@@ -299,6 +428,7 @@ static void FrameRender(ImGui_ImplVulkanH_Window* wd, ImDrawData* draw_data)
         err = vkBeginCommandBuffer(fd->CommandBuffer, &info);
         check_vk_result(err);
     }
+    UploadTextures(fd->CommandBuffer, wd->FrameIndex);
     {
         VkRenderPassBeginInfo info = {};
         info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
@@ -370,6 +500,7 @@ int main(int argc, char* argv[])
         printf("Error: SDL_Init(): %s\n", SDL_GetError());
         return -1;
     }
+    g_WakeupEvent = SDL_RegisterEvents(1);
 
     // Create window with Vulkan graphics context
     Uint32 window_flags = SDL_WINDOW_VULKAN | SDL_WINDOW_RESIZABLE | SDL_WINDOW_HIGH_PIXEL_DENSITY
@@ -466,8 +597,17 @@ int main(int argc, char* argv[])
         // - When io.WantCaptureKeyboard is true, do not dispatch keyboard input data to your main application, or clear/overwrite your copy of the keyboard data.
         // Generally you may always pass all inputs to dear imgui, and hide them from your application based on those two flags.
         SDL_Event event;
-        while (SDL_PollEvent(&event))
+        // block until an event, a wakeup, a frame request or the app timeout unless there is something to animate
+        bool pending = (g_BusyFrames > 0 || ImGui::SysWaitTimeout <= 0.0 || g_FrameRequested.exchange(false, std::memory_order_relaxed))
+                     ? SDL_PollEvent(&event)
+                     : WaitEvent(&event);
+        if (g_BusyFrames > 0)
+            g_BusyFrames--;
+        for (; pending; pending = SDL_PollEvent(&event))
         {
+            if (g_WakeupEvent && event.type == g_WakeupEvent)
+                continue;
+            g_BusyFrames = 3; // give ImGui a few frames to settle hover and active states
             ImGui_ImplSDL3_ProcessEvent(&event);
             if (event.type == SDL_EVENT_QUIT)
                 ImGui::AppExit = true;
@@ -586,6 +726,9 @@ int main(int argc, char* argv[])
     // Cleanup
     err = vkDeviceWaitIdle(g_Device);
     check_vk_result(err);
+    for (SysTexture* tex : g_Textures) // left by the app
+        DestroyTexture(tex);
+    g_Textures.clear();
     ImGui_ImplVulkan_Shutdown();
     ImGui_ImplSDL3_Shutdown();
     ImGui::DestroyContext();
@@ -645,8 +788,160 @@ void ImGui::SysAcceptFiles(AppDragAndDropCb cb)
     SDL_SetEventEnabled(SDL_EVENT_DROP_FILE, true);
 }
 
+void ImGui::SysWakeup()
+{
+    if (!g_WakeupEvent)
+        return;
+    SDL_Event event;
+    SDL_zero(event);
+    event.type = g_WakeupEvent;
+    SDL_PushEvent(&event);
+}
+
+void ImGui::SysRequestFrame()
+{
+    g_FrameRequested.store(true, std::memory_order_relaxed);
+}
+
 void ImGui::SysRejectFiles()
 {
     SDL_SetEventEnabled(SDL_EVENT_DROP_FILE, false);
     g_DropCb = nullptr;
 }
+
+// dynamic textures
+ImTextureID ImGui::SysCreateTexture(int width, int height)
+{
+    SysTexture* tex = IM_NEW(SysTexture)();
+    tex->Width = width;
+    tex->Height = height;
+    tex->Pixels.resize(width * height, 0);
+    tex->DirtyX1 = width; // the whole image goes with the first upload, it leaves the undefined layout then
+    tex->DirtyY1 = height;
+    tex->StagingFrames = g_MainWindowData.ImageCount ? g_MainWindowData.ImageCount : 1;
+
+    VkResult err;
+    {
+        VkImageCreateInfo info = {};
+        info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        info.imageType = VK_IMAGE_TYPE_2D;
+        info.format = VK_FORMAT_R8G8B8A8_UNORM;
+        info.extent = { (uint32_t)width, (uint32_t)height, 1 };
+        info.mipLevels = 1;
+        info.arrayLayers = 1;
+        info.samples = VK_SAMPLE_COUNT_1_BIT;
+        info.tiling = VK_IMAGE_TILING_OPTIMAL;
+        info.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+        info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        err = vkCreateImage(g_Device, &info, g_Allocator, &tex->Image);
+        if (err == VK_SUCCESS)
+        {
+            VkMemoryRequirements req;
+            vkGetImageMemoryRequirements(g_Device, tex->Image, &req);
+            VkMemoryAllocateInfo alloc_info = {};
+            alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+            alloc_info.allocationSize = req.size;
+            alloc_info.memoryTypeIndex = FindMemoryType(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, req.memoryTypeBits);
+            err = vkAllocateMemory(g_Device, &alloc_info, g_Allocator, &tex->ImageMemory);
+        }
+        if (err == VK_SUCCESS)
+            err = vkBindImageMemory(g_Device, tex->Image, tex->ImageMemory, 0);
+    }
+    if (err == VK_SUCCESS)
+    {
+        VkImageViewCreateInfo info = {};
+        info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        info.image = tex->Image;
+        info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        info.format = VK_FORMAT_R8G8B8A8_UNORM;
+        info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        info.subresourceRange.levelCount = 1;
+        info.subresourceRange.layerCount = 1;
+        err = vkCreateImageView(g_Device, &info, g_Allocator, &tex->ImageView);
+    }
+    if (err == VK_SUCCESS)
+    {
+        VkSamplerCreateInfo info = {};
+        info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+        info.magFilter = VK_FILTER_LINEAR;
+        info.minFilter = VK_FILTER_LINEAR;
+        info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+        info.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        info.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        info.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        info.maxAnisotropy = 1.0f;
+        err = vkCreateSampler(g_Device, &info, g_Allocator, &tex->Sampler);
+    }
+    if (err == VK_SUCCESS)
+    {
+        VkBufferCreateInfo info = {};
+        info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        info.size = (VkDeviceSize)tex->StagingFrames * width * height * 4;
+        info.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+        info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        err = vkCreateBuffer(g_Device, &info, g_Allocator, &tex->Staging);
+        if (err == VK_SUCCESS)
+        {
+            VkMemoryRequirements req;
+            vkGetBufferMemoryRequirements(g_Device, tex->Staging, &req);
+            VkMemoryAllocateInfo alloc_info = {};
+            alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+            alloc_info.allocationSize = req.size;
+            alloc_info.memoryTypeIndex = FindMemoryType(VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, req.memoryTypeBits);
+            err = vkAllocateMemory(g_Device, &alloc_info, g_Allocator, &tex->StagingMemory);
+        }
+        if (err == VK_SUCCESS)
+            err = vkBindBufferMemory(g_Device, tex->Staging, tex->StagingMemory, 0);
+        if (err == VK_SUCCESS)
+            err = vkMapMemory(g_Device, tex->StagingMemory, 0, VK_WHOLE_SIZE, 0, &tex->StagingMap);
+    }
+    if (err == VK_SUCCESS)
+        tex->DescriptorSet = ImGui_ImplVulkan_AddTexture(tex->Sampler, tex->ImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    if (err != VK_SUCCESS || tex->DescriptorSet == VK_NULL_HANDLE)
+    {
+        fprintf(stderr, "[vulkan] Error: failed to create texture, VkResult = %d\n", err);
+        DestroyTexture(tex);
+        return (ImTextureID)0;
+    }
+
+    g_Textures.push_back(tex);
+    return (ImTextureID)tex->DescriptorSet;
+}
+
+void ImGui::SysUpdateTexture(ImTextureID texture, int x, int y, int width, int height, const void* pixels)
+{
+    for (SysTexture* tex : g_Textures)
+    {
+        if ((ImTextureID)tex->DescriptorSet != texture)
+            continue;
+        for (int row = 0; row < height; row++)
+            memcpy(&tex->Pixels[(y + row) * tex->Width + x], (const ImU32*)pixels + row * width, width * 4);
+        if (tex->DirtyX0 >= tex->DirtyX1 || tex->DirtyY0 >= tex->DirtyY1)
+        {
+            tex->DirtyX0 = x; tex->DirtyY0 = y;
+            tex->DirtyX1 = x + width; tex->DirtyY1 = y + height;
+        }
+        else
+        {
+            if (x < tex->DirtyX0) tex->DirtyX0 = x;
+            if (y < tex->DirtyY0) tex->DirtyY0 = y;
+            if (x + width > tex->DirtyX1) tex->DirtyX1 = x + width;
+            if (y + height > tex->DirtyY1) tex->DirtyY1 = y + height;
+        }
+        return;
+    }
+}
+
+void ImGui::SysDestroyTexture(ImTextureID texture)
+{
+    for (int n = 0; n < g_Textures.Size; n++)
+    {
+        if ((ImTextureID)g_Textures[n]->DescriptorSet != texture)
+            continue;
+        vkDeviceWaitIdle(g_Device); // frames in flight may still sample it
+        DestroyTexture(g_Textures[n]);
+        g_Textures.erase(g_Textures.Data + n);
+        return;
+    }
+}
@@ -14,6 +14,7 @@
 #include <tchar.h>
 #include <memory>
 #include <errno.h>
+#include <atomic>
 
 #define IMGUI_BACKEND
 #include "imgui_local.h"
@@ -31,6 +32,8 @@ static ID3D11RenderTargetView*  g_mainRenderTargetView = nullptr;
 static HWND                     g_Window = nullptr;
 static UINT_PTR                 g_idGlobalRefreshTimer = 0;
 static ImGui::AppDragAndDropCb  g_DropCb = nullptr;
+static int                      g_BusyFrames = 0;      // frames to render without waiting after input
+static std::atomic<bool>        g_FrameRequested(false); // SysRequestFrame() since the last wait
 
        ImRect                   ImGui::SysWndPos  = ImRect(100, 100, 1280, 800);
        ImRect                   ImGui::SysWndMinMax  = ImRect(0, 0, 0, 0);
@@ -40,6 +43,24 @@ static ImGui::AppDragAndDropCb  g_DropCb = nullptr;
        float                    ImGui::SysWndScaling = 1.0f;
        bool                     ImGui::AppExit = false;
        bool                     ImGui::AppReconfigure = false;
+       double                   ImGui::SysWaitTimeout = 0.0;
+       double                   ImGui::SysRequestPoll = 0.0;
+
+// waits for a message up to SysWaitTimeout, in SysRequestPoll slices while frame requests are expected,
+// SysRequestFrame() can't post a message
+static void WaitInput()
+{
+    double wait = ImGui::SysWaitTimeout;
+    double slice = ImGui::SysRequestPoll > 0.0 && ImGui::SysRequestPoll < wait ? ImGui::SysRequestPoll : wait;
+    for (;;)
+    {
+        if (::MsgWaitForMultipleObjectsEx(0, nullptr, (DWORD)(slice * 1000.0 + 0.5), QS_ALLINPUT, MWMO_INPUTAVAILABLE) != WAIT_TIMEOUT)
+            return;
+        wait -= slice;
+        if (wait <= 0.0 || g_FrameRequested.exchange(false, std::memory_order_relaxed))
+            return;
+    }
+}
 
 // system function pointers
 static BOOL (WINAPI * ptrEnableNonClientDpiScaling) (HWND) = nullptr;
@@ -178,8 +199,15 @@ int wmain(int argc, wchar_t** wargv)
         // Poll and handle messages (inputs, window resize, etc.)
         // See the WndProc() function below for our to dispatch events to the Win32 backend.
         MSG msg;
+        // block until a message, a wakeup, a frame request or the app timeout unless there is something to animate
+        if (g_BusyFrames > 0)
+            g_BusyFrames--;
+        else if (ImGui::SysWaitTimeout > 0.0 && !g_FrameRequested.exchange(false, std::memory_order_relaxed))
+            WaitInput();
         while (::PeekMessage(&msg, nullptr, 0U, 0U, PM_REMOVE))
         {
+            if (msg.message != WM_NULL)
+                g_BusyFrames = 3; // give ImGui a few frames to settle hover and active states
             ::TranslateMessage(&msg);
             ::DispatchMessage(&msg);
             if (msg.message == WM_QUIT)
@@ -615,8 +643,68 @@ void ImGui::SysAcceptFiles(AppDragAndDropCb cb)
     DragAcceptFiles(g_Window, TRUE);
 }
 
+void ImGui::SysWakeup()
+{
+    if (g_Window)
+        ::PostMessage(g_Window, WM_NULL, 0, 0);
+}
+
+void ImGui::SysRequestFrame()
+{
+    g_FrameRequested.store(true, std::memory_order_relaxed);
+}
+
 void ImGui::SysRejectFiles()
 {
     DragAcceptFiles(g_Window, FALSE);
     g_DropCb = nullptr;
 }
+
+// dynamic textures
+ImTextureID ImGui::SysCreateTexture(int width, int height)
+{
+    ImVector<ImU32> pixels;
+    pixels.resize(width * height, 0);
+
+    D3D11_TEXTURE2D_DESC desc = {};
+    desc.Width = width;
+    desc.Height = height;
+    desc.MipLevels = 1;
+    desc.ArraySize = 1;
+    desc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+    desc.SampleDesc.Count = 1;
+    desc.Usage = D3D11_USAGE_DEFAULT;
+    desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+    D3D11_SUBRESOURCE_DATA data = {};
+    data.pSysMem = pixels.Data;
+    data.SysMemPitch = width * 4;
+    ID3D11Texture2D* texture = nullptr;
+    if (g_pd3dDevice->CreateTexture2D(&desc, &data, &texture) != S_OK)
+        return (ImTextureID)0;
+
+    D3D11_SHADER_RESOURCE_VIEW_DESC srv_desc = {};
+    srv_desc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+    srv_desc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
+    srv_desc.Texture2D.MipLevels = 1;
+    ID3D11ShaderResourceView* srv = nullptr;
+    HRESULT hr = g_pd3dDevice->CreateShaderResourceView(texture, &srv_desc, &srv);
+    texture->Release(); // the view keeps it
+    if (hr != S_OK)
+        return (ImTextureID)0;
+    return (ImTextureID)srv;
+}
+
+void ImGui::SysUpdateTexture(ImTextureID texture, int x, int y, int width, int height, const void* pixels)
+{
+    ID3D11Resource* resource = nullptr;
+    ((ID3D11ShaderResourceView*)texture)->GetResource(&resource);
+    D3D11_BOX box = { (UINT)x, (UINT)y, 0, (UINT)(x + width), (UINT)(y + height), 1 };
+    g_pd3dDeviceContext->UpdateSubresource(resource, 0, &box, pixels, width * 4, 0);
+    resource->Release();
+}
+
+void ImGui::SysDestroyTexture(ImTextureID texture)
+{
+    if (texture)
+        ((ID3D11ShaderResourceView*)texture)->Release();
+}
@@ -27,6 +27,10 @@ namespace ImGui
     extern bool AppExit;                             // exit signal to backend
     extern bool AppReconfigure;                      // request backend to call AppConfig()
                                                      // backend can also set this flag on system configuration events
+    extern double SysWaitTimeout;                    // seconds the backend may wait for input before the next frame,
+                                                     // 0 renders continuously, set by the app every frame
+    extern double SysRequestPoll;                    // seconds between the SysRequestFrame() checks while waiting,
+                                                     // 0 if no requests are expected, set by the app every frame
 
     // App functions
     int  AppInit(int argc, char const *const* argv); // called once at the start of main() function, non-zero return aborts the app
@@ -50,4 +54,13 @@ namespace ImGui
                                                      // ShellExecuteA and so requires UTF8 support shenanigans (1903 + manifest)
     void SysAcceptFiles(AppDragAndDropCb cb);        // start accepting drag and drop files
     void SysRejectFiles();                           // stop accepting drag and drop files
+    void SysWakeup();                                // interrupt the backend wait to render a new frame,
+                                                     // can be called from any thread
+    void SysRequestFrame();                          // lock-free SysWakeup() for the real-time threads,
+                                                     // noticed within SysRequestPoll
+    // dynamic RGBA8 textures for the app drawing, main thread only
+    ImTextureID SysCreateTexture(int width, int height); // returns 0 on failure, initial content is transparent black
+    void SysUpdateTexture(ImTextureID texture, int x, int y, int width, int height, const void* pixels);
+                                                     // uploads a tightly packed rect of pixels
+    void SysDestroyTexture(ImTextureID texture);     // releases the texture, call before AppDestroy() returns
 }
@@ -73,6 +73,11 @@ Index of this file:
 // pitch history buffer capacity, seconds
 #define ANALYZER_ANALYZE_SPAN 60
 #include "Analyzer.hpp"
+#include "WorkerPool.hpp"
+#include "ThreadTuning.hpp"
+#include "PitchStream.hpp"
+#include "LogSink.hpp"
+#include "TextureRing.hpp"
 #include "AudioHandler.h"
 #include "fonts.h"
 #include <IconsFontAwesome6.h>
@@ -84,6 +89,7 @@ Index of this file:
 #include <algorithm>        // min, max
 #include <vector>
 #include <limits>
+#include <chrono>
 #if !defined(_MSC_VER) || _MSC_VER >= 1800
 #include <inttypes.h>       // PRId64/PRIu64, not avail in some MinGW headers.
 #endif
@@ -97,6 +103,7 @@ Index of this file:
 
 #define IMGUI_APP
 #include "imgui_local.h"
+#include "FontAtlasCache.hpp"
 
 #define _UNUSED_ [[maybe_unused]]
 
@@ -176,11 +183,27 @@ public:
 
     bool on_hold() { return onhold; }
 
+    // after Analyzer::set_analyze_freq(), call with the audio stopped and the mutex locked
+    void resize()
+    {
+        Analyzer::resize();
+        hold_pitch_buf.reset(new float[PITCH_BUF_SIZE]);
+        hold_cq_data.reset();
+        unhold_locked();
+    }
+
     void hold()
     {
         std::unique_lock<std::mutex> lock(mtx);
         std::copy(fft_data.get(), fft_data.get() + FFTSIZE, hold_fft_data.get());
         std::copy(pitch_buf.get(), pitch_buf.get() + PITCH_BUF_SIZE, hold_pitch_buf.get());
+        if (cq_data)
+        {
+            hold_cq_data.reset(new float[cq->size() * PITCH_BUF_SIZE]);
+            std::copy(cq_data.get(), cq_data.get() + cq->size() * PITCH_BUF_SIZE, hold_cq_data.get());
+        }
+        else
+            hold_cq_data.reset();
         hold_total_analyze_cnt =  total_analyze_cnt;
         hold_peak_freq         =  peak_freq;
         hold_pitch_buf_pos     =  pitch_buf_pos;
@@ -196,6 +219,11 @@ public:
     void unhold()
     {
         std::unique_lock<std::mutex> lock(mtx);
+        unhold_locked();
+    }
+
+    void unhold_locked()
+    {
         fft_data_x          =  fft_data;
         pitch_buf_x         =  pitch_buf;
         total_analyze_cnt_x = &total_analyze_cnt;
@@ -219,6 +247,11 @@ public:
         return pitch_buf_x;
     }
 
+    std::shared_ptr<const float[]> get_cq_buf()
+    {
+        return onhold ? hold_cq_data : cq_data; // live buffer is replaced when the transform is toggled
+    }
+
     size_t get_pitch_buf_pos()
     {
         return *pitch_buf_pos_x;
@@ -240,10 +273,455 @@ protected:
     std::shared_ptr<const double[]> fft_data_x;
     std::shared_ptr<float[]> hold_pitch_buf;
     std::shared_ptr<const float[]> pitch_buf_x;
+    std::shared_ptr<float[]> hold_cq_data;
     size_t hold_pitch_buf_pos;
     const size_t *pitch_buf_pos_x;
 };
 
+// set of analyzers, one per capture channel, [0] analyzes the mono downmix unless per-channel mode is on
+// channels are analyzed in parallel on the worker pool, each worker picks its channel from the interleaved buffer
+// additional capture devices have own analyzers, guarded by own mutexes, fed from the device worker threads
+class AnalyzerGroup
+{
+public:
+    AnalyzerGroup(std::mutex &_mtx, size_t max_channels) :
+        mtx(_mtx),
+        per_channel(false),
+        gate(false),
+        active(1),
+        base_cnt(0),
+        pool(std::min<size_t>(max_channels, std::max(1u, std::thread::hardware_concurrency())) - 1)
+    {
+        for (size_t i = 0; i < max_channels; i++)
+            analyzers.emplace_back(new HoldingAnalyzer(_mtx));
+    }
+
+    HoldingAnalyzer& operator[](size_t ch) { return *analyzers[ch]; }
+
+    // channels being analyzed, call with the mutex locked
+    size_t size() { return active; }
+    size_t max_size() { return analyzers.size(); }
+
+    bool is_per_channel() { return per_channel; }
+
+    void set_per_channel(bool enable)
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (per_channel == enable)
+            return;
+        per_channel = enable;
+        active = 1;
+        for (auto &a : analyzers)
+            a->clearData();
+    }
+
+    // interleaved frames in the capture format, call with the mutex locked
+    void addFrames(const void *data, Analyzer::InputFormat format, size_t frames, size_t channels)
+    {
+        if (!per_channel || channels < 2)
+        {
+            // a single stream downmixed on the way in, the analyses due within the block go to the pool instead
+            analyzers[0]->addFrames(data, format, frames, channels, -1, &pool);
+            return;
+        }
+
+        channels = std::min(channels, analyzers.size());
+        if (active != channels)
+        {
+            // restart all channels in phase with the first one
+            size_t count = analyzers[0]->Analyzer::get_total_analyze_cnt();
+            for (size_t ch = 0; ch < channels; ch++)
+            {
+                analyzers[ch]->clearData();
+                if (ch >= active)
+                {
+                    analyzers[ch]->clearPitch();
+                    analyzers[ch]->set_total_analyze_cnt(count);
+                }
+            }
+            active = channels;
+        }
+        pool.run(channels, [&](size_t ch) { analyzers[ch]->addFrames(data, format, frames, channels, (int)ch); });
+    }
+
+    // capture group devices, add before the capture starts
+    void add_device()
+    {
+        devices.emplace_back(new Device());
+        devices.back()->analyzer.set_gate(gate);
+    }
+    size_t device_count() { return devices.size(); }
+    HoldingAnalyzer& device(size_t n) { return devices[n]->analyzer; }
+    std::mutex& device_mutex(size_t n) { return devices[n]->mtx; }
+
+    // interleaved frames of a capture group device, called from the device worker thread,
+    // timeline_pos is the main capture device position of the first frame
+    void addDeviceFrames(size_t n, const Analyzer::sample_t *data, size_t frames, size_t channels, uint64_t timeline_pos)
+    {
+        if (n >= devices.size())
+            return;
+        Device &dev = *devices[n];
+        std::lock_guard<std::mutex> lock(dev.mtx);
+        if (dev.resync)
+        {
+            // put the device in phase with the main analyzer
+            dev.analyzer.clearData();
+            dev.analyzer.set_total_analyze_cnt(base_cnt + timeline_pos / Analyzer::ANALYZE_INTERVAL);
+            dev.resync = false;
+        }
+        dev.analyzer.addFrames(data, Analyzer::InputF32, frames, channels);
+    }
+
+    // group wide operations
+    void clearData()
+    {
+        for (auto &a : analyzers)
+            a->clearData();
+        base_cnt = analyzers[0]->Analyzer::get_total_analyze_cnt(); // a new timeline starts here
+        for (auto &d : devices)
+        {
+            std::lock_guard<std::mutex> lock(d->mtx);
+            d->resync = true;
+        }
+    }
+
+    void hold()
+    {
+        for (auto &a : analyzers)
+            a->hold();
+        for (auto &d : devices)
+            d->analyzer.hold();
+    }
+
+    void unhold()
+    {
+        for (auto &a : analyzers)
+            a->unhold();
+        for (auto &d : devices)
+            d->analyzer.unhold();
+    }
+
+    bool on_hold() { return analyzers[0]->on_hold(); }
+
+    // after Analyzer::set_analyze_freq(), before the capture starts
+    void resize()
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        for (auto &a : analyzers)
+            a->resize();
+        base_cnt = 0;
+        for (auto &d : devices)
+        {
+            std::lock_guard<std::mutex> lock(d->mtx);
+            d->analyzer.resize();
+            d->resync = true;
+        }
+    }
+
+    // batch working sets of the main analyzer for callbacks of up to the given frames, before the capture starts
+    void prefault(size_t frames)
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        analyzers[0]->prefault(frames);
+    }
+
+    // realtime priority and pinning of the pool workers, before the capture starts, returns the workers that refused
+    unsigned tune_pool(bool realtime, uint64_t cpus)
+    {
+        std::atomic<unsigned> refused(0);
+        pool.each_thread([&] {
+            if ((realtime && !ThreadTuning::SetRealtime(ThreadTuning::WorkerPriority)) || !ThreadTuning::SetAffinity(cpus))
+                refused++;
+        });
+        return refused;
+    }
+
+    void set_threshold(double thres)
+    {
+        for (auto &a : analyzers)
+            a->set_threshold(thres);
+        for (auto &d : devices)
+        {
+            std::lock_guard<std::mutex> lock(d->mtx);
+            d->analyzer.set_threshold(thres);
+        }
+    }
+
+    // energy pre-gate, see Analyzer::set_gate()
+    void set_gate(bool enable)
+    {
+        gate = enable;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            for (auto &a : analyzers)
+                a->set_gate(enable);
+        }
+        for (auto &d : devices)
+        {
+            std::lock_guard<std::mutex> lock(d->mtx);
+            d->analyzer.set_gate(enable);
+        }
+    }
+
+    // frames of the main analyzer passed through the gate and skipped by it, the counts restart
+    void take_gate_stats(size_t &frames, size_t &skipped)
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        frames = analyzers[0]->get_gate_frames();
+        skipped = analyzers[0]->get_gated_cnt();
+        analyzers[0]->reset_gate_stats();
+    }
+
+    void set_total_analyze_cnt(size_t count)
+    {
+        base_cnt = count;
+        for (auto &a : analyzers)
+            a->set_total_analyze_cnt(count);
+        for (auto &d : devices)
+        {
+            std::lock_guard<std::mutex> lock(d->mtx);
+            d->resync = true;
+        }
+    }
+
+protected:
+    struct Device
+    {
+        Device() : analyzer(mtx), resync(true) {}
+        std::mutex mtx;
+        HoldingAnalyzer analyzer;
+        bool resync;
+    };
+
+    std::mutex &mtx;
+    bool per_channel;
+    bool gate;
+    size_t active;
+    size_t base_cnt;   // analyze count at the timeline start
+    std::vector<std::unique_ptr<HoldingAnalyzer>> analyzers;
+    std::vector<std::unique_ptr<Device>> devices;
+    WorkerPool pool;
+};
+
+// prebuilt draw list geometry, split into segments which are copied into the window draw list with an offset,
+// saves text layout and line tessellation for plot features that only move around
+class DrawCache
+{
+public:
+    // compares the inputs with the ones the geometry was built with and stores them, true if anything changed
+    template<typename... Args>
+    bool Update(const Args&... args)
+    {
+        std::string key;
+        (append(key, args), ...);
+        if (key == inputs)
+            return false;
+        inputs.swap(key);
+        return true;
+    }
+
+    void Invalidate() { inputs.clear(); }
+
+    // starts recording, segments are drawn into the returned list, should use the font atlas texture only
+    ImDrawList* Begin(const ImDrawList *parent)
+    {
+        if (!recorder)
+            recorder.reset(new ImDrawList(ImGui::GetDrawListSharedData()));
+        recorder->_ResetForNewFrame();
+        recorder->Flags = parent->Flags & ~ImDrawListFlags_AllowVtxOffset; // keep everything in a single command
+        recorder->PushClipRectFullScreen();
+        recorder->PushTextureID(ImGui::GetIO().Fonts->TexID);
+        segments.clear();
+        return recorder.get();
+    }
+
+    // closes the current segment, it can be empty
+    void Mark()
+    {
+        segments.push_back({ (unsigned)recorder->VtxBuffer.Size, (unsigned)recorder->IdxBuffer.Size });
+    }
+
+    void End()
+    {
+        IM_ASSERT(recorder->CmdBuffer.Size == 1 && "DrawCache: geometry does not fit a single draw command");
+        recorder->PopTextureID();
+        recorder->PopClipRect();
+    }
+
+    size_t Segments() const { return segments.size(); }
+
+    size_t Vertices() const { return segments.empty() ? 0 : segments.back().vtx_end; }
+
+    // copies the segment into the draw list moved by offset
+    void Draw(ImDrawList *draw_list, ImVec2 offset, size_t segment) const
+    {
+        if (segment >= segments.size())
+            return;
+        unsigned vtx_begin = segment ? segments[segment - 1].vtx_end : 0;
+        unsigned idx_begin = segment ? segments[segment - 1].idx_end : 0;
+        int vtx_count = (int)(segments[segment].vtx_end - vtx_begin);
+        int idx_count = (int)(segments[segment].idx_end - idx_begin);
+        if (!idx_count)
+            return;
+
+        draw_list->PrimReserve(idx_count, vtx_count);
+        unsigned base = draw_list->_VtxCurrentIdx; // after the reserve, it could start a new command
+        const ImDrawVert *vtx = recorder->VtxBuffer.Data + vtx_begin;
+        for (int i = 0; i < vtx_count; ++i)
+        {
+            ImDrawVert *v = draw_list->_VtxWritePtr++;
+            *v = vtx[i];
+            v->pos += offset;
+        }
+        const ImDrawIdx *idx = recorder->IdxBuffer.Data + idx_begin;
+        for (int i = 0; i < idx_count; ++i)
+            *draw_list->_IdxWritePtr++ = (ImDrawIdx)(base + idx[i] - vtx_begin);
+        draw_list->_VtxCurrentIdx += vtx_count;
+    }
+
+private:
+    struct Segment
+    {
+        unsigned vtx_end;
+        unsigned idx_end;
+    };
+
+    template<typename T>
+    static void append(std::string &key, const T &value) { key.append((const char*)&value, sizeof(value)); }
+    template<typename T>
+    static void append(std::string &key, const std::vector<T> &values) { key.append((const char*)values.data(), values.size() * sizeof(T)); }
+
+    std::string inputs;
+    std::unique_ptr<ImDrawList> recorder;
+    std::vector<Segment> segments;
+};
+
+// scrolling spectrogram, a ring texture with a column per pitch buffer element and a row per constant-Q key,
+// only the frames analyzed since the last update are uploaded, scrolling is done with texture coordinates
+class Spectrogram
+{
+public:
+    static constexpr float range_db = 60.0f; // levels below the full scale that are still visible
+
+    // copies the constant-Q frames analyzed since the last call, call with the analyzer mutex held
+    void Fetch(HoldingAnalyzer &analyzer)
+    {
+        const size_t size = Analyzer::PITCH_BUF_SIZE;
+        auto cq_buf = analyzer.get_cq_buf();
+        size_t total_cnt = analyzer.get_total_analyze_cnt();
+        keys = analyzer.get_cq_keys();
+        if (!cq_buf || !keys)
+            return;
+
+        size_t count = total_cnt - last_cnt;
+        if (refresh || total_cnt < last_cnt || count > size)
+            count = size; // timeline restarted or jumped, take the whole ring
+        refresh = false;
+        last_cnt = total_cnt;
+
+        size_t pos = analyzer.get_pitch_buf_pos();
+        columns.resize(count);
+        frames.resize(count * keys);
+        for (size_t i = 0; i < count; ++i)
+        {
+            size_t col = (pos + size - count + i) % size;
+            columns[i] = col;
+            std::copy(&cq_buf[col * keys], &cq_buf[col * keys] + keys, &frames[i * keys]);
+        }
+    }
+
+    // uploads the fetched frames, creates the texture on the first use
+    void Upload()
+    {
+        const size_t size = Analyzer::PITCH_BUF_SIZE;
+        if (columns.empty())
+            return;
+        if (!texture)
+        {
+            if (!failed)
+                texture = ImGui::SysCreateTexture((int)size, (int)keys);
+            failed = !texture;
+            if (failed || columns.size() < size)
+            {
+                // fill the new texture on the next fetch
+                columns.clear();
+                refresh = true;
+                return;
+            }
+        }
+
+        if (columns.size() == size)
+        {
+            // the whole ring at once
+            pixels.resize(size * keys);
+            for (size_t i = 0; i < size; ++i)
+                for (size_t k = 0; k < keys; ++k)
+                    pixels[k * size + columns[i]] = Level(frames[i * keys + k]);
+            ImGui::SysUpdateTexture(texture, 0, 0, (int)size, (int)keys, pixels.data());
+        }
+        else
+        {
+            pixels.resize(keys);
+            for (size_t i = 0; i < columns.size(); ++i)
+            {
+                for (size_t k = 0; k < keys; ++k)
+                    pixels[k] = Level(frames[i * keys + k]);
+                ImGui::SysUpdateTexture(texture, (int)columns[i], 0, 1, (int)keys, pixels.data());
+            }
+        }
+        columns.clear();
+    }
+
+    // draws count columns up to and including the newest one, which is centered at x_right,
+    // y_top and y_bottom are the outer edges of the highest and the lowest key, color tints the levels
+    void Draw(ImDrawList *draw_list, size_t newest, size_t count, float x_right, float x_step, float y_top, float y_bottom, ImU32 color) const
+    {
+        const size_t size = Analyzer::PITCH_BUF_SIZE;
+        if (!texture)
+            return;
+        TextureRingSpan spans[2];
+        size_t n = TextureRingSpans(size, newest, count, spans);
+        float x = x_right + x_step * 0.5f - x_step * std::min(count, size); // left edge of the oldest column
+        for (size_t i = 0; i < n; ++i)
+        {
+            float x_next = x + x_step * spans[i].count;
+            draw_list->AddImage(texture, ImVec2(x, y_top), ImVec2(x_next, y_bottom),
+                                ImVec2((float)spans[i].first / size, 1.0f), ImVec2((float)(spans[i].first + spans[i].count) / size, 0.0f), color);
+            x = x_next;
+        }
+    }
+
+    // releases the texture, everything is uploaded again on the next use
+    void Release()
+    {
+        if (texture)
+            ImGui::SysDestroyTexture(texture);
+        texture = 0;
+        failed = false;
+        refresh = true;
+        columns.clear();
+    }
+
+private:
+    // key magnitude to a white texel with the level in alpha, full scale is a full scale sine
+    static ImU32 Level(float magnitude)
+    {
+        const float full_scale = (float)Analyzer::FFTSIZE / 4.0f; // Hann windowed frame
+        float db = 20.0f * std::log10(std::fmax(magnitude, 1e-6f) / full_scale);
+        float a = std::clamp((db + range_db) / range_db, 0.0f, 1.0f);
+        return IM_COL32(255, 255, 255, (int)(a * 255.0f + 0.5f));
+    }
+
+    ImTextureID texture = 0;
+    bool failed = false;    // texture creation failed, do not retry every frame
+    bool refresh = true;    // fetch the whole ring
+    size_t last_cnt = 0;    // analyze count of the last fetch
+    size_t keys = 0;
+    std::vector<size_t> columns; // texture columns of the fetched frames
+    std::vector<float> frames;   // fetched frames, keys each
+    std::vector<ImU32> pixels;
+};
+
 //-----------------------------------------------------------------------------
 // [SECTION] App state
 //-----------------------------------------------------------------------------
@@ -265,6 +743,10 @@ static constexpr float     rul_margin = 4.0f;   // ruler label margin, px
 static constexpr float   top_feat_pos = 42.0f;  // top features vertical position, px: pitch note indicator, tuner, frequency
 static constexpr float         c_dist = 100.0f; // interval width, Cents
 static constexpr float         dc_max = 400.0f; // plot: max diff between data points, Cents
+static constexpr size_t AnalyzerChannelsMax = 8; // max channels analyzed separately, also max capture devices
+static constexpr size_t AnalyzeCbPeriodMin = 441; // audio callback period floor, frames, analyses in it run in parallel
+static constexpr int  LowLatencyPeriodDef = 128; // low latency device period, frames, raised on xruns
+static constexpr int  LowLatencyPeriodMax = 4096;
 
 // LUTs
 static constexpr const char *lut_note[][12] = {
@@ -345,6 +827,11 @@ constexpr const char *scale_list[] = {
 static constexpr float VolThresMax =     50.0f;  // Analyzer: volume threshold max value
 static constexpr float VolThresMin =      0.0f;  // Analyzer: volume threshold min value
 static constexpr float VolThresDef =      2.0f;  // Analyzer: volume threshold default value [2.0f]
+static constexpr bool  PerChannelDef =   false;  // Analyzer: analyze capture channels separately, default value [false]
+static constexpr bool  SkipSilenceDef =    true;  // Analyzer: skip the spectral analysis below the threshold, default value [true]
+static constexpr int   AnalyzeRateMax =    240;  // Analyzer: analysis rate max value, Hz
+static constexpr int   AnalyzeRateMin =     10;  // Analyzer: analysis rate min value, Hz
+static constexpr int   AnalyzeRateDef = ANALYZER_ANALYZE_FREQ; // Analyzer: analysis rate, Hz, default value [30]
 static constexpr float PitchCalibMax =  450.0f;  // pitch calibration max value, Hz
 static constexpr float PitchCalibMin =  430.0f;  // pitch calibration min value, Hz
 static constexpr float PitchCalibDef =  440.0f;  // pitch calibration, Hz, default value [440]
@@ -366,6 +853,8 @@ static constexpr int   PlotAScrlVelMin =     1;  // plot: vertical autoscroll mi
 static constexpr int   PlotAScrlVelDef =     3;  // plot: vertical autoscroll velocity, Cents, default value [3]
 static constexpr int   PlotAScrlMar =      100;  // plot: vertical autoscroll margin, Cents
 static constexpr double PlotAScrlGrace =   3.0;  // plot: vertical autoscroll grace period, seconds
+static constexpr double UIIdleWait =      0.25;  // UI: max wait for input between frames when nothing animates, seconds
+static constexpr double UIRequestPoll =  0.005;  // UI: new analysis frame checks while the audio runs, seconds
 static constexpr bool  PlotRulRightDef = false;  // plot: ruller on the right side, default value [false]
 static constexpr bool  PlotSemiLinesDef = true;  // plot: draw semitone lines if not on Chromatic scale, default value
 static constexpr bool  PlotSemiLblsDef = false;  // plot: show semitone labels, default value
@@ -379,6 +868,7 @@ static constexpr int   TempoValueMax =     250;  // plot: tempo max value, beats
 static constexpr int   TempoValueMin =      20;  // plot: tempo min value, beats per minute
 static constexpr int   TempoValueDef =     120;  // plot: tempo, beats per minute, default value [120]
 static constexpr bool  TempoGridDef =    false;  // plot: draw tempo grid by default [false]
+static constexpr bool  SpectrogramDef =  false;  // plot: draw spectrogram under the pitch by default [false]
 static constexpr bool  ButtonHoldDef =    true;  // UI: show HOLD button by default [true]
 static constexpr bool  ButtonScaleDef =   true;  // UI: show scale selector by default [true]
 static constexpr bool  ButtonTempoDef =   true;  // UI: show tempo settings button by default [true]
@@ -424,6 +914,10 @@ enum {                              // plot: tempo metering scheme
 
 static bool       first_run = true;
 static float      vol_thres = VolThresDef;       // Analyzer: volume threshold
+static bool     per_channel = PerChannelDef;     // Analyzer: per-channel analysis
+static bool    skip_silence = SkipSilenceDef;    // Analyzer: energy pre-gate
+static int     analyze_rate = AnalyzeRateDef;    // Analyzer: analysis rate, Hz, applied on start
+static int  analyze_rate_run = AnalyzeRateDef;   // Analyzer: analysis rate in effect, Hz
 static float         x_zoom = PlotXZoomDef;      // plot: horizontal zoom, px
 static float         y_zoom = PlotYZoomDef;      // plot: vertical zoom, ruler font heights
 static float          c_pos = PlotPosDef;        // plot: current bottom position, Cents
@@ -441,6 +935,7 @@ static int       note_names = NoteNamesDef;      // note naming scheme
 static bool       metronome = MetronomeDef;      // metronome pulse enabled
 static int        tempo_val = TempoValueDef;     // plot: tempo value, beats per minute
 static bool      tempo_grid = TempoGridDef;      // plot: show tempo grid
+static bool     spectrogram = SpectrogramDef;    // plot: show spectrogram
 static int      tempo_meter = TempoMeterDef;     // plot: tempo meter
 static bool        but_hold = ButtonHoldDef;     // UI: show HOLD button
 static bool       but_scale = ButtonScaleDef;    // UI: show scale selector
@@ -454,6 +949,11 @@ static float    play_volume = 1.0f;              // playback volume
 static bool            mute = false;             // playback muted
 static std::string scale_str(scale_list[0]);     // scale selected
 static char record_dir[PATH_MAX] = {};           // record directory path
+static bool     rt_priority = false;             // realtime priority of the audio and analysis threads
+static bool     lock_memory = false;             // keep the process memory resident
+static char  audio_cpus[64] = {};                // cpus the audio threads are pinned to, "0-1,4" list
+static char analysis_cpus[64] = {};              // ditto, analysis threads
+static int      low_latency = 0;                 // low latency device period, frames, 0 off
 
 // Plot palete, fixed order up to and including pitch
 std::initializer_list<ImU32> DefaultPlotColors = {
@@ -482,7 +982,15 @@ std::initializer_list<ImU32> DefaultPlotColors = {
     palette[ColorYellow],         //   pitch
     IM_COL32(0, 0, 128, 255),     //   metronome
     IM_COL32(255, 255, 255, 255), //   note
-    IM_COL32(204, 204, 204, 255)  //   tuner
+    IM_COL32(204, 204, 204, 255), //   tuner
+    palette[ColorCyan],           //   pitch, channel 2
+    palette[ColorOrange],         //   pitch, channel 3
+    palette[ColorLime],           //   pitch, channel 4
+    palette[ColorPink],           //   pitch, channel 5
+    palette[ColorLightBlue],      //   pitch, channel 6
+    palette[ColorRed],            //   pitch, channel 7
+    palette[ColorLightGreen],     //   pitch, channel 8
+    palette[ColorOrange]          //   spectrogram, full level
 };
 enum {
     PlotIdxSemitone = 0,
@@ -510,7 +1018,10 @@ enum {
     PlotIdxPitch,
     PlotIdxMetronome,
     PlotIdxNote,
-    PlotIdxTuner
+    PlotIdxTuner,
+    PlotIdxPitchCh2,
+    PlotIdxPitchChLast = PlotIdxPitchCh2 + (int)AnalyzerChannelsMax - 2,
+    PlotIdxSpectrogram
 };
 static std::vector<ImU32> plot_colors(DefaultPlotColors);
 
@@ -556,6 +1067,7 @@ static bool   fonts_reloaded =    false;  // fonts reloaded flag
 static float        ui_scale =      1.0;  // DPI scaling factor
 static float        x_offset =     0.0f;  // horizontal panning offset
 static bool      x_off_reset =    false;  // reset offset flag
+static bool        animating =    false;  // something moves between analysis frames, render continuously
 static float      x_zoom_min =     0.0f;  // plot horizontal zoom min limit based on window size,
                                           //           DPI scale and Analyzer's pitch array size
 static float           c_top =     0.0f;  // current top plot position, Cents
@@ -576,6 +1088,10 @@ static ImVec2       tempo_sz;             // UI tempo widget size
 static float   scale_sel_wdt;             // UI scale selector width
 static ImVec2    hold_btn_sz;             // UI hold button size
 static float    progress_hgt;             // UI playback progress height
+static DrawCache  grid_cache;             // plot: vertical grid and ruler labels, a segment per key
+static int        grid_first = 0;         // plot: first key in the grid cache
+static DrawCache tuner_cache;             // tuner scale, a segment per 10 Cents of an octave
+static Spectrogram spectrogram_view;      // plot: spectrogram texture
 static bool   progress_hover =    false;  // UI playback progress is hovered
 static std::vector<double> f_peak_buf(TunerSmoothDef, -1.0);    // peak frequency averaging buffer
 static size_t f_peak_buf_pos =        0;  // peak frequency averaging buffer position
@@ -585,15 +1101,51 @@ static std::string last_file;             // path to the last active file
 static std::string open_dir;              // directory of the last file open
 static std::string cmd_options;           // command line options help message
 
+// startup phases, ms since AppInit(), reported to the debug log on the first frame
+static struct {
+    std::chrono::steady_clock::time_point start;
+    double settings = 0.0;                // settings load
+    double config = 0.0;                  // AppConfig() called, the window is up
+    double fonts = 0.0;                   // font atlas build
+    bool capture = false;                 // capture start reported
+} startup_phases;
+
+// capture to screen latency, from the callback bringing an analysis to the frame drawing it,
+// reported to the debug log along with the device timing
+static std::atomic<int64_t> analysis_stamp(0); // steady clock, ns, the callback the last analysis came with
+static struct {
+    size_t analyze_cnt = 0;
+    double sum = 0.0, max = 0.0;          // ms
+    size_t count = 0;
+    std::chrono::steady_clock::time_point reported;
+} latency_meter;
+
+// plot drawing cost per frame, CPU time and vertices, with the part of the cached grid and tuner layers:
+// copying them in every frame and rebuilding them (what every frame paid before), reported to the debug log
+static struct {
+    double sum = 0.0, max = 0.0;          // ms, Draw()
+    size_t vtx = 0;                       // added by Draw()
+    double copy = 0.0;                    // ms, the cached layers copied in
+    size_t copy_vtx = 0;
+    double build = 0.0;                   // ms, the cached layers rebuilt
+    size_t build_vtx = 0, builds = 0;
+    size_t count = 0;
+    std::chrono::steady_clock::time_point reported;
+} draw_meter;
+
 typedef std::unique_ptr<pfd::open_file> unique_open_file;
 static unique_open_file open_file_dlg = nullptr; // open file dialog operation
 typedef std::unique_ptr<pfd::select_folder> unique_select_folder;
 static unique_select_folder select_folder_dlg = nullptr; // select folder dialog operation
 
 static std::mutex analyzer_mtx;
-static HoldingAnalyzer analyzer(analyzer_mtx);
+static AnalyzerGroup analyzers(analyzer_mtx, AnalyzerChannelsMax);
+static HoldingAnalyzer &analyzer = analyzers[0]; // main analyzer: mono downmix or the first channel
+static PitchStream pitch_stream;                // shared memory publisher, -s option
 static Logger msg_log;
-static AudioHandler audiohandler(&msg_log, 44100 /* Fsample */, 2 /* channels */, AudioHandler::FormatF32 /* sample format */, AudioHandler::FormatS16 /* record format */, Analyzer::ANALYZE_INTERVAL /* cb interval */);
+static LogSink log_sink(msg_log);               // log file writer, -l option
+static AudioHandler audiohandler(&msg_log, 44100 /* Fsample */, 2 /* channels */, AudioHandler::FormatF32 /* sample format */, AudioHandler::FormatS16 /* record format */, Analyzer::ANALYZE_INTERVAL /* cb interval */,
+                                 AudioHandler::BackendDefault, true /* lazy init, started by AppInit() */);
 static AudioHandler::State ah_state;      // frame-locked handler state
 static uint64_t ah_len = 0, ah_pos = 0;   // handler length and position, applicable only to playback and record
 
@@ -790,8 +1342,8 @@ static void AddFmtTextAligned(ImVec2 at, int alignH, int alignV, ImU32 color, Im
 static void AlignTempo(size_t position = 0)
 {
     std::lock_guard<std::mutex> lock(analyzer_mtx);
-    analyzer.set_total_analyze_cnt(Analyzer::PITCH_BUF_SIZE + position); // offset for panning
-    analyzer.clearData();
+    analyzers.set_total_analyze_cnt(Analyzer::PITCH_BUF_SIZE + position); // offset for panning
+    analyzers.clearData();
 }
 
 // audio control wrappers
@@ -800,8 +1352,8 @@ static void Play(const char *file = nullptr)
     if (file && *file)
         last_file = file;
 
-    analyzer.clearData();
-    analyzer.unhold();
+    analyzers.clearData();
+    analyzers.unhold();
     audiohandler.stop();
     audiohandler.play(file);
     x_off_reset = true;
@@ -814,7 +1366,7 @@ static void Seek(uint64_t seek_to_frame)
 
     seek_to_frame = std::min(seek_to_frame, ah_len);
 
-    analyzer.clearData();
+    analyzers.clearData();
     audiohandler.seek(seek_to_frame - seek_to_frame % Analyzer::ANALYZE_INTERVAL); // align to analyzer frame
 }
 
@@ -841,7 +1393,7 @@ static void Seek(double seek_to_second, bool relative = false)
             frame = ((uint64_t)-relframes < ah_pos) ? ah_pos + relframes : 0;
     }
 
-    analyzer.clearData();
+    analyzers.clearData();
     audiohandler.seek(frame - frame % Analyzer::ANALYZE_INTERVAL);
 }
 
@@ -849,7 +1401,7 @@ static void Capture()
 {
     if (!ah_state.isCapturing())
     {
-        analyzer.clearData();
+        analyzers.clearData();
         audiohandler.stop();
         audiohandler.capture();
         x_off_reset = true;
@@ -892,8 +1444,8 @@ static void Record(const char *file = nullptr)
 
     last_file += ".wav";
 
-    analyzer.clearData();
-    analyzer.unhold();
+    analyzers.clearData();
+    analyzers.unhold();
     audiohandler.stop();
     audiohandler.record(last_file.c_str());
     x_off_reset = true;
@@ -909,7 +1461,7 @@ static void Resume()
 {
     if (ah_state.canResume())
     {
-        analyzer.unhold();
+        analyzers.unhold();
         audiohandler.resume();
         x_off_reset = true;
     }
@@ -917,13 +1469,13 @@ static void Resume()
 
 static void ToggleHold()
 {
-    if (analyzer.on_hold())
+    if (analyzers.on_hold())
     {
-        analyzer.unhold();
+        analyzers.unhold();
         x_off_reset = true;
     }
     else
-        analyzer.hold();
+        analyzers.hold();
 }
 
 static void TogglePause()
@@ -935,7 +1487,7 @@ static void TogglePause()
         audiohandler.pause();
     else if (ah_state.canResume())
     {
-        analyzer.unhold();
+        analyzers.unhold();
         audiohandler.resume();
         x_off_reset = true;
     }
@@ -946,6 +1498,13 @@ static inline void AdjustVolume()
     audiohandler.setPlaybackVolumeFactor(mute ? 0 : play_volume);
 }
 
+// per-channel analysis takes every channel the capture device has, the analyzers follow the count delivered
+static inline void AdjustPerChannel()
+{
+    analyzers.set_per_channel(per_channel);
+    audiohandler.setCaptureChannels(per_channel ? 0 : audiohandler.channels);
+}
+
 static inline void ToggleMute()
 {
     mute = !mute;
@@ -1118,6 +1677,9 @@ static void LoadSettings()
         {
             GETVAL("imvpm", first_run);
             GETVAL("imvpm", vol_thres, VolThresMin, VolThresMax);
+            GETVAL("imvpm", per_channel);
+            GETVAL("imvpm", skip_silence);
+            GETVAL("imvpm", analyze_rate, AnalyzeRateMin, AnalyzeRateMax);
             GETVAL("imvpm", x_zoom, PlotXZoomMin, PlotXZoomMax);
             GETVAL("imvpm", y_zoom, PlotYZoomMin, PlotYZoomMax);
             GETVAL("imvpm", c_pos, PlotRangeMin, PlotRangeMax);
@@ -1135,6 +1697,7 @@ static void LoadSettings()
             GETVAL("imvpm", metronome);
             GETVAL("imvpm", tempo_val, TempoValueMin, TempoValueMax);
             GETVAL("imvpm", tempo_grid);
+            GETVAL("imvpm", spectrogram);
             GETVAL("imvpm", tempo_meter, TempoMeterMin, TempoMeterMax);
             GETVAL("imvpm", but_hold);
             GETVAL("imvpm", but_scale);
@@ -1185,6 +1748,11 @@ static void LoadSettings()
                     ImGui::SysWndState = (ImGui::WindowState)wstate;
             }
             GETVAL("imvpm", record_dir, IM_ARRAYSIZE(record_dir));
+            GETVAL("imvpm", rt_priority);
+            GETVAL("imvpm", lock_memory);
+            GETVAL("imvpm", audio_cpus, IM_ARRAYSIZE(audio_cpus));
+            GETVAL("imvpm", analysis_cpus, IM_ARRAYSIZE(analysis_cpus));
+            GETVAL("imvpm", low_latency, 0, LowLatencyPeriodMax);
             {
                 const char *pv = ini.GetValue("imvpm", "open_dir");
                 if (pv)
@@ -1196,6 +1764,8 @@ static void LoadSettings()
     UpdateCalibration();
     UpdateScale();
     AdjustVolume();
+    AdjustPerChannel();
+    analyzers.set_gate(skip_silence);
 
     if (first_run && !record_dir[0])
     {
@@ -1217,6 +1787,9 @@ static void SaveSettings()
     first_run = false;
     SETBOOL("imvpm", first_run);
     SETVAL ("imvpm", vol_thres, "%0.3f");
+    SETBOOL("imvpm", per_channel);
+    SETBOOL("imvpm", skip_silence);
+    SETVAL ("imvpm", analyze_rate, "%d");
     SETVAL ("imvpm", x_zoom, "%0.3f");
     SETVAL ("imvpm", y_zoom, "%0.3f");
     SETVAL ("imvpm", c_pos, "%0.3f");
@@ -1234,6 +1807,7 @@ static void SaveSettings()
     SETBOOL("imvpm", metronome);
     SETVAL ("imvpm", tempo_val, "%d");
     SETBOOL("imvpm", tempo_grid);
+    SETBOOL("imvpm", spectrogram);
     SETVAL ("imvpm", tempo_meter, "%d");
     SETBOOL("imvpm", but_hold);
     SETBOOL("imvpm", but_scale);
@@ -1272,6 +1846,14 @@ static void SaveSettings()
         ini.SetValue("imvpm", "record_dir", record_dir);
     if (!open_dir.empty())
         ini.SetValue("imvpm", "open_dir", open_dir.c_str());
+    // realtime controls, not in the UI
+    SETBOOL("imvpm", rt_priority);
+    SETBOOL("imvpm", lock_memory);
+    if (audio_cpus[0])
+        ini.SetValue("imvpm", "audio_cpus", audio_cpus);
+    if (analysis_cpus[0])
+        ini.SetValue("imvpm", "analysis_cpus", analysis_cpus);
+    SETVAL ("imvpm", low_latency, "%d");
 
     ini.SaveFile(config_file.c_str());
 }
@@ -1279,6 +1861,9 @@ static void SaveSettings()
 static void ResetSettings()
 {
     vol_thres = VolThresDef;
+    per_channel = PerChannelDef;
+    skip_silence = SkipSilenceDef;
+    analyze_rate = AnalyzeRateDef;
     x_zoom = PlotXZoomDef;
     y_zoom = PlotYZoomDef;
     c_pos = PlotPosDef;
@@ -1296,6 +1881,7 @@ static void ResetSettings()
     metronome = MetronomeDef;
     tempo_val = TempoValueDef;
     tempo_grid = TempoGridDef;
+    spectrogram = SpectrogramDef;
     tempo_meter = TempoMeterDef;
     but_hold = ButtonHoldDef;
     but_scale = ButtonScaleDef;
@@ -1317,6 +1903,8 @@ static void ResetSettings()
     UpdateCalibration();
     UpdateScale();
     AdjustVolume();
+    AdjustPerChannel();
+    analyzers.set_gate(skip_silence);
 }
 
 static bool ButtonWidget(const char* text, ImU32 color = UI_colors[UIIdxWidgetText], bool disabled = false)
@@ -1374,19 +1962,44 @@ static inline bool ShowWindow(WndState &state)
 //-----------------------------------------------------------------------------
 
 // AudioHandler
-void sampleCb(_UNUSED_ AudioHandler::Format format, uint32_t channels, const void *pData, uint32_t frameCount, _UNUSED_ void *userData)
+void sampleCb(AudioHandler::Format format, uint32_t channels, const void *pData, uint32_t frameCount, _UNUSED_ void *userData)
 {
-    std::lock_guard<std::mutex> lock(analyzer_mtx);
-    const float *bufptr = (const float*)pData;
-    while (frameCount--)
+    auto entry = std::chrono::steady_clock::now();
+    Analyzer::InputFormat input;
+    switch (format)
     {
-        float sample = 0.0f;
-        for (uint32_t ch = 0; ch < channels; ch++) // downmix to mono
-            sample += *bufptr++;
-        analyzer.addData(sample / channels);
+    case AudioHandler::FormatU8:  input = Analyzer::InputU8;  break;
+    case AudioHandler::FormatS16: input = Analyzer::InputS16; break;
+    case AudioHandler::FormatS24: input = Analyzer::InputS24; break;
+    case AudioHandler::FormatS32: input = Analyzer::InputS32; break;
+    case AudioHandler::FormatF32: input = Analyzer::InputF32; break;
+    default: return;
     }
+    bool wakeup;
+    {
+        std::lock_guard<std::mutex> lock(analyzer_mtx);
+        size_t count = analyzer.Analyzer::get_total_analyze_cnt();
+        analyzers.addFrames(pData, input, frameCount, channels);
+        wakeup = count != analyzer.Analyzer::get_total_analyze_cnt() && !analyzers.on_hold();
+    }
+    if (wakeup)
+    {
+        analysis_stamp.store(std::chrono::duration_cast<std::chrono::nanoseconds>(entry.time_since_epoch()).count(), std::memory_order_relaxed);
+        ImGui::SysRequestFrame(); // new analysis frame to draw, SysWakeup() locks and this is the audio thread
+    }
+}
+
+void groupSampleCb(unsigned device, _UNUSED_ AudioHandler::Format format, uint32_t channels, const void *pData, uint32_t frameCount, uint64_t timelinePos, _UNUSED_ void *userData)
+{
+    analyzers.addDeviceFrames(device, (const float*)pData, frameCount, channels, timelinePos);
+}
+
+static double StartupMs()
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startup_phases.start).count();
 }
 
+// UI thread, queued notifications are delivered at the frame start
 void eventCb(const AudioHandler::Notification &notification, _UNUSED_ void *userData)
 {
     std::stringstream title;
@@ -1411,15 +2024,54 @@ void eventCb(const AudioHandler::Notification &notification, _UNUSED_ void *user
         case AudioHandler::EventResume:
             if (notification.dataU64 != AudioHandler::EventOpCapture)
                 break;
+            if (!startup_phases.capture)
+            {
+                startup_phases.capture = true;
+                msg_log.LogMsg(LOG_DBG, "Startup: capture running at %.1f ms", StartupMs());
+            }
             // fall through
         default:
         case AudioHandler::EventStop:
+            if (notification.event == AudioHandler::EventStop)
+            {
+                size_t frames, skipped;
+                analyzers.take_gate_stats(frames, skipped);
+                if (frames)
+                    msg_log.LogMsg(LOG_DBG, "Analyzer: %zu of %zu frames below the threshold skipped, %.1f%%",
+                                   skipped, frames, 100.0 * skipped / frames);
+            }
             ImGui::SysSetWindowTitle(WINDOW_TITLE);
             if (notification.dataU64 == AudioHandler::EventOpRecord)
                 msg_log.LogMsg(LOG_INFO, "File recorded: %s", last_file.c_str());
     }
 }
 
+// realtime controls of the settings or the command line, before the audio starts
+static void ApplyThreadTuning(bool rt, bool mlock, const char *audio_list, const char *analysis_list, size_t cb_frames)
+{
+    uint64_t audio_mask = 0, analysis_mask = 0;
+    if (!ThreadTuning::ParseCpuList(audio_list, audio_mask))
+        msg_log.LogMsg(LOG_WARN, "Invalid audio cpu list '%s', not pinned", audio_list);
+    if (!ThreadTuning::ParseCpuList(analysis_list, analysis_mask))
+        msg_log.LogMsg(LOG_WARN, "Invalid analysis cpu list '%s', not pinned", analysis_list);
+
+    audiohandler.setThreadPriority(rt ? AudioHandler::PriorityRealtime : AudioHandler::PriorityDefault, audio_mask, analysis_mask);
+    if (rt || analysis_mask)
+    {
+        unsigned refused = analyzers.tune_pool(rt, analysis_mask);
+        if (refused)
+            msg_log.LogMsg(LOG_WARN, "%u analysis threads refused the realtime priority or pinning", refused);
+    }
+    if (mlock)
+    {
+        analyzers.prefault(cb_frames);
+        if (ThreadTuning::LockMemory())
+            msg_log.LogMsg(LOG_DBG, "Memory locked");
+        else
+            msg_log.LogMsg(LOG_WARN, "Failed to lock the memory, check the memlock limit");
+    }
+}
+
 // ImGui
 void DragAndDropCb(const char *file)
 {
@@ -1438,18 +2090,21 @@ void DragAndDropCb(const char *file)
 
 int ImGui::AppInit(int argc, char const *const* argv)
 {
+    startup_phases.start = std::chrono::steady_clock::now();
     msg_log.SetLevel(LOG_INFO);
 
     LoadSettings();
+    startup_phases.settings = StartupMs();
 
     AlignTempo();
     audiohandler.attachFrameDataCb(sampleCb);
+    audiohandler.attachGroupFrameDataCb(groupSampleCb);
     audiohandler.attachNotificationCb(AudioHandler::EventPlayFile
                                     | AudioHandler::EventRecordFile
                                     | AudioHandler::EventSeek
                                     | AudioHandler::EventResume
                                     | AudioHandler::EventStop,
-                                      eventCb);
+                                      eventCb, nullptr, true, [](void*) { ImGui::SysWakeup(); });
     audiohandler.setPlaybackEOFaction(AudioHandler::CmdCapture);
     audiohandler.setUpdatePlaybackFileName(true);
     audiohandler.enumerate();
@@ -1461,10 +2116,19 @@ int ImGui::AppInit(int argc, char const *const* argv)
     }
 
     popl::OptionParser op("opts");
-    auto capture_option     = op.add<popl::Value<std::string>>("i", "capture", "capture device");
+    auto capture_option     = op.add<popl::Value<std::string>>("i", "capture", "capture device\n(repeat to capture from\nseveral devices at once)");
     auto playback_option    = op.add<popl::Value<std::string>>("o", "playback", "playback device");
     auto record_option      = op.add<popl::Switch>("r", "record", "start recording\n(overwrite an existing\nfile without asking)");
     auto verbose_option     = op.add<popl::Switch>("v", "verbose", "enable debug log");
+    auto shm_option         = op.add<popl::Value<std::string>>("s", "shm", "publish pitch stream to\nshared memory object", PITCHSTREAM_DEFAULT_NAME);
+    auto shm_spectrum_option = op.add<popl::Switch>("", "shm-spectrum", "include spectrum into\nthe pitch stream");
+    auto log_option         = op.add<popl::Value<std::string>>("l", "log", "append log messages\nto file");
+    auto rate_option        = op.add<popl::Value<int>>("a", "rate", "analysis rate, Hz\n(overrides the setting)");
+    auto rt_option          = op.add<popl::Switch>("", "rt", "realtime priority of the\naudio and analysis threads");
+    auto audio_cpus_option  = op.add<popl::Value<std::string>>("", "audio-cpus", "pin the audio threads\nto cpus, e.g. 0-1,4");
+    auto analysis_cpus_option = op.add<popl::Value<std::string>>("", "analysis-cpus", "pin the analysis threads\nto cpus");
+    auto mlock_option       = op.add<popl::Switch>("", "mlock", "keep the memory resident,\nno paging on the audio path");
+    auto low_latency_option = op.add<popl::Implicit<int>>("", "low-latency", "small device periods,\nframes, 0 off", LowLatencyPeriodDef);
     // save the help text for the About window
     {
         std::stringstream ss;
@@ -1472,16 +2136,64 @@ int ImGui::AppInit(int argc, char const *const* argv)
         cmd_options = ss.str();
     }
 
+    // the command line ones are for this run only
+    bool rt = rt_priority, mlock = lock_memory;
+    int ll_period = low_latency;
+    std::string audio_cpu_list(audio_cpus), analysis_cpu_list(analysis_cpus);
     try
     {
         op.parse(argc, argv);
 
+        if (verbose_option->is_set())
+            msg_log.SetLevel(LOG_DBG);
+        rt = rt || rt_option->is_set();
+        mlock = mlock || mlock_option->is_set();
+        if (low_latency_option->is_set())
+            ll_period = std::clamp(low_latency_option->value(), 0, LowLatencyPeriodMax);
+        if (audio_cpus_option->is_set())
+            audio_cpu_list = audio_cpus_option->value();
+        if (analysis_cpus_option->is_set())
+            analysis_cpu_list = analysis_cpus_option->value();
+        // the analysis rate sizes the analyzer buffers, set before any capture device is added
+        if (rate_option->is_set())
+            analyze_rate = std::clamp(rate_option->value(), AnalyzeRateMin, AnalyzeRateMax);
+        if (analyze_rate != AnalyzeRateDef && Analyzer::set_analyze_freq(analyze_rate))
+        {
+            analyzers.resize();
+            analyze_rate_run = analyze_rate;
+            msg_log.LogMsg(LOG_DBG, "Analysis rate %.2f Hz, %zu frames", Analyzer::get_analyze_freq(), Analyzer::ANALYZE_INTERVAL);
+        }
+
         if (capture_option->is_set())
-            audiohandler.setPreferredCaptureDevice(capture_option->value().c_str());
+        {
+            audiohandler.setPreferredCaptureDevice(capture_option->value(0).c_str());
+            // the rest are analyzed alongside the main one
+            for (size_t i = 1; i < capture_option->count(); i++)
+            {
+                if (analyzers.device_count() + 1 >= AnalyzerChannelsMax)
+                {
+                    msg_log.LogMsg(LOG_WARN, "Too many capture devices, %s ignored", capture_option->value(i).c_str());
+                    continue;
+                }
+                analyzers.add_device();
+                audiohandler.addCaptureDevice(capture_option->value(i).c_str());
+            }
+        }
         if (playback_option->is_set())
             audiohandler.setPreferredPlaybackDevice(capture_option->value().c_str());
-        if (verbose_option->is_set())
-            msg_log.SetLevel(LOG_DBG);
+        if (log_option->is_set() && !log_sink.Open(log_option->value().c_str()))
+            msg_log.LogMsg(LOG_ERR, "Failed to open log file %s", log_option->value().c_str());
+        if (shm_option->is_set())
+        {
+            if (pitch_stream.open(shm_option->value().c_str(), 256, shm_spectrum_option->is_set()))
+            {
+                std::lock_guard<std::mutex> lock(analyzer_mtx);
+                analyzer.set_analyze_cb(PitchStream::analyze_cb, &pitch_stream);
+                msg_log.LogMsg(LOG_INFO, "Publishing pitch stream to %s", pitch_stream.get_name().c_str());
+            }
+            else
+                msg_log.LogMsg(LOG_ERR, "Failed to create pitch stream %s", shm_option->value().c_str());
+        }
 
         if (record_option->is_set())
             Record(op.non_option_args().size() && !op.non_option_args()[0].empty() ? op.non_option_args()[0].c_str() : nullptr);
@@ -1496,6 +2208,18 @@ int ImGui::AppInit(int argc, char const *const* argv)
     }
     catch (const std::exception& e) {}
 
+    // the audio backend comes up on its own threads while the window and fonts are made,
+    // the commands above are carried out as soon as it is ready;
+    // at high analysis rates a callback brings several analyses, they run in parallel;
+    // capture comes in the device native format, the analyzers convert it on the way in
+    audiohandler.setCaptureFormat(AudioHandler::FormatAny);
+    uint32_t cb_interval = (uint32_t)(Analyzer::ANALYZE_INTERVAL * ((AnalyzeCbPeriodMin + Analyzer::ANALYZE_INTERVAL - 1) / Analyzer::ANALYZE_INTERVAL));
+    ApplyThreadTuning(rt, mlock, audio_cpu_list.c_str(), analysis_cpu_list.c_str(), cb_interval);
+    // small device periods, the analyzers accumulate to the hop, an analysis is drawn as soon as it is due
+    if (ll_period)
+        audiohandler.setLowLatency((uint32_t)ll_period);
+    audiohandler.init(cb_interval);
+
     return 0;
 }
 
@@ -1514,6 +2238,8 @@ int ImGui::AppInit(int argc, char const *const* argv)
 } while(0)
 bool ImGui::AppConfig(bool startup)
 {
+    if (startup)
+        startup_phases.config = StartupMs();
     if (custom_scaling)
         ui_scale = custom_scale;
     else
@@ -1569,18 +2295,62 @@ bool ImGui::AppConfig(bool startup)
         0
     };
 
-    io.Fonts->Clear();
-    ADD_FONT(font_def, ranges_ui, FONT);
-    MERGE_FONT(font_icon, ranges_icons_regular, FONT_ICONS_REGULAR);
-    MERGE_FONT(font_icon, ranges_icons_solid, FONT_ICONS_SOLID);
-    ADD_FONT(font_widget, ranges_icons_regular, FONT_ICONS_REGULAR);
-    MERGE_FONT(font_widget, ranges_icons_solid, FONT_ICONS_SOLID);
-    ADD_FONT(font_tuner, ranges_notes, FONT_NOTES);
-    ADD_FONT(font_pitch, ranges_notes, FONT_NOTES);
-    ADD_FONT(font_grid, ranges_notes, FONT_NOTES);
-    io.Fonts->Build();
+    // the rasterized atlas is cached next to the config file, keyed by everything it is built from
+    pathstr_t font_cache = config_file;
+    uint64_t font_key = FontAtlasCache::Hash(&ui_scale, sizeof(ui_scale));
+    if (!font_cache.empty())
+    {
+ #if defined(_WIN32)
+        font_cache += L".fonts";
+ #else
+        font_cache += ".fonts";
+ #endif
+        static const float font_sizes[] = { font_def_sz, font_icon_sz, font_widget_sz, font_tuner_sz, font_pitch_sz, font_grid_sz };
+        font_key = FontAtlasCache::Hash(font_sizes, sizeof(font_sizes), font_key);
+        const int font_raster[] = { font_config.OversampleH, font_config.OversampleV, font_config.PixelSnapH };
+        font_key = FontAtlasCache::Hash(font_raster, sizeof(font_raster), font_key);
+        for (const ImWchar *ranges : { ranges_ui, ranges_icons_regular, ranges_icons_solid, ranges_notes })
+        {
+            size_t n = 0;
+            while (ranges[n])
+                n++;
+            font_key = FontAtlasCache::Hash(ranges, n * sizeof(*ranges), font_key);
+        }
+        font_key = FontAtlasCache::Hash(FONT_DATA(FONT), FONT_SIZE(FONT), font_key);
+        font_key = FontAtlasCache::Hash(FONT_DATA(FONT_NOTES), FONT_SIZE(FONT_NOTES), font_key);
+        font_key = FontAtlasCache::Hash(FONT_DATA(FONT_ICONS_REGULAR), FONT_SIZE(FONT_ICONS_REGULAR), font_key);
+        font_key = FontAtlasCache::Hash(FONT_DATA(FONT_ICONS_SOLID), FONT_SIZE(FONT_ICONS_SOLID), font_key);
+    }
+
+    if (!font_cache.empty() && FontAtlasCache::Load(io.Fonts, font_cache.c_str(), font_key) && io.Fonts->Fonts.Size == 5)
+    {
+        // in the order they are added below
+        font_def    = io.Fonts->Fonts[0];
+        font_widget = io.Fonts->Fonts[1];
+        font_tuner  = io.Fonts->Fonts[2];
+        font_pitch  = io.Fonts->Fonts[3];
+        font_grid   = io.Fonts->Fonts[4];
+        msg_log.LogMsg(LOG_DBG, "Font atlas loaded from cache, scale %.2f", ui_scale);
+    }
+    else
+    {
+        io.Fonts->Clear();
+        ADD_FONT(font_def, ranges_ui, FONT);
+        MERGE_FONT(font_icon, ranges_icons_regular, FONT_ICONS_REGULAR);
+        MERGE_FONT(font_icon, ranges_icons_solid, FONT_ICONS_SOLID);
+        ADD_FONT(font_widget, ranges_icons_regular, FONT_ICONS_REGULAR);
+        MERGE_FONT(font_widget, ranges_icons_solid, FONT_ICONS_SOLID);
+        ADD_FONT(font_tuner, ranges_notes, FONT_NOTES);
+        ADD_FONT(font_pitch, ranges_notes, FONT_NOTES);
+        ADD_FONT(font_grid, ranges_notes, FONT_NOTES);
+        io.Fonts->Build();
+        if (!font_cache.empty() && !ro_config && !FontAtlasCache::Save(io.Fonts, font_cache.c_str(), font_key))
+            msg_log.LogMsg(LOG_DBG, "Failed to write font atlas cache");
+    }
     io.FontDefault = font_def;
     fonts_reloaded = true;
+    if (startup)
+        startup_phases.fonts = StartupMs() - startup_phases.config;
 
     ImGuiStyle& style = ImGui::GetStyle();
     style.WindowPadding = ImVec2(font_def_sz / 2 * ui_scale, font_def_sz / 2 * ui_scale);
@@ -1620,9 +2390,17 @@ void ImGui::AppNewFrame()
     // Most functions would normally just assert/crash if the context is missing.
     IM_ASSERT(ImGui::GetCurrentContext() != NULL && "Missing Dear ImGui context. Refer to examples app!");
 
+    animating = ImGui::GetIO().WantTextInput; // cursor blinking
+
+    if (ImGui::GetFrameCount() == 1)
+        msg_log.LogMsg(LOG_DBG, "Startup: settings %.1f ms, window up at %.1f ms, fonts %.1f ms, first frame at %.1f ms",
+                       startup_phases.settings, startup_phases.config, startup_phases.fonts, StartupMs());
+
     if (fonts_reloaded)
     {
         fonts_reloaded = false;
+        grid_cache.Invalidate(); // glyphs have moved
+        tuner_cache.Invalidate();
 
         // determine ruller width by the longest note name
         ImGui::PushFont(font_grid);
@@ -1673,6 +2451,7 @@ void ImGui::AppNewFrame()
         select_folder_dlg = nullptr;
     }
 
+    audiohandler.dispatchNotifications();              // handler events since the last frame
     audiohandler.getError();                           // discard any errors
     audiohandler.getState(ah_state, &ah_len, &ah_pos); // cache handler state for the frame
 
@@ -1802,14 +2581,32 @@ void ImGui::AppNewFrame()
     SettingsWindow();
     ImGui::ShowAboutWindow(nullptr);
 
+    // constant-Q transform runs in the analysis thread only while the spectrum or the spectrogram is shown
+    static bool cq_enabled = false;
+    if ((wnd_spectrum || spectrogram) != cq_enabled)
+    {
+        static std::shared_ptr<const ConstantQ> cq_kernel;
+        if (!cq_kernel)
+            cq_kernel = Analyzer::make_cq_kernel();
+        std::lock_guard<std::mutex> lock(analyzer_mtx);
+        cq_enabled = wnd_spectrum || spectrogram;
+        analyzer.set_cq(cq_enabled ? cq_kernel : nullptr);
+    }
+    if (!spectrogram)
+        spectrogram_view.Release(); // no-op unless it was just turned off
     if (wnd_spectrum)
         SpectrumWindow(&wnd_spectrum);
 
     //ImGui::ShowIDStackToolWindow(nullptr);
+
+    // new analysis frames and input wake the backend up, otherwise there is nothing to redraw
+    ImGui::SysWaitTimeout = animating ? 0.0 : UIIdleWait;
+    ImGui::SysRequestPoll = !ah_state.isIdle() && !ah_state.isPaused() ? UIRequestPoll : 0.0;
 }
 
 void ImGui::AppDestroy()
 {
+    spectrogram_view.Release();
     SaveSettings();
 }
 
@@ -1870,7 +2667,6 @@ static void CaptureDevices()
                     audiohandler.capture();
             }
         }
-        audiohandler.unlockDevices();
 
         ImGui::EndPopup();
     }
@@ -1902,7 +2698,6 @@ static void PlaybackDevices()
             if (ImGui::MenuItem(TruncateUTF8String(devices.list[n].name, 60).c_str(), "", is_selected) && !is_selected)
                 audiohandler.setPreferredPlaybackDevice(devices.list[n].name.c_str());
         }
-        audiohandler.unlockDevices();
 
         float vol;
         audiohandler.getPlaybackVolumeFactor(vol);
@@ -2078,7 +2873,7 @@ static void ScaleSelector(bool from_settings)
 
 static void HoldButton()
 {
-    ImGui::PushStyleColor(ImGuiCol_Text, ImGui::GetColorU32(UI_colors[UIIdxWidgetText], 0.5f + 0.5f * analyzer.on_hold()));
+    ImGui::PushStyleColor(ImGuiCol_Text, ImGui::GetColorU32(UI_colors[UIIdxWidgetText], 0.5f + 0.5f * analyzers.on_hold()));
     ImGui::PushStyleColor(ImGuiCol_Button, UI_colors[UIIdxWidget]);
     ImGui::PushStyleColor(ImGuiCol_ButtonHovered, UI_colors[UIIdxWidgetHovered]);
     ImGui::PushStyleColor(ImGuiCol_ButtonActive, UI_colors[UIIdxWidgetActive]);
@@ -2306,17 +3101,99 @@ static void InputControl()
     psysfocus = ImGui::SysWndFocus;
 }
 
+// per frame, with the analyses count about to be drawn; the age of the newest frame analyzed:
+// what the device holds, a period for the capture, and the way from the callback to the frame
+static void MeasureLatency(size_t total_analyze_cnt)
+{
+    auto now = std::chrono::steady_clock::now();
+    if (total_analyze_cnt != latency_meter.analyze_cnt)
+    {
+        latency_meter.analyze_cnt = total_analyze_cnt;
+        int64_t stamp = analysis_stamp.load(std::memory_order_relaxed);
+        if (stamp)
+        {
+            double ms = std::chrono::duration<double, std::milli>(now.time_since_epoch() - std::chrono::nanoseconds(stamp)).count();
+            latency_meter.sum += ms;
+            latency_meter.max = std::max(latency_meter.max, ms);
+            latency_meter.count++;
+        }
+    }
+    if (!latency_meter.count || now - latency_meter.reported < std::chrono::seconds(10))
+        return;
+
+    AudioHandler::LatencyStats ls;
+    if (!audiohandler.getLatencyStats(ls))
+        return;
+    msg_log.LogMsg(LOG_DBG, "Latency: audio to screen %.1f ms, max %.1f; device %u x %u frames%s, callback %.2f ms, max %.2f; %llu xruns",
+                   ls.bufferMs + latency_meter.sum / latency_meter.count, ls.bufferMs + latency_meter.max, ls.periods, ls.periodFrames,
+                   ls.tunedPeriod ? ", low latency" : "", ls.callbackAvgMs, ls.callbackMaxMs, (unsigned long long)ls.xruns);
+    latency_meter.sum = latency_meter.max = 0.0;
+    latency_meter.count = 0;
+    latency_meter.reported = now;
+}
+
+// ms since the lap start, which moves to now
+static double MeterLap(std::chrono::steady_clock::time_point &lap)
+{
+    auto now = std::chrono::steady_clock::now();
+    double ms = std::chrono::duration<double, std::milli>(now - lap).count();
+    lap = now;
+    return ms;
+}
+
+// at the end of Draw(), with its start and the vertices it added
+static void MeasureDraw(std::chrono::steady_clock::time_point start, size_t vtx)
+{
+    auto now = start;
+    double ms = MeterLap(now);
+    draw_meter.sum += ms;
+    draw_meter.max = std::max(draw_meter.max, ms);
+    draw_meter.vtx += vtx;
+    draw_meter.count++;
+    if (now - draw_meter.reported < std::chrono::seconds(10))
+        return;
+
+    size_t count = draw_meter.count, builds = draw_meter.builds;
+    msg_log.LogMsg(LOG_DBG, "Draw: %.3f ms, max %.3f, %zu vertices per frame; cached layers %zu vertices copied in %.3f ms, %zu rebuilds %.3f ms and %zu vertices each",
+                   draw_meter.sum / count, draw_meter.max, draw_meter.vtx / count, draw_meter.copy_vtx / count, draw_meter.copy / count,
+                   builds, builds ? draw_meter.build / builds : 0.0, builds ? draw_meter.build_vtx / builds : 0);
+    draw_meter = {};
+    draw_meter.reported = now;
+}
+
 static void Draw()
 {
+    auto meter_start = std::chrono::steady_clock::now();
+    auto meter_lap = meter_start;
+    int meter_vtx = ImGui::GetWindowDrawList()->VtxBuffer.Size;
     double f_peak;
-    size_t total_analyze_cnt, pitch_buf_pos;
+    size_t total_analyze_cnt, channels, devices;
+    size_t pitch_buf_pos[AnalyzerChannelsMax];
+    size_t dev_buf_pos[AnalyzerChannelsMax];
 
     {
         // cache analyzer state
         std::lock_guard<std::mutex> lock(analyzer_mtx);
         f_peak = analyzer.get_peak_freq();
         total_analyze_cnt = analyzer.get_total_analyze_cnt();
-        pitch_buf_pos = analyzer.get_pitch_buf_pos();
+        channels = analyzers.size();
+        for (size_t ch = 0; ch < channels; ch++)
+            pitch_buf_pos[ch] = analyzers[ch].get_pitch_buf_pos();
+        if (spectrogram)
+            spectrogram_view.Fetch(analyzer);
+    }
+    MeasureLatency(total_analyze_cnt);
+    if (spectrogram)
+        spectrogram_view.Upload();
+    devices = analyzers.device_count();
+    for (size_t n = 0; n < devices; n++)
+    {
+        // align to the main analyzer by the analyze count, lag is bounded by the device drift tolerance
+        std::lock_guard<std::mutex> lock(analyzers.device_mutex(n));
+        HoldingAnalyzer &dev = analyzers.device(n);
+        int64_t lag = (int64_t)total_analyze_cnt - (int64_t)dev.get_total_analyze_cnt();
+        lag = std::clamp<int64_t>(lag, -(int64_t)Analyzer::PITCH_BUF_SIZE / 2, (int64_t)Analyzer::PITCH_BUF_SIZE / 2);
+        dev_buf_pos[n] = dev.get_pitch_buf_pos() + 2 * Analyzer::PITCH_BUF_SIZE + lag;
     }
 
     float c_peak = Analyzer::freq_to_cent(f_peak);
@@ -2346,7 +3223,7 @@ static void Draw()
     c_top = c_pos + wsize.y / c2y_mul;
 
     // do autoscrolling
-    if (autoscroll && !analyzer.on_hold() && ah_state.isActive() && c_peak >= 0.0 && y_ascrl_grace < ImGui::GetTime() && x_offset == 0.0f)
+    if (autoscroll && !analyzers.on_hold() && ah_state.isActive() && c_peak >= 0.0 && y_ascrl_grace < ImGui::GetTime() && x_offset == 0.0f)
     {
         static int velocity = 0;
 
@@ -2357,6 +3234,7 @@ static void Draw()
         else
             velocity = 0;
         c_pos += (float)velocity;
+        animating |= velocity != 0;
     }
 
     // set plot boundaries and feature positions
@@ -2395,10 +3273,13 @@ static void Draw()
     {
         x_offset = (int)(x_offset - std::fmin(50.0f, x_offset / 4.0f)); // just arbitrary easing
         x_off_reset = x_offset > 0;
+        animating |= x_off_reset;
     }
     x_offset = FCLAMP(x_offset, 0.0f, (float)(Analyzer::PITCH_BUF_SIZE - 2 - (int)(x_span / x_zoom)));
     // adjust horizontal zoom
-    x_zoom_min = std::fmax(PlotXZoomMin, x_span / (float)(Analyzer::PITCH_BUF_SIZE - 2)); // limit zoom by pitch buffer size; ignore current pitch buffer element
+    // the minimum covers the same time at any analysis rate
+    const float x_zoom_floor = PlotXZoomMin * (float)AnalyzeRateDef / (float)Analyzer::get_analyze_freq();
+    x_zoom_min = std::fmax(x_zoom_floor, x_span / (float)(Analyzer::PITCH_BUF_SIZE - 2)); // limit zoom by pitch buffer size; ignore current pitch buffer element
     x_zoom = std::fmax(x_zoom, x_zoom_min);
     float x_zoom_scaled = x_zoom * ui_scale;
 
@@ -2430,42 +3311,76 @@ static void Draw()
         }
     }
 
-    // draw vertical grid
+    // draw vertical grid, keys are prebuilt at y = 0 and moved into place
     ImGui::PushFont(font_grid);
     int key_bot = (int)(c_pos / c_dist);
     int key_top = key_bot + (int)(wsize.y / step) + 1;
-    for (int key = key_bot; key <= key_top; ++key)
+    MeterLap(meter_lap);
+    if (grid_cache.Update(x_far, x_near, x_rullbl, align_rullbl, notch, ui_scale, scale_key, scale_major, scale_chroma,
+                          semi_lines, semi_lbls, oct_offset, note_names, plot_colors)
+        || key_bot < grid_first || key_top >= grid_first + (int)grid_cache.Segments())
     {
-        float y = std::roundf(c2y_off - c_dist * key * c2y_mul);
-        int note =   (key + 24) % 12;
-        int note_scaled = (note - scale_key + 12) % 12;
-        int octave = (key + 24) / 12 - 2 + oct_offset; // minus negative truncation compensation ( - 24/12)
-        int line_idx = scale_chroma ? note + 8 : lut_number[scale_major][note_scaled];
-        int label_idx = lut_number[1][note]; // Major scale
-
-        // line
-        if (semi_lines || line_idx)
-            draw_list->AddLine(ImVec2(x_far, y), ImVec2(x_near + notch * !(line_idx - 1), y), plot_colors[line_idx], lut_linew[line_idx] * ui_scale);
-
-        // label
-        if (semi_lbls || label_idx)
-            AddNoteLabel(ImVec2(x_rullbl, y), align_rullbl, TextAlignMiddle, note, semi_lbls << (int)!!label_idx, octave, plot_colors[line_idx], draw_list);
+        // the whole plot range at once, so scrolling never rebuilds
+        grid_first = std::min(key_bot, (int)(c_min / c_dist) - 1);
+        int grid_last = std::max(key_top, (int)(PlotRangeMax / c_dist) + 1);
+        ImDrawList* cache_list = grid_cache.Begin(draw_list);
+        for (int key = grid_first; key <= grid_last; ++key)
+        {
+            int note =   (key + 24) % 12;
+            int note_scaled = (note - scale_key + 12) % 12;
+            int octave = (key + 24) / 12 - 2 + oct_offset; // minus negative truncation compensation ( - 24/12)
+            int line_idx = scale_chroma ? note + 8 : lut_number[scale_major][note_scaled];
+            int label_idx = lut_number[1][note]; // Major scale
+
+            // line
+            if (semi_lines || line_idx)
+                cache_list->AddLine(ImVec2(x_far, 0.0f), ImVec2(x_near + notch * !(line_idx - 1), 0.0f), plot_colors[line_idx], lut_linew[line_idx] * ui_scale);
+
+            // label
+            if (semi_lbls || label_idx)
+                AddNoteLabel(ImVec2(x_rullbl, 0.0f), align_rullbl, TextAlignMiddle, note, semi_lbls << (int)!!label_idx, octave, plot_colors[line_idx], cache_list);
+            grid_cache.Mark();
+        }
+        grid_cache.End();
+        draw_meter.build += MeterLap(meter_lap);
+        draw_meter.build_vtx += grid_cache.Vertices();
+        draw_meter.builds++;
     }
+    int copy_vtx = draw_list->VtxBuffer.Size;
+    for (int key = key_bot; key <= key_top; ++key)
+        grid_cache.Draw(draw_list, ImVec2(0.0f, std::roundf(c2y_off - c_dist * key * c2y_mul)), key - grid_first);
+    draw_meter.copy_vtx += draw_list->VtxBuffer.Size - copy_vtx;
+    draw_meter.copy += MeterLap(meter_lap);
     ImGui::PopFont();
 
+    // draw spectrogram under the pitch, keys are centered on the semitone lines
+    if (spectrogram)
+    {
+        int max_cnt = (int)((x_right - x_left) / x_zoom_scaled);
+        size_t count = std::min<size_t>(max_cnt + 1, Analyzer::PITCH_BUF_SIZE - 1 - (int)x_offset); // not past the current element
+        float y_top = c2y_off - ((Analyzer::CQ_KEYS - 0.5f) * c_dist + c_calib) * c2y_mul;
+        float y_bottom = c2y_off - (-0.5f * c_dist + c_calib) * c2y_mul;
+        draw_list->PushClipRect(ImVec2(x_left, 0.0f), ImVec2(x_right, wsize.y), true);
+        spectrogram_view.Draw(draw_list, pitch_buf_pos[0] + Analyzer::PITCH_BUF_SIZE - 1 - (int)x_offset, count,
+                              x_right, x_zoom_scaled, y_top, y_bottom, plot_colors[PlotIdxSpectrogram]);
+        draw_list->PopClipRect();
+    }
+
     // draw split line
     draw_list->AddLine(ImVec2(x_near, 0), ImVec2(x_near, wsize.y), plot_colors[PlotIdxTonic], lut_linew[PlotIdxTonic] * ui_scale);
 
-    // plot the data
+    // plot the data, the first channel goes on top, capture group devices below the channels
+    for (size_t tr = channels + devices; tr-- > 0; )
     {
         int max_cnt = (int)((x_right - x_left) / x_zoom_scaled);
         float line_w = lut_linew[PlotIdxPitch] * ui_scale;
-        ImU32 color = plot_colors[PlotIdxPitch];
+        ImU32 color = plot_colors[tr ? PlotIdxPitchCh2 + std::min<size_t>(tr, AnalyzerChannelsMax - 1) - 1 : PlotIdxPitch];
         float pp = -1.0f;
         ImVec2 pv;
 
-        auto pitch_buf = analyzer.get_pitch_buf();
-        size_t pitch_buf_offset = pitch_buf_pos + Analyzer::PITCH_BUF_SIZE - 1 - (int)x_offset; // ignore current pitch buffer element
+        bool dev = tr >= channels;
+        auto pitch_buf = dev ? analyzers.device(tr - channels).get_pitch_buf() : analyzers[tr].get_pitch_buf();
+        size_t pitch_buf_offset = (dev ? dev_buf_pos[tr - channels] : pitch_buf_pos[tr] + Analyzer::PITCH_BUF_SIZE) - 1 - (int)x_offset; // ignore current pitch buffer element
         for(int i = 0; i <= max_cnt; ++i) // inclusive
         {
             float p = pitch_buf[(pitch_buf_offset - i) % Analyzer::PITCH_BUF_SIZE];
@@ -2524,35 +3439,50 @@ static void Draw()
                                          plot_colors[PlotIdxTuner]);
 
             ImGui::PushFont(font_tuner);
-            float stop = c_mean + 100.0f;
-            int pos = (int)((c_mean - 100.0f) / 10.0f) * 10;
             ImU32 color = plot_colors[PlotIdxTuner];
-            for ( ; (float)pos <= stop; pos += 10)
+            MeterLap(meter_lap);
+            if (tuner_cache.Update(ui_scale, note_names, color))
             {
-                float x_pos = std::roundf(x_center + ((float)pos - c_mean) * zoom);
-                float linew = lut_linew[PlotIdxSemitone] * ui_scale;
-                switch (pos % 100)
-                {
-                case 0:
+                // ticks are prebuilt at x = 0 and moved into place
+                ImDrawList* cache_list = tuner_cache.Begin(draw_list);
+                for (int pos = 0; pos < 1200; pos += 10)
                 {
-                    int note = pos % 1200 / 100;
-
-                    // tuner note
-                    AddNoteLabel(ImVec2(x_pos, y_long), TextAlignCenter, TextAlignTop,
-                         note, 1 - !!lut_number[1][note], -1, color, draw_list);
-
-                    // long thick tick
-                    linew = lut_linew[PlotIdxSupertonic] * ui_scale;
-                } // fall through
-                case 50:
-                    // long thin tick
-                    draw_list->AddLine(ImVec2(x_pos, y_tuner), ImVec2(x_pos, y_long), color, linew);
-                    break;
-                default:
-                    // short thin tick
-                    draw_list->AddLine(ImVec2(x_pos, y_tuner), ImVec2(x_pos, y_short), color, linew);
+                    float linew = lut_linew[PlotIdxSemitone] * ui_scale;
+                    switch (pos % 100)
+                    {
+                    case 0:
+                    {
+                        int note = pos / 100;
+
+                        // tuner note
+                        AddNoteLabel(ImVec2(0.0f, y_long), TextAlignCenter, TextAlignTop,
+                             note, 1 - !!lut_number[1][note], -1, color, cache_list);
+
+                        // long thick tick
+                        linew = lut_linew[PlotIdxSupertonic] * ui_scale;
+                    } // fall through
+                    case 50:
+                        // long thin tick
+                        cache_list->AddLine(ImVec2(0.0f, y_tuner), ImVec2(0.0f, y_long), color, linew);
+                        break;
+                    default:
+                        // short thin tick
+                        cache_list->AddLine(ImVec2(0.0f, y_tuner), ImVec2(0.0f, y_short), color, linew);
+                    }
+                    tuner_cache.Mark();
                 }
+                tuner_cache.End();
+                draw_meter.build += MeterLap(meter_lap);
+                draw_meter.build_vtx += tuner_cache.Vertices();
+                draw_meter.builds++;
             }
+            float stop = c_mean + 100.0f;
+            int pos = (int)((c_mean - 100.0f) / 10.0f) * 10;
+            int tuner_vtx = draw_list->VtxBuffer.Size;
+            for ( ; (float)pos <= stop; pos += 10)
+                tuner_cache.Draw(draw_list, ImVec2(std::roundf(x_center + ((float)pos - c_mean) * zoom), 0.0f), (pos % 1200 + 1200) % 1200 / 10);
+            draw_meter.copy_vtx += draw_list->VtxBuffer.Size - tuner_vtx;
+            draw_meter.copy += MeterLap(meter_lap);
             ImGui::PopFont();
         }
 
@@ -2560,6 +3490,8 @@ static void Draw()
             AddFmtTextAligned(ImVec2(x_center + x_peak_off * 2.5f, top_feat_pos * ui_scale), TextAlignLeft, TextAlignBottom,
                 plot_colors[PlotIdxTuner], draw_list, "%4.0fHz", f_mean);
     }
+
+    MeasureDraw(meter_start, (size_t)(draw_list->VtxBuffer.Size - meter_vtx));
 }
 
 static void ProcessLog()
@@ -2580,13 +3512,15 @@ static void ProcessLog()
 
     float alpha = 1.0f;
     size_t timedOut = 0;
-    auto& entries = msg_log.LockEntries();
-    for ( auto &entry : entries )
+    Logger::Entry entry;
+    for (unsigned long long N = std::min(nextN, msg_log.LastN()); N > nextN - maxMsgs; --N)
     {
-        if (entry.N > nextN)
+        if (!msg_log.GetEntry(N, entry))
+        {
+            if (!msg_log.IsPending(N))
+                timedOut++; // never shows up, make room for the next one
             continue;
-        if (entry.N <= nextN - maxMsgs)
-            break;
+        }
 
         double time = ImGui::GetTime();
         size_t curMsg = entry.N % maxMsgs;
@@ -2601,23 +3535,20 @@ static void ProcessLog()
 
         ImU32 color = ImGui::GetColorU32(*msg_colors[entry.Lvl],
                 alpha * std::fmin(faderate - std::fabs(std::fmod((float)(MsgTimeout[curMsg] - time) * faderate * 2.0f / msgTimeoutSec, faderate * 2.0f) - faderate), 1.0f));
-        AddTextAligned(pos, TextAlignCenter, TextAlignMiddle, color, draw_list, entry.Msg.get());
+        AddTextAligned(pos, TextAlignCenter, TextAlignMiddle, color, draw_list, entry.Msg);
+        animating = true; // fading
 
         pos.y -= font_def_sz * 1.5f;
         alpha -= alpha_step;
     }
-    msg_log.UnlockEntries();
     nextN += timedOut;
 }
 
 // from src/plug.c:fft_analyze() @ https://github.com/tsoding/musializer
 static void SpectrumWindow(bool *show)
 {
-    static const double fft_binw = Analyzer::SAMPLE_FREQ / Analyzer::FFTSIZE;
-    static const double step = std::pow(2.0, 1.0/12.0);
-    static const double fbot = floor(Analyzer::Analyzer::FREQ_C2 / step) * step;
-    static const double ftop = std::fmin(Analyzer::SAMPLE_FREQ / 2.0, ceil(Analyzer::FREQ_C7 / step) * step);
-    static const size_t keycnt = (size_t)((std::log2(ftop) - std::log2(fbot)) * 12.0 + 1);
+    static const double fbot = Analyzer::FREQ_C1;
+    static const size_t keycnt = Analyzer::CQ_KEYS;
     static std::unique_ptr<float[]> out_log(new float[keycnt]());
     static std::unique_ptr<float[]> out_smooth(new float[keycnt]());
     static size_t p_total_cnt = 0;
@@ -2629,13 +3560,13 @@ static void SpectrumWindow(bool *show)
     ImGui::SetNextWindowPos(
         ImVec2(rullbl_sz.x * !rul_right + widget_margin, (top_feat_pos + 11.0f /* tuner offset + tuner long tick */ + font_tuner_sz) * ui_scale + widget_margin),
         ImGuiCond_Appearing);
-    if (!ImGui::Begin("Spectrum C2..C7", show, ImGuiWindowFlags_NoFocusOnAppearing))
+    if (!ImGui::Begin("Spectrum C1..C8", show, ImGuiWindowFlags_NoFocusOnAppearing))
     {
         ImGui::End();
         return;
     }
 
-    // "Squash" into keys
+    // constant-Q key magnitudes come with the analysis frame
     float max_amp = 1.0f;
     {
         std::lock_guard<std::mutex> lock(analyzer_mtx);
@@ -2643,20 +3574,13 @@ static void SpectrumWindow(bool *show)
         if (total_cnt != p_total_cnt)
         {
             f_peak = analyzer.get_peak_freq();
-            auto fft_buf = analyzer.get_fft_buf();
-            size_t cnt = 0;
-            for (double f = fbot; f <= ftop; f *= step)
+            auto cq_buf = analyzer.get_cq_buf();
+            const float *cq_frame = cq_buf ? &cq_buf[(analyzer.get_pitch_buf_pos() + Analyzer::PITCH_BUF_SIZE - 1) % Analyzer::PITCH_BUF_SIZE * keycnt] : nullptr;
+            for (size_t i = 0; i < keycnt; ++i)
             {
-                size_t q = (size_t)round(f / fft_binw), qtop = (size_t)round(f * step / fft_binw);
-                float a = 0.0f;
-                do
-                {
-                    float b = (float)std::log(Analyzer::power(fft_buf[q * 2], fft_buf[q * 2 + 1]));
-                    if (b > a) a = b;
-                } while (++q < qtop);
+                float a = cq_frame ? 2.0f * std::log(std::fmax(cq_frame[i], 1.0f)) : 0.0f; // log power
                 if (max_amp < a) max_amp = a;
-                IM_ASSERT(cnt < keycnt);
-                out_log[cnt++] = a;
+                out_log[i] = a;
             }
 
             p_total_cnt = total_cnt;
@@ -2686,6 +3610,7 @@ static void SpectrumWindow(bool *show)
     for (size_t i = 0; i < keycnt; ++i)
     {
         out_smooth[i] += (out_log[i] - out_smooth[i]) * smoothness * dt;
+        animating |= std::fabs(out_log[i] - out_smooth[i]) * height > 0.5f; // still easing by half a pixel or more
         rmin.y = rmax.y - std::fmax(margin, out_smooth[i] * height);
         draw_list->AddRectFilled(rmin, rmax, (int)i == n_peak ? plot_colors[PlotIdxPitch] : UI_colors[UIIdxText]);
         rmin.x += adv;
@@ -2757,7 +3682,16 @@ static void SettingsWindow()
         ImGui::TextUnformatted("Volume threshold");
         ImGui::SameLine();
         if (ImGui::SliderFloat("##VolumeThreshold", &vol_thres, VolThresMin, VolThresMax, "%.2f", ImGuiSliderFlags_AlwaysClamp))
-            analyzer.set_threshold((double)vol_thres);
+            analyzers.set_threshold((double)vol_thres);
+        if (ImGui::Checkbox("Analyze channels separately", &per_channel))
+            AdjustPerChannel();
+        if (ImGui::Checkbox("Skip analysis below the threshold", &skip_silence))
+            analyzers.set_gate(skip_silence);
+        ImGui::AlignTextToFramePadding();
+        ImGui::TextUnformatted("Analysis rate");
+        ImGui::SameLine();
+        ImGui::SliderInt("##AnalyzeRate", &analyze_rate, AnalyzeRateMin, AnalyzeRateMax,
+                         analyze_rate == analyze_rate_run ? "%d Hz" : "%d Hz, on restart", ImGuiSliderFlags_AlwaysClamp);
     }
 
     // grid control
@@ -2825,6 +3759,7 @@ static void SettingsWindow()
         ImGui::Indent();
         ImGui::Checkbox("Tuner", &show_tuner);
         ImGui::SameLine(); ImGui::Checkbox("Frequency", &show_freq);
+        ImGui::SameLine(); ImGui::Checkbox("Spectrogram", &spectrogram);
         ImGui::SameLine();
         int samples = (int)f_peak_buf.size();
         if (ImGui::SliderInt("##Smoothing", &samples, TunerSmoothMin, TunerSmoothMax, "smoothing = %d", ImGuiSliderFlags_AlwaysClamp))
@@ -2923,6 +3858,16 @@ static void SettingsWindow()
         ColorPicker("Metronome", plot_colors[PlotIdxMetronome], -FLT_MIN);
         ColorPicker("Note", plot_colors[PlotIdxNote], -FLT_MIN);
         ColorPicker("Tuner", plot_colors[PlotIdxTuner], -FLT_MIN);
+        ColorPicker("Spectrogram", plot_colors[PlotIdxSpectrogram], -FLT_MIN);
+        if (per_channel || analyzers.device_count())
+        {
+            char label[32];
+            for (int i = PlotIdxPitchCh2; i <= PlotIdxPitchChLast; i++)
+            {
+                snprintf(label, IM_ARRAYSIZE(label), "Pitch, %s %d", per_channel ? "channel" : "device", i - PlotIdxPitchCh2 + 2);
+                ColorPicker(label, plot_colors[i], -FLT_MIN);
+            }
+        }
         ImGui::Unindent();
 
         enum { CloseNone = 0, CloseScale, CloseChromatic };
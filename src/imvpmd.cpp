@@ -0,0 +1,359 @@
+// imVocalPitchMonitor headless mode: capture and analyze without any UI,
+// pitch records are streamed as text lines to stdout or a file
+#define NOMINMAX
+#include <cstdio>
+#include <cstdlib>
+#include <cinttypes>
+#include <csignal>
+#include <ctime>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <string>
+#include <sstream>
+
+#include "Analyzer.hpp"
+#include "AudioHandler.h"
+#include "Logger.hpp"
+#include "LogSink.hpp"
+#include "PitchStream.hpp"
+#include "ThreadTuning.hpp"
+#include "version.h"
+
+#include <popl.hpp>
+
+#define _UNUSED_ [[maybe_unused]]
+
+using namespace logger;
+
+// analysis record, one per analyze interval per device
+struct PitchRecord
+{
+    double time;        // seconds on the capture/playback timeline
+    unsigned device;    // 0 is the main device, capture group devices follow
+    double freq;        // Hz, -1 if no pitch
+    float cents;        // cents above C1, -1 if no pitch
+    double confidence;  // 0~1
+    double level;
+};
+
+// analyzer with the frame position tracking, fed from the audio or device worker thread
+struct StreamAnalyzer
+{
+    Analyzer analyzer;
+    uint64_t frames = 0;  // timeline position of the next frame
+    bool synced = false;
+};
+
+static Logger msg_log;
+static LogSink log_sink(msg_log);
+static PitchStream pitch_stream;
+static std::vector<std::unique_ptr<StreamAnalyzer>> analyzers; // [0] main device, then capture group devices
+
+static std::mutex records_mtx;
+static std::condition_variable records_cond;
+static std::deque<PitchRecord> records;
+static std::atomic<bool> quit(false);
+
+static void SignalHandler(_UNUSED_ int signum)
+{
+    quit = true; // picked up by the main loop on the next wakeup
+}
+
+// prints the log entries in order, from the main thread only: the audio threads log too and must not
+// wait on the console, an entry still being written is picked up on the next call
+static void PrintLog()
+{
+    static unsigned long long next = 1;
+    Logger::Entry entry;
+    unsigned long long last = msg_log.LastN();
+    unsigned long long first = last - msg_log.Size() + 1; // the oldest entry still in the ring
+    if (next < first)
+    {
+        fprintf(stderr, "%llu log messages lost\n", first - next);
+        next = first;
+    }
+    for ( ; next <= last; next++)
+    {
+        if (!msg_log.GetEntry(next, entry))
+        {
+            if (msg_log.IsPending(next))
+                break;
+            continue;
+        }
+        fprintf(stderr, "%s: %s\n", Logger::Lvl2Str(entry.Lvl), entry.Msg);
+    }
+}
+
+// feeds interleaved frames, produces a record for each analyze interval
+static void Analyze(unsigned device, const float *data, uint32_t frameCount, uint32_t channels)
+{
+    StreamAnalyzer &sa = *analyzers[device];
+    bool added = false;
+
+    while (frameCount)
+    {
+        // split on the analyze interval boundary to catch every result
+        uint32_t frames = std::min<uint32_t>(frameCount, (uint32_t)(Analyzer::ANALYZE_INTERVAL - sa.frames % Analyzer::ANALYZE_INTERVAL));
+        sa.analyzer.addFrames(data, Analyzer::InputF32, frames, channels); // downmix to mono
+        data += (size_t)frames * channels;
+        sa.frames += frames;
+        frameCount -= frames;
+
+        if (sa.frames % Analyzer::ANALYZE_INTERVAL == 0)
+        {
+            double freq = sa.analyzer.get_peak_freq();
+            std::lock_guard<std::mutex> lock(records_mtx);
+            records.push_back({(double)sa.frames / Analyzer::SAMPLE_FREQ, device, freq, Analyzer::freq_to_cent(freq),
+                               sa.analyzer.get_confidence(), sa.analyzer.get_level()});
+            added = true;
+        }
+    }
+
+    if (added)
+        records_cond.notify_one();
+}
+
+static void SampleCb(_UNUSED_ AudioHandler::Format format, uint32_t channels, const void *pData, uint32_t frameCount, _UNUSED_ void *userData)
+{
+    Analyze(0, (const float*)pData, frameCount, channels);
+}
+
+static void GroupSampleCb(unsigned device, _UNUSED_ AudioHandler::Format format, uint32_t channels, const void *pData, uint32_t frameCount, uint64_t timelinePos, _UNUSED_ void *userData)
+{
+    if (device + 1 >= analyzers.size())
+        return;
+    StreamAnalyzer &sa = *analyzers[device + 1];
+    if (!sa.synced)
+    {
+        // start on the main timeline, in phase with the main analyzer
+        sa.frames = timelinePos;
+        sa.synced = true;
+    }
+    Analyze(device + 1, (const float*)pData, frameCount, channels);
+}
+
+static void EventCb(const AudioHandler::Notification &notification, _UNUSED_ void *userData)
+{
+    switch(notification.event)
+    {
+        case AudioHandler::EventPlayFile:
+            msg_log.LogMsg(LOG_INFO, "Playing %s", notification.dataStr.c_str());
+            break;
+        case AudioHandler::EventRecordFile:
+            msg_log.LogMsg(LOG_INFO, "Recording %s", notification.dataStr.c_str());
+            break;
+        case AudioHandler::EventStop:
+            if (notification.dataU64 == AudioHandler::EventOpPlayback)
+            {
+                quit = true; // end of file
+                records_cond.notify_all();
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+static void WriteRecords(FILE *out)
+{
+    std::deque<PitchRecord> pending;
+    {
+        std::lock_guard<std::mutex> lock(records_mtx);
+        pending.swap(records);
+    }
+    for (const auto &r : pending)
+        fprintf(out, "%.4f\t%u\t%.2f\t%.1f\t%.3f\t%.3f\n", r.time, r.device, r.freq, r.cents, r.confidence, r.level);
+    if (!pending.empty())
+        fflush(out);
+}
+
+int main(int argc, char **argv)
+{
+    msg_log.SetLevel(LOG_INFO);
+
+    popl::OptionParser op("opts");
+    auto help_option        = op.add<popl::Switch>("h", "help", "show this help");
+    auto capture_option     = op.add<popl::Value<std::string>>("i", "capture", "capture device\n(repeat to capture from\nseveral devices at once)");
+    auto playback_option    = op.add<popl::Value<std::string>>("o", "playback", "playback device");
+    auto record_option      = op.add<popl::Switch>("r", "record", "start recording\n(overwrite an existing\nfile without asking)");
+    auto verbose_option     = op.add<popl::Switch>("v", "verbose", "enable debug log");
+    auto output_option      = op.add<popl::Value<std::string>>("f", "output", "write records to file\ninstead of stdout");
+    auto null_option        = op.add<popl::Switch>("n", "null", "use null audio backend\n(no audio hardware)");
+    auto time_option        = op.add<popl::Value<double>>("t", "time", "stop after given seconds");
+    auto shm_option         = op.add<popl::Value<std::string>>("s", "shm", "publish pitch stream to\nshared memory object", PITCHSTREAM_DEFAULT_NAME);
+    auto shm_spectrum_option = op.add<popl::Switch>("", "shm-spectrum", "include spectrum into\nthe pitch stream");
+    auto log_option         = op.add<popl::Value<std::string>>("l", "log", "append log messages\nto file");
+    auto rate_option        = op.add<popl::Value<double>>("a", "rate", "analysis rate, Hz", ANALYZER_ANALYZE_FREQ);
+    auto gate_option        = op.add<popl::Implicit<unsigned>>("g", "gate", "skip analysis of silent frames,\ncheck every Nth while silent", 1);
+    auto rt_option          = op.add<popl::Switch>("", "rt", "realtime priority of the\naudio and analysis threads");
+    auto audio_cpus_option  = op.add<popl::Value<std::string>>("", "audio-cpus", "pin the audio threads\nto cpus, e.g. 0-1,4");
+    auto analysis_cpus_option = op.add<popl::Value<std::string>>("", "analysis-cpus", "pin the capture group\nanalysis threads to cpus");
+    auto mlock_option       = op.add<popl::Switch>("", "mlock", "keep the memory resident,\nno paging on the audio path");
+    auto low_latency_option = op.add<popl::Implicit<unsigned>>("", "low-latency", "small device periods,\nframes", 128);
+
+    try
+    {
+        op.parse(argc, argv);
+    }
+    catch(const std::exception& e)
+    {
+        fprintf(stderr, "Invalid option: %s\n", e.what());
+        return 1;
+    }
+    if (help_option->is_set())
+    {
+        std::stringstream ss;
+        ss << "imvpmd " VER_VERSION_DISPLAY "\nimvpmd [opts] [file]\n" << op;
+        printf("%s", ss.str().c_str());
+        return 0;
+    }
+    if (verbose_option->is_set())
+        msg_log.SetLevel(LOG_DBG);
+    if (log_option->is_set() && !log_sink.Open(log_option->value().c_str()))
+    {
+        fprintf(stderr, "%s: failed to open log file\n", log_option->value().c_str());
+        return 1;
+    }
+    // before any analyzer is made
+    if (rate_option->is_set() && !Analyzer::set_analyze_freq(rate_option->value()))
+    {
+        fprintf(stderr, "Analysis rate should be within %g..%g Hz\n", Analyzer::ANALYZE_FREQ_MIN, Analyzer::ANALYZE_FREQ_MAX);
+        return 1;
+    }
+    uint64_t audio_cpus = 0, analysis_cpus = 0;
+    if ((audio_cpus_option->is_set() && !ThreadTuning::ParseCpuList(audio_cpus_option->value().c_str(), audio_cpus))
+        || (analysis_cpus_option->is_set() && !ThreadTuning::ParseCpuList(analysis_cpus_option->value().c_str(), analysis_cpus)))
+    {
+        fprintf(stderr, "Invalid cpu list, expected e.g. 0-1,4\n");
+        return 1;
+    }
+
+    FILE *out = stdout;
+    if (output_option->is_set())
+    {
+        out = fopen(output_option->value().c_str(), "w");
+        if (!out)
+        {
+            fprintf(stderr, "%s: failed to create file\n", output_option->value().c_str());
+            return 1;
+        }
+    }
+
+    signal(SIGINT, SignalHandler);
+    signal(SIGTERM, SignalHandler);
+
+    analyzers.emplace_back(new StreamAnalyzer());
+    analyzers[0]->analyzer.set_gate(gate_option->is_set(), gate_option->value());
+    if (shm_option->is_set())
+    {
+        if (!pitch_stream.open(shm_option->value().c_str(), 256, shm_spectrum_option->is_set()))
+        {
+            fprintf(stderr, "%s: failed to create pitch stream\n", shm_option->value().c_str());
+            return 1;
+        }
+        analyzers[0]->analyzer.set_analyze_cb(PitchStream::analyze_cb, &pitch_stream);
+    }
+    AudioHandler ah(&msg_log, (uint32_t)Analyzer::SAMPLE_FREQ, 2, AudioHandler::FormatF32, AudioHandler::FormatS16,
+                    (uint32_t)Analyzer::ANALYZE_INTERVAL,
+                    null_option->is_set() ? AudioHandler::BackendNull : AudioHandler::BackendDefault);
+    AudioHandler::State state;
+    if (!ah.getState(state) || !state.isReady())
+    {
+        PrintLog();
+        fprintf(stderr, "Audio backend is not available\n");
+        return 1;
+    }
+
+    ah.attachFrameDataCb(SampleCb);
+    ah.attachGroupFrameDataCb(GroupSampleCb);
+    ah.attachNotificationCb(AudioHandler::EventPlayFile | AudioHandler::EventRecordFile | AudioHandler::EventStop, EventCb);
+    ah.setPlaybackEOFaction(AudioHandler::CmdStop);
+    ah.enumerate();
+
+    if (capture_option->is_set())
+    {
+        ah.setPreferredCaptureDevice(capture_option->value(0).c_str());
+        for (size_t i = 1; i < capture_option->count(); i++)
+        {
+            analyzers.emplace_back(new StreamAnalyzer());
+            analyzers.back()->analyzer.set_gate(gate_option->is_set(), gate_option->value());
+            ah.addCaptureDevice(capture_option->value(i).c_str());
+        }
+    }
+    if (playback_option->is_set())
+        ah.setPreferredPlaybackDevice(playback_option->value().c_str());
+
+    // the main device analysis runs on the audio thread, the capture group ones on the handler workers
+    if (rt_option->is_set() || audio_cpus || analysis_cpus)
+        ah.setThreadPriority(rt_option->is_set() ? AudioHandler::PriorityRealtime : AudioHandler::PriorityDefault, audio_cpus, analysis_cpus);
+    // the analyzers accumulate to the hop, a record is out as soon as it is due
+    if (low_latency_option->is_set())
+        ah.setLowLatency(low_latency_option->value());
+    // everything the analysis needs is allocated by now
+    if (mlock_option->is_set() && !ThreadTuning::LockMemory())
+        msg_log.LogMsg(LOG_WARN, "Failed to lock the memory, check the memlock limit");
+
+    const char *file = op.non_option_args().size() && !op.non_option_args()[0].empty() ? op.non_option_args()[0].c_str() : nullptr;
+    if (record_option->is_set())
+    {
+        std::string name;
+        if (file)
+            name = file;
+        else
+        {
+            char timeString[64];
+            std::time_t time = std::time({});
+            std::strftime(timeString, sizeof(timeString), "%Y%m%d_%H%M%S.wav", std::localtime(&time));
+            name = timeString;
+        }
+        ah.record(name.c_str());
+    }
+    else if (file)
+        ah.play(file);
+    else
+        ah.capture();
+
+    fprintf(out, "# time_s\tdevice\tfreq_hz\tcents\tconfidence\tlevel\n");
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::duration<double>(time_option->is_set() ? time_option->value() : 0.0);
+    while (!quit)
+    {
+        {
+            // records come at the analyze rate, no need to poll
+            std::unique_lock<std::mutex> lock(records_mtx);
+            records_cond.wait_for(lock, std::chrono::milliseconds(200), [] { return quit || !records.empty(); });
+        }
+        WriteRecords(out);
+        PrintLog();
+        if (time_option->is_set() && std::chrono::steady_clock::now() >= deadline)
+            break;
+    }
+
+    AudioHandler::LatencyStats ls;
+    if (ah.getLatencyStats(ls))
+        msg_log.LogMsg(LOG_DBG, "Device %u x %u frames, %.1f ms buffer, callback %.2f ms, max %.2f; %llu xruns",
+                       ls.periods, ls.periodFrames, ls.bufferMs, ls.callbackAvgMs, ls.callbackMaxMs, (unsigned long long)ls.xruns);
+    ah.stop();
+    ah.removeGroupFrameDataCb();
+    ah.removeFrameDataCb();
+    WriteRecords(out);
+    if (out != stdout)
+        fclose(out);
+    for (size_t i = 0; i < analyzers.size(); i++)
+    {
+        Analyzer &a = analyzers[i]->analyzer;
+        if (a.get_gate_frames())
+            msg_log.LogMsg(LOG_DBG, "Device %zu: %zu of %zu frames skipped by the gate, %.1f%%", i,
+                           a.get_gated_cnt(), a.get_gate_frames(), 100.0 * a.get_gated_cnt() / a.get_gate_frames());
+    }
+
+    int error = 0;
+    ah.getError(&error);
+    PrintLog();
+    return error ? 2 : 0;
+}
@@ -0,0 +1,184 @@
+/*
+ * imVocalPitchMonitor pitch stream, shared memory layout and reader
+ *
+ * imvpm publishes every analysis frame into a POSIX shared memory object
+ * (imvpm -s <name>, "/imvpm" by default) laid out as a header followed by a ring of slots.
+ * There is a single writer and any number of readers, nobody blocks anybody:
+ * each slot carries a sequence number, odd while the slot is being written,
+ * readers copy the slot and check the sequence again to detect a concurrent overwrite.
+ * Once attached, neither side makes any syscall per frame.
+ *
+ * reader usage:
+ *     pitchstream_reader r;
+ *     pitchstream_frame f;
+ *     if (pitchstream_open(&r, "/imvpm") == 0) {
+ *         for (;;) {
+ *             int res = pitchstream_read(&r, &f, NULL, 0);
+ *             if (res == PITCHSTREAM_EMPTY) { sleep a bit; continue; }
+ *             if (res == PITCHSTREAM_OVERRUN) { frames were lost, r.lost counts them; continue; }
+ *             use f
+ *         }
+ *         pitchstream_close(&r);
+ *     }
+ *
+ * requires GCC or Clang atomic builtins, link with -lrt on older glibc
+ */
+#ifndef PITCHSTREAM_H
+#define PITCHSTREAM_H
+
+#include <stdint.h>
+#include <string.h>
+
+#define PITCHSTREAM_MAGIC    0x48435450u /* "PTCH" */
+#define PITCHSTREAM_VERSION  1
+#define PITCHSTREAM_DEFAULT_NAME "/imvpm"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct pitchstream_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t header_size;      /* offset of the first slot */
+    uint32_t slot_count;       /* power of two */
+    uint32_t slot_size;        /* bytes, including the spectrum */
+    uint32_t spectrum_bins;    /* magnitudes per frame, 0 if not published */
+    uint32_t sample_rate;      /* Hz */
+    uint32_t analyze_interval; /* frames between analyses */
+    uint64_t write_seq;        /* frames published so far, the next frame index */
+    uint64_t writer_pid;
+} pitchstream_header;
+
+typedef struct pitchstream_frame {
+    uint64_t index;       /* frame index since the writer start */
+    uint64_t analyze_cnt; /* analyzer timeline, matches the GUI plot position */
+    double   timestamp;   /* writer monotonic clock, seconds */
+    double   freq;        /* Hz, -1 if no pitch */
+    double   level;       /* signal level */
+    float    cents;       /* cents above C1, -1 if no pitch */
+    float    confidence;  /* 0~1 */
+} pitchstream_frame;
+
+typedef struct pitchstream_slot {
+    uint64_t seq;         /* 2 * index + 1 while writing, 2 * index + 2 when complete */
+    pitchstream_frame frame;
+    /* float spectrum[spectrum_bins] follows, FFT magnitudes, bin width is sample_rate / 2 / spectrum_bins */
+} pitchstream_slot;
+
+#define PITCHSTREAM_OK        1
+#define PITCHSTREAM_EMPTY     0
+#define PITCHSTREAM_OVERRUN  -1
+#define PITCHSTREAM_ERROR    -2
+
+static inline pitchstream_slot *pitchstream_slot_at(const pitchstream_header *h, uint64_t index)
+{
+    return (pitchstream_slot *)((char *)h + h->header_size + (size_t)(index & (h->slot_count - 1)) * h->slot_size);
+}
+
+static inline float *pitchstream_spectrum(pitchstream_slot *slot)
+{
+    return (float *)(slot + 1);
+}
+
+#if !defined(_WIN32)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+typedef struct pitchstream_reader {
+    const pitchstream_header *header;
+    size_t map_size;
+    uint64_t next;   /* next frame index to read */
+    uint64_t lost;   /* frames overwritten before they were read */
+} pitchstream_reader;
+
+/* attaches to the stream, starts from the latest published frame, returns 0 on success */
+static inline int pitchstream_open(pitchstream_reader *r, const char *name)
+{
+    struct stat st;
+    void *map;
+    int fd = shm_open(name ? name : PITCHSTREAM_DEFAULT_NAME, O_RDONLY, 0);
+    if (fd < 0)
+        return -1;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(pitchstream_header)) {
+        close(fd);
+        return -1;
+    }
+    map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return -1;
+
+    r->header = (const pitchstream_header *)map;
+    r->map_size = (size_t)st.st_size;
+    if (r->header->magic != PITCHSTREAM_MAGIC || r->header->version != PITCHSTREAM_VERSION
+        || (size_t)r->header->header_size + (size_t)r->header->slot_count * r->header->slot_size > r->map_size) {
+        munmap(map, r->map_size);
+        r->header = NULL;
+        return -1;
+    }
+    r->next = __atomic_load_n(&r->header->write_seq, __ATOMIC_ACQUIRE);
+    r->lost = 0;
+    return 0;
+}
+
+static inline void pitchstream_close(pitchstream_reader *r)
+{
+    if (r->header)
+        munmap((void *)r->header, r->map_size);
+    r->header = NULL;
+}
+
+/* reads the next frame, copies up to bins spectrum magnitudes if spectrum is not NULL,
+ * returns PITCHSTREAM_OK, PITCHSTREAM_EMPTY if there is no new frame yet,
+ * or PITCHSTREAM_OVERRUN if the reader fell behind, r->next is moved to the oldest frame available then */
+static inline int pitchstream_read(pitchstream_reader *r, pitchstream_frame *frame, float *spectrum, uint32_t bins)
+{
+    const pitchstream_header *h = r->header;
+    uint64_t written, seq;
+    pitchstream_slot *slot;
+
+    if (!h)
+        return PITCHSTREAM_ERROR;
+    written = __atomic_load_n(&h->write_seq, __ATOMIC_ACQUIRE);
+    if (r->next >= written)
+        return PITCHSTREAM_EMPTY;
+    if (written - r->next > h->slot_count - 1) {
+        /* keep one slot of margin, the writer may be filling it already */
+        uint64_t oldest = written - (h->slot_count - 1);
+        r->lost += oldest - r->next;
+        r->next = oldest;
+        return PITCHSTREAM_OVERRUN;
+    }
+
+    slot = pitchstream_slot_at(h, r->next);
+    seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+    if (seq != 2 * r->next + 2) {
+        if (seq < 2 * r->next + 2)
+            return PITCHSTREAM_EMPTY;
+        r->lost++;
+        r->next++;
+        return PITCHSTREAM_OVERRUN;
+    }
+    memcpy(frame, &slot->frame, sizeof(*frame));
+    if (spectrum && bins)
+        memcpy(spectrum, pitchstream_spectrum(slot), sizeof(float) * (bins < h->spectrum_bins ? bins : h->spectrum_bins));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) != seq) {
+        /* overwritten while copying */
+        r->lost++;
+        r->next++;
+        return PITCHSTREAM_OVERRUN;
+    }
+    r->next++;
+    return PITCHSTREAM_OK;
+}
+#endif /* !_WIN32 */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PITCHSTREAM_H */
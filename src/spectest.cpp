@@ -0,0 +1,241 @@
+// spectrogram texture path check, offscreen on Mesa llvmpipe by default, no window and no GPU needed:
+// the OpenGL backend texture functions and the TextureRing layout drawn with the Dear ImGui OpenGL3 shader,
+// the pixels read back have to show every analysis frame in its place
+#define GL_GLEXT_PROTOTYPES 1
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <GL/glcorearb.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+
+#include "TextureRing.hpp"
+#include "imgui/backends/opengl3_texture.h"
+
+#define COL32(R,G,B,A) (((uint32_t)(A)<<24) | ((uint32_t)(B)<<16) | ((uint32_t)(G)<<8) | ((uint32_t)(R)))
+
+struct Vertex
+{
+    float x, y, u, v;
+    uint32_t col;
+};
+
+// ImDrawList::AddImage() geometry
+static void AddImage(std::vector<Vertex> &vtx, float x0, float y0, float x1, float y1, float u0, float v0, float u1, float v1, uint32_t col)
+{
+    Vertex a{x0, y0, u0, v0, col}, b{x1, y0, u1, v0, col}, c{x1, y1, u1, v1, col}, d{x0, y1, u0, v1, col};
+    vtx.insert(vtx.end(), {a, b, c, a, c, d});
+}
+
+// the Dear ImGui OpenGL3 backend shaders, GLSL 130
+static const char *vertex_shader =
+    "#version 130\n"
+    "uniform mat4 ProjMtx;\n"
+    "in vec2 Position;\n"
+    "in vec2 UV;\n"
+    "in vec4 Color;\n"
+    "out vec2 Frag_UV;\n"
+    "out vec4 Frag_Color;\n"
+    "void main()\n"
+    "{\n"
+    "    Frag_UV = UV;\n"
+    "    Frag_Color = Color;\n"
+    "    gl_Position = ProjMtx * vec4(Position.xy,0,1);\n"
+    "}\n";
+static const char *fragment_shader =
+    "#version 130\n"
+    "uniform sampler2D Texture;\n"
+    "in vec2 Frag_UV;\n"
+    "in vec4 Frag_Color;\n"
+    "out vec4 Out_Color;\n"
+    "void main()\n"
+    "{\n"
+    "    Out_Color = Frag_Color * texture(Texture, Frag_UV.st);\n"
+    "}\n";
+
+static bool InitContext()
+{
+    EGLDisplay dpy = eglGetPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+    EGLint major, minor;
+    if (dpy == EGL_NO_DISPLAY || !eglInitialize(dpy, &major, &minor) || !eglBindAPI(EGL_OPENGL_API))
+        return false;
+    EGLint context_attrs[] = { EGL_CONTEXT_MAJOR_VERSION, 3, EGL_CONTEXT_MINOR_VERSION, 0, EGL_NONE };
+    EGLContext ctx = eglCreateContext(dpy, EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, context_attrs);
+    return ctx != EGL_NO_CONTEXT && eglMakeCurrent(dpy, EGL_NO_SURFACE, EGL_NO_SURFACE, ctx);
+}
+
+static GLuint InitProgram()
+{
+    GLuint vs = glCreateShader(GL_VERTEX_SHADER), fs = glCreateShader(GL_FRAGMENT_SHADER);
+    glShaderSource(vs, 1, &vertex_shader, nullptr);
+    glCompileShader(vs);
+    glShaderSource(fs, 1, &fragment_shader, nullptr);
+    glCompileShader(fs);
+    GLuint program = glCreateProgram();
+    glAttachShader(program, vs);
+    glAttachShader(program, fs);
+    glLinkProgram(program);
+    glDeleteShader(vs);
+    glDeleteShader(fs);
+    GLint linked = 0;
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    return linked ? program : 0;
+}
+
+// level of a key in the frame of the given analysis count, distinct for the neighbours
+static int Level(size_t count, size_t key)
+{
+    return (int)((count * 7 + key * 3) % 200) + 40;
+}
+
+int main(int argc, char **argv)
+{
+    size_t size = 1800;     // texture columns, 30 Hz x 60 s
+    size_t keys = 85;       // C1..C8
+    int width = 600;        // view columns, a pixel each
+    bool gpu = false;
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-s") && i + 1 < argc)
+            size = (size_t)std::max(2L, std::strtol(argv[++i], NULL, 0));
+        else if (!strcmp(argv[i], "-w") && i + 1 < argc)
+            width = (int)std::max(1L, std::strtol(argv[++i], NULL, 0));
+        else if (!strcmp(argv[i], "-g"))
+            gpu = true;
+        else
+        {
+            printf("Usage: %s [-s texture_columns] [-w view_columns] [-g]\n", argv[0]);
+            printf("  full and per column uploads wrapping the ring, each checked in the pixels read back,\n");
+            printf("  runs on llvmpipe unless -g lets Mesa pick the GPU driver\n");
+            return -1;
+        }
+    }
+    if (!gpu)
+        setenv("LIBGL_ALWAYS_SOFTWARE", "1", 1);
+
+    if (!InitContext())
+    {
+        printf("FAILED: no EGL surfaceless OpenGL 3.0 context\n");
+        return 1;
+    }
+    printf("renderer: %s, %s\n", glGetString(GL_RENDERER), glGetString(GL_VERSION));
+
+    GLuint fbo, rb;
+    glGenFramebuffers(1, &fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glGenRenderbuffers(1, &rb);
+    glBindRenderbuffer(GL_RENDERBUFFER, rb);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, (GLsizei)keys);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, rb);
+    GLuint program = InitProgram();
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE || !program)
+    {
+        printf("FAILED: no framebuffer or shaders\n");
+        return 1;
+    }
+
+    GLuint vao, vbo;
+    glGenVertexArrays(1, &vao);
+    glBindVertexArray(vao);
+    glGenBuffers(1, &vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    GLint position = glGetAttribLocation(program, "Position"), uv = glGetAttribLocation(program, "UV"), color = glGetAttribLocation(program, "Color");
+    glEnableVertexAttribArray(position);
+    glEnableVertexAttribArray(uv);
+    glEnableVertexAttribArray(color);
+    glVertexAttribPointer(position, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, x));
+    glVertexAttribPointer(uv, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, u));
+    glVertexAttribPointer(color, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Vertex), (void*)offsetof(Vertex, col));
+    // top left origin as the ImGui display
+    const float w = (float)width, h = (float)keys;
+    const float ortho[16] = { 2.0f / w, 0.0f, 0.0f, 0.0f,  0.0f, -2.0f / h, 0.0f, 0.0f,  0.0f, 0.0f, -1.0f, 0.0f,  -1.0f, 1.0f, 0.0f, 1.0f };
+    glUseProgram(program);
+    glUniformMatrix4fv(glGetUniformLocation(program, "ProjMtx"), 1, GL_FALSE, ortho);
+    glUniform1i(glGetUniformLocation(program, "Texture"), 0);
+    glViewport(0, 0, width, (GLsizei)keys);
+
+    GLuint texture = GL3CreateTexture((int)size, (int)keys);
+    if (!texture)
+    {
+        printf("FAILED: no %zux%zu texture\n", size, keys);
+        return 1;
+    }
+
+    // a full upload as on enable, then per column ones as the frames come, wrapping the ring a few times
+    std::vector<uint32_t> pixels;
+    std::vector<Vertex> vtx;
+    std::vector<uint32_t> out((size_t)width * keys);
+    size_t total = 0, failures = 0;
+    for (int round = 0; round < 6; ++round)
+    {
+        if (round == 0)
+        {
+            pixels.assign(size * keys, 0);
+            for (size_t i = 0; i < size; ++i, ++total)
+                for (size_t k = 0; k < keys; ++k)
+                    pixels[k * size + total % size] = COL32(255, 255, 255, Level(total, k));
+            GL3UpdateTexture(texture, 0, 0, (int)size, (int)keys, pixels.data());
+        }
+        else
+        {
+            pixels.resize(keys);
+            size_t add = size * 2 / 5 + round * 37;
+            for (size_t i = 0; i < add; ++i, ++total)
+            {
+                for (size_t k = 0; k < keys; ++k)
+                    pixels[k] = COL32(255, 255, 255, Level(total, k));
+                GL3UpdateTexture(texture, (int)(total % size), 0, 1, (int)keys, pixels.data());
+            }
+        }
+
+        // as Spectrogram::Draw(), the newest column at the right edge, the highest key on top
+        size_t newest = total - 1;
+        size_t count = std::min((size_t)width, size);
+        TextureRingSpan spans[2];
+        size_t n = TextureRingSpans(size, newest, count, spans);
+        float x = w - (float)count;
+        vtx.clear();
+        for (size_t i = 0; i < n; ++i)
+        {
+            float x_next = x + (float)spans[i].count;
+            AddImage(vtx, x, 0.0f, x_next, h, (float)spans[i].first / size, 1.0f, (float)(spans[i].first + spans[i].count) / size, 0.0f, COL32(255, 255, 255, 255));
+            x = x_next;
+        }
+        glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)(vtx.size() * sizeof(Vertex)), vtx.data(), GL_STREAM_DRAW);
+        glDrawArrays(GL_TRIANGLES, 0, (GLsizei)vtx.size());
+        glReadPixels(0, 0, width, (GLsizei)keys, GL_RGBA, GL_UNSIGNED_BYTE, out.data());
+        if (glGetError() != GL_NO_ERROR)
+        {
+            printf("FAILED: GL error\n");
+            return 1;
+        }
+
+        // rows are read bottom up, the lowest key first
+        size_t bad = 0;
+        for (int px = width - (int)count; px < width; ++px)
+            for (size_t k = 0; k < keys; ++k)
+            {
+                size_t frame = newest - (size_t)(width - 1 - px);
+                int want = Level(frame, k);
+                int got = (int)(out[k * width + px] >> 24);
+                if (std::abs(got - want) > 2 && bad++ < 5)
+                    printf("  column %d key %zu: level %d, expected %d\n", px, k, got, want);
+            }
+        printf("round %d: newest frame %zu at texture column %zu, %zu spans, %zu mismatches\n", round, newest, newest % size, n, bad);
+        failures += bad;
+    }
+
+    GL3DestroyTexture(texture);
+    if (failures)
+    {
+        printf("FAILED: %zu pixels do not show their frame\n", failures);
+        return 1;
+    }
+    return 0;
+}
@@ -9,8 +9,10 @@
 #include <cinttypes>
 #include <cstring>
 #include <cerrno>
+#include <vector>
 
 #include "Analyzer.hpp"
+#include "WorkerPool.hpp"
 
 #if defined(__GNUC__) || defined(__clang__)
 #pragma GCC diagnostic push
@@ -30,6 +32,7 @@ typedef                            ma_float       sample_t;
 typedef struct _ctx_t
 {
     Analyzer analyzer;
+    std::vector<std::unique_ptr<Analyzer>> ch_analyzers; // per-channel mode analyzers
     ma_device device;
     const char *infile;
     std::unique_ptr<sample_t[]> framebuf;
@@ -70,6 +73,131 @@ uint64_t analyze_frames(ctx_t &ctx, uint64_t from, uint64_t count)
     return ret;
 }
 
+// analyzes first nch channels separately, in parallel if pool is given
+uint64_t analyze_channels(ctx_t &ctx, uint64_t from, uint64_t count, uint32_t nch, WorkerPool *pool)
+{
+    assert(from < ctx.totalPCMFrameCount);
+    assert(nch <= ctx.ch_analyzers.size() && nch <= ctx.channels);
+    if (ctx.totalPCMFrameCount - from < count)
+        count = ctx.totalPCMFrameCount - from;
+    const sample_t *bufptr = ctx.framebuf.get() + from * ctx.channels;
+    auto job = [&](size_t ch) { ctx.ch_analyzers[ch]->addData(bufptr + ch, (size_t)count, ctx.channels); };
+    if (pool)
+        pool->run(nch, job);
+    else
+        for (uint32_t ch = 0; ch < nch; ++ch)
+            job(ch);
+    return count;
+}
+
+// per-channel analysis cost, serial vs parallel, for 1..channels channels
+void bench_channels(ctx_t &ctx)
+{
+    const int cnt = 3;
+    WorkerPool pool(ctx.channels - 1);
+    for (uint32_t ch = 0; ch < ctx.channels; ++ch)
+        ctx.ch_analyzers.emplace_back(new Analyzer());
+
+    const double events = (double)ctx.totalPCMFrameCount / Analyzer::ANALYZE_INTERVAL * cnt;
+    double base = 0.0;
+    printf("%u worker threads\n", (unsigned)pool.size());
+    for (uint32_t nch = 1; nch <= ctx.channels; ++nch)
+    {
+        double us[2];
+        for (int parallel = 0; parallel < 2; ++parallel)
+        {
+            std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+            for (int i = 0; i < cnt; ++i)
+            {
+                uint64_t offset = 0;
+                while (offset < ctx.totalPCMFrameCount)
+                    offset += analyze_channels(ctx, offset, Analyzer::ANALYZE_INTERVAL, nch, parallel ? &pool : nullptr);
+            }
+            std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+            us[parallel] = (double)std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count() / events / nch;
+        }
+        if (nch == 1)
+            base = us[1];
+        printf("%u ch: serial %.2f us/ch/event, parallel %.2f us/ch/event, %.2f of single channel cost\n",
+            nch, us[0], us[1], us[1] / base);
+    }
+}
+
+// single stream analysis load at various rates, the analyses due within an audio callback period
+// are run on 0..hardware concurrency - 1 workers, the load is the share of real time spent
+void bench_rates(ctx_t &ctx, double rate)
+{
+    const double rates[] = { 30.0, 60.0, 120.0, 200.0, 240.0, 500.0 };
+    const size_t period = 441; // callback period floor, frames, as imvpm uses
+    const double duration = (double)ctx.totalPCMFrameCount / ctx.sampleRate;
+    unsigned int hc = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<sample_t> mono(ctx.totalPCMFrameCount);
+    for (uint64_t i = 0; i < ctx.totalPCMFrameCount; ++i)
+        mono[i] = ctx.framebuf[i * ctx.channels];
+
+    for (double r : rates)
+    {
+        if (rate > 0.0)
+            r = rate;
+        if (!Analyzer::set_analyze_freq(r))
+        {
+            printf("rate should be within %g..%g Hz\n", Analyzer::ANALYZE_FREQ_MIN, Analyzer::ANALYZE_FREQ_MAX);
+            return;
+        }
+        const size_t block = Analyzer::ANALYZE_INTERVAL * ((period + Analyzer::ANALYZE_INTERVAL - 1) / Analyzer::ANALYZE_INTERVAL);
+        printf("%.2f Hz, %zu analyses per %zu frame callback\n", Analyzer::get_analyze_freq(), block / Analyzer::ANALYZE_INTERVAL, block);
+        for (unsigned int workers = 0; workers < hc; ++workers)
+        {
+            WorkerPool pool(workers);
+            Analyzer analyzer;
+            std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+            for (uint64_t offset = 0; offset < ctx.totalPCMFrameCount; offset += block)
+                analyzer.addData(mono.data() + offset, (size_t)std::min<uint64_t>(block, ctx.totalPCMFrameCount - offset), 1, &pool);
+            std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+            double sec = (double)std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count() / 1000000.0;
+            double load = sec / duration;
+            printf("  %u workers: %.1f%% load, sustains up to %.0f Hz\n", workers, load * 100.0, Analyzer::get_analyze_freq() / load);
+        }
+        if (rate > 0.0)
+            break;
+    }
+}
+
+// energy pre-gate effect: the share of frames skipped and the analysis time saved, the pitch is checked to match
+void bench_gate(ctx_t &ctx, double threshold)
+{
+    const int cnt = 3;
+    double us[2];
+    size_t frames = 0, skipped = 0, mismatch = 0;
+    std::vector<float> pitch[2];
+    for (int gated = 0; gated < 2; ++gated)
+    {
+        std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+        for (int i = 0; i < cnt; ++i)
+        {
+            Analyzer analyzer;
+            analyzer.set_threshold(threshold);
+            analyzer.set_gate(gated != 0);
+            for (uint64_t offset = 0; offset < ctx.totalPCMFrameCount; offset += Analyzer::ANALYZE_INTERVAL)
+            {
+                size_t n = (size_t)std::min<uint64_t>(Analyzer::ANALYZE_INTERVAL, ctx.totalPCMFrameCount - offset);
+                size_t count = analyzer.get_total_analyze_cnt();
+                analyzer.addData(ctx.framebuf.get() + offset * ctx.channels, n, ctx.channels);
+                if (i == 0 && count != analyzer.get_total_analyze_cnt())
+                    pitch[gated].push_back((float)analyzer.get_peak_freq());
+            }
+            frames = analyzer.get_gate_frames();
+            skipped = analyzer.get_gated_cnt();
+        }
+        std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+        us[gated] = (double)std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count() / cnt;
+    }
+    for (size_t i = 0; i < pitch[0].size() && i < pitch[1].size(); ++i)
+        mismatch += pitch[0][i] != pitch[1][i];
+    printf("threshold %g: %zu of %zu frames skipped (%.1f%%), %.0f us -> %.0f us, %.1f%% saved, %zu pitch mismatches\n",
+        threshold, skipped, frames, frames ? 100.0 * skipped / frames : 0.0, us[0], us[1], 100.0 * (1.0 - us[1] / us[0]), mismatch);
+}
+
 int create_pitch_map(ctx_t &ctx, const char *outfile)
 {
     std::ofstream of;
@@ -154,6 +282,9 @@ int main(int argc, char **argv)
         printf("  p: play file <file.wav>\n");
         printf("  c: create pitch map for file <file.wav>\n");
         printf("  b: benchmark on <file.wav>\n");
+        printf("  m: per-channel benchmark on <file.wav> [channels]\n");
+        printf("  r: analysis rate benchmark on <file.wav> [rate]\n");
+        printf("  g: energy pre-gate benchmark on <file.wav> [threshold]\n");
         printf("  d: FFT dump at frame <file.wav> <frame> [back_intervals]\n");
         printf("  e: print detection error at frame <file.wav> <frame> <ref_value> [max_err_cents]\n");
         return -1;
@@ -164,7 +295,13 @@ int main(int argc, char **argv)
     ctx_t ctx = { };
     ctx.infile = argv[2];
 
-    result = load_file(ctx, op == 'p' ? 2 : 1);
+    ma_uint32 nch = 1;
+    if (op == 'p')
+        nch = 2;
+    else if (op == 'm')
+        nch = argc > 3 ? (ma_uint32)std::max(1L, std::min(std::strtol(argv[3], NULL, 0), (long)MA_MAX_CHANNELS)) : 4;
+
+    result = load_file(ctx, nch);
     if (result != MA_SUCCESS)
     {
         printf("failed to open %s: %s\n", ctx.infile, ma_result_description(result));
@@ -210,6 +347,15 @@ int main(int argc, char **argv)
             printf("%.2f events/s\n", (double)ctx.totalPCMFrameCount / Analyzer::ANALYZE_INTERVAL * cnt *
                 1000000UL / std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count());
         } break;
+        case 'm':
+            bench_channels(ctx);
+        break;
+        case 'g':
+            bench_gate(ctx, argc > 3 ? strtod(argv[3], nullptr) : 2.0);
+        break;
+        case 'r':
+            bench_rates(ctx, argc > 3 ? strtod(argv[3], nullptr) : 0.0);
+        break;
         case 'd':
         {
             if (argc < 4)